@@ -0,0 +1,72 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-compile-css.c: pre-compile style sheets
+ *
+ * Copyright 2010 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Writes the parsed form of each style sheet given on the command line next
+ * to it (FILENAME.cssc for FILENAME.css), where MxStyle finds and maps it
+ * instead of parsing the style sheet when it is loaded. A compiled file that
+ * no longer matches its style sheet is ignored, so style sheets can still be
+ * edited without running this again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mx-css.h"
+
+int
+main (int    argc,
+      char **argv)
+{
+  const gchar *output = NULL;
+  gint i, first, status;
+
+  first = 1;
+  if (argc > 2 && !strcmp (argv[1], "-o"))
+    {
+      output = argv[2];
+      first = 3;
+    }
+
+  if (first >= argc || (output && argc - first != 1))
+    {
+      g_printerr ("Usage:\n"
+                  "\tmx-compile-css <file>...\n"
+                  "\tmx-compile-css -o <output> <file>\n");
+      return EXIT_FAILURE;
+    }
+
+  g_type_init ();
+
+  status = EXIT_SUCCESS;
+  for (i = first; i < argc; i++)
+    {
+      GError *error = NULL;
+
+      if (!mx_style_sheet_compile_file (argv[i], output, &error))
+        {
+          g_printerr ("mx-compile-css: %s\n", error->message);
+          g_error_free (error);
+          status = EXIT_FAILURE;
+        }
+    }
+
+  return status;
+}
@@ -28,26 +28,39 @@
 #include <string.h>
 #include <assert.h>
 #include <stdint.h>
+#include <limits.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#include "mx-image-cache.h"
+
 
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
 
+/* Images are placed with a one pixel copy of their edges around them, so
+ * that filtering never samples their neighbours. width and height include
+ * that border. */
 struct imgcache_element {
-  char  filename[256];
-  int   width, height;
-  int   posX, posY;
-  void *ptr;
+  char     filename[256];
+  int      width, height;
+  int      posX, posY;
+  void    *ptr;
+  guint64  mtime;
+  guint64  size;
 };
 
 GList *images;
 
 int totalarea = 0;
 
+/* the length of the path of the directory being cached, names are stored
+ * relative to it */
+int base_length = 0;
+
 
 int sizes[] = { 0, 256, 384, 512, 640, 768, 896, 1024, 1280, 1536, 1792,  2048, -1};
 
@@ -67,12 +80,41 @@ static gint sort_by_size(gconstpointer a,
   return 0;
 
 }
+static GdkPixbuf *pad_image(GdkPixbuf *image)
+{
+  GdkPixbuf *rgba, *padded;
+  int w, h;
+
+  rgba = gdk_pixbuf_add_alpha(image, FALSE, 0, 0, 0);
+  w = gdk_pixbuf_get_width(rgba);
+  h = gdk_pixbuf_get_height(rgba);
+
+  padded = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w + 2, h + 2);
+  assert(padded != NULL);
+
+  /* the image, its top and bottom rows, then its left and right columns
+   * including the corners */
+  gdk_pixbuf_copy_area(rgba, 0, 0, w, h, padded, 1, 1);
+  gdk_pixbuf_copy_area(rgba, 0, 0, w, 1, padded, 1, 0);
+  gdk_pixbuf_copy_area(rgba, 0, h - 1, w, 1, padded, 1, h + 1);
+  gdk_pixbuf_copy_area(padded, 1, 0, 1, h + 2, padded, 0, 0);
+  gdk_pixbuf_copy_area(padded, w, 0, 1, h + 2, padded, w + 1, 0);
+
+  g_object_unref(rgba);
+
+  return padded;
+}
+
 static void do_one_file(char *filename)
 {
   GdkPixbuf *image;
   struct imgcache_element *element;
+  struct stat st;
+
+  if (strlen(filename + base_length) >= 256)
+    return;
 
-  if (strlen(filename) >= 256)
+  if (g_stat(filename, &st))
     return;
 
   image = gdk_pixbuf_new_from_file(filename, NULL);
@@ -96,13 +138,16 @@ static void do_one_file(char *filename)
     }
 
   memset(element, 0, sizeof(struct imgcache_element));
-  element->width = gdk_pixbuf_get_width(image);
-  element->height = gdk_pixbuf_get_height(image);
+  element->ptr = pad_image(image);
+  gdk_pixbuf_unref(image);
+  element->width = gdk_pixbuf_get_width(element->ptr);
+  element->height = gdk_pixbuf_get_height(element->ptr);
   element->posX = -1;
   element->posY = -1;
-  element->ptr = image;
+  element->mtime = st.st_mtime;
+  element->size = st.st_size;
   totalarea += element->width * element->height;
-  strncpy(element->filename, filename, 256);
+  strncpy(element->filename, filename + base_length, 256);
 
   if (element->width > sizes[0])
     sizes[0] = element->width;
@@ -146,7 +191,7 @@ static inline uint32_t get_pixel(struct imgcache_element *element,
   p += Y * gdk_pixbuf_get_rowstride(buf);
   p += X * 4;
 
-  return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
 }
 
 static int can_scooch(struct imgcache_element *one,
@@ -341,7 +386,7 @@ static void optimal_placement(void)
   printf("Best score is %i, %0.1f %% waste\n", best_score, (100.0*best_score / totalarea) -100.0);
 }
 
-static int make_final_image(char *filename)
+static GdkPixbuf *make_final_image(void)
 {
   int maxX = 0, maxY = 0;
   struct imgcache_element *element;
@@ -362,9 +407,9 @@ static int make_final_image(char *filename)
   printf("Final image is %ix%i\n", maxX, maxY);
 
   if (!maxX)
-    return 0;
+    return NULL;
   if (!maxY)
-    return 0;
+    return NULL;
   final = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, maxX, maxY);
   assert(final != NULL);
 
@@ -377,8 +422,7 @@ static int make_final_image(char *filename)
       gdk_pixbuf_copy_area(element->ptr, 0, 0, element->width, element->height, final, element->posX, element->posY);
     }
 
-  gdk_pixbuf_save(final, filename, "png", NULL, NULL);
-  return 1;
+  return final;
 }
 
 static void makecache(char *directory,
@@ -418,52 +462,115 @@ static void makecache(char *directory,
   images = g_list_sort(images, sort_by_size);
 }
 
-static void write_cache_file(char *directory,
-                             char *pngfile)
+static int write_cache_file(char      *directory,
+                            GdkPixbuf *final)
 {
-  FILE *file;
-  char filename[PATH_MAX *2];
-  struct imgcache_element element;
+  MxImageCacheHeader header;
+  MxImageCacheEntry entry;
   struct imgcache_element *elm;
+  GByteArray *data;
+  GString *strings;
   GList *item;
+  GError *error = NULL;
+  char *filename;
+  guchar *pixels;
+  int x, y, rowstride, ret;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MX_IMAGE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MX_IMAGE_CACHE_VERSION;
+  header.byte_order = MX_IMAGE_CACHE_BYTE_ORDER;
+  header.n_images = g_list_length(images);
+  header.width = gdk_pixbuf_get_width(final);
+  header.height = gdk_pixbuf_get_height(final);
+
+  data = g_byte_array_new();
+  g_byte_array_set_size(data, sizeof(header));
+  strings = g_string_new(NULL);
+
+  /* the entries point at the part of each element inside its border */
+  item = g_list_first(images);
+  while (item) {
+      elm = item->data;
+      item = g_list_next(item);
 
-  memset(&element, 0, sizeof(element));
+      memset(&entry, 0, sizeof(entry));
+      entry.name = strings->len;
+      entry.x = elm->posX + 1;
+      entry.y = elm->posY + 1;
+      entry.width = elm->width - 2;
+      entry.height = elm->height - 2;
+      entry.mtime = elm->mtime;
+      entry.size = elm->size;
+      g_byte_array_append(data, (guint8 *)&entry, sizeof(entry));
+
+      g_string_append_len(strings, elm->filename, strlen(elm->filename) + 1);
+    }
 
-  strcpy(&element.filename[0], pngfile);
+  header.strings_offset = data->len;
+  header.strings_size = strings->len;
+  g_byte_array_append(data, (guint8 *)strings->str, strings->len);
+  g_string_free(strings, TRUE);
+
+  /* the pixels are premultiplied, the way they are uploaded */
+  while (data->len % 4)
+    g_byte_array_append(data, (guint8 *)"", 1);
+  header.pixels_offset = data->len;
+
+  pixels = gdk_pixbuf_get_pixels(final);
+  rowstride = gdk_pixbuf_get_rowstride(final);
+  for (y = 0; y < header.height; y++) {
+      for (x = 0; x < header.width; x++) {
+          guchar *p = pixels + y * rowstride + x * 4;
+          guint8 texel[4];
+
+          texel[0] = (p[0] * p[3] + 127) / 255;
+          texel[1] = (p[1] * p[3] + 127) / 255;
+          texel[2] = (p[2] * p[3] + 127) / 255;
+          texel[3] = p[3];
+          g_byte_array_append(data, texel, 4);
+        }
+    }
 
-  sprintf(filename, "%s/mx.cache", directory);
+  memcpy(data->data, &header, sizeof(header));
 
-  file = fopen(filename, "w");
-  if (!file) {
-      fprintf(stderr, "Cannot write cache file: %s\n", filename);
-      return;
+  filename = g_build_filename(directory, MX_IMAGE_CACHE_NAME, NULL);
+  ret = g_file_set_contents(filename, (gchar *)data->data, data->len, &error);
+  if (!ret) {
+      fprintf(stderr, "Cannot write cache file: %s\n", error->message);
+      g_error_free(error);
     }
-  fwrite(&element, 1, sizeof(element), file);
+  else
+    printf("Wrote %i images to %s\n", header.n_images, filename);
 
-  item = g_list_first(images);
-  while (item) {
-      elm = item->data;
-      item = g_list_next(item);
-      elm->ptr = NULL;
-      fwrite(elm, 1, sizeof(element), file);
-    }
-  fclose(file);
+  g_free(filename);
+  g_byte_array_free(data, TRUE);
 
+  return ret;
 }
 
 int main(int    argc,
          char **argv)
 {
-  char image_file[PATH_MAX];
+  GdkPixbuf *final;
+  int ret;
+
   if (argc <= 1) {
-      printf("Usage:\n\t\tmakecache <directory>\n");
+      printf("Usage:\n\t\tmx-create-image-cache <directory>\n");
       return EXIT_FAILURE;
     }
   g_type_init();
+  /* skip the directory and the separator after it */
+  base_length = strlen(argv[1]);
+  while (base_length > 1 && argv[1][base_length - 1] == '/')
+    base_length--;
+  base_length++;
   makecache(argv[1], 1);
   optimal_placement();
-  sprintf(image_file, "/var/cache/mx/%08x.png", g_str_hash(argv[1]));
-  if (make_final_image(image_file))
-    write_cache_file(argv[1], image_file);
-  return EXIT_SUCCESS;
+  final = make_final_image();
+  if (!final)
+    return EXIT_SUCCESS;
+  ret = write_cache_file(argv[1], final);
+  g_object_unref(final);
+  return ret ? EXIT_SUCCESS : EXIT_FAILURE;
 }
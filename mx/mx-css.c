@@ -21,9 +21,6 @@
 #include <clutter/clutter.h>
 #include <string.h>
 
-#include <unistd.h>
-#include <fcntl.h>
-
 #include "mx-private.h"
 
 struct _MxStyleSheet
@@ -31,6 +28,29 @@ struct _MxStyleSheet
   GList *selectors;
   GList *styles;
   GList *filenames;
+
+  /* all the names and values in the style sheet */
+  GStringChunk *strings;
+
+  /* compiled style sheets, which the selectors and values point into */
+  GList *mapped_files;
+
+  /* Selectors bucketed by the most specific part of their right-most simple
+   * selector, so that matching only has to consider rules that could
+   * possibly apply to a node */
+  GHashTable *id_rules;
+  GHashTable *class_rules;
+  GHashTable *type_rules;
+  GPtrArray  *universal_rules;
+
+  /* The ids, classes and pseudo-classes tested by the parent and ancestor
+   * parts of the selectors. A change to any other part of a stylable's
+   * state cannot change the rules that match its descendants. */
+  GHashTable *ancestor_ids;
+  GHashTable *ancestor_classes;
+  GHashTable *ancestor_pseudo_classes;
+
+  guint n_selectors;
 };
 
 typedef struct _MxSelector MxSelector;
@@ -47,250 +67,427 @@ struct _MxSelector
   guint line;
   guint position;
   gint priority;
+  guint index; /* order of the selector in the style sheet */
 };
 
 
 /* MxStyleSheetValue */
 
 static MxStyleSheetValue *
-mx_style_sheet_value_new ()
+mx_style_sheet_value_new (const gchar *string,
+                          const gchar *source)
 {
-  return g_slice_new0 (MxStyleSheetValue);
+  MxStyleSheetValue *value;
+
+  value = g_slice_new0 (MxStyleSheetValue);
+  value->string = string;
+  value->source = source;
+
+  return value;
 }
 
 static void
 mx_style_sheet_value_free (MxStyleSheetValue *value)
 {
+  if (value->values)
+    {
+      guint i;
+
+      for (i = 0; i < value->values->len; i++)
+        g_value_unset (&g_array_index (value->values, GValue, i));
+
+      g_array_free (value->values, TRUE);
+    }
+
   g_slice_free (MxStyleSheetValue, value);
 }
 
 
-static gchar*
-append (gchar *str1, const gchar *str2)
+/* Tokenizer
+ *
+ * The style sheet is tokenized in a single pass over the mapped file. Names
+ * are interned and values are copied once into the string arena owned by
+ * the style sheet, so parsing does not allocate per token or per character.
+ */
+
+typedef enum
+{
+  CSS_TOKEN_EOF,
+  CSS_TOKEN_IDENTIFIER,
+  CSS_TOKEN_CHAR
+} CssTokenType;
+
+typedef struct
+{
+  CssTokenType type;
+  const gchar *start;
+  gsize        len;
+} CssToken;
+
+typedef struct
 {
-  gchar *tmp;
+  MxStyleSheet *sheet;
+  const gchar  *filename;
+  gint          priority;
+
+  const gchar  *p;
+  const gchar  *end;
+  guint         line;
+  guint         position;
+
+  GString      *scratch;
+} CssScanner;
+
+#define CSS_IS_SPACE(c) \
+  ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
 
-  if (!str1)
-      return g_strdup (str2);
+#define CSS_IS_IDENTIFIER_FIRST(c) \
+  (g_ascii_isalpha (c) || (c) == '_' || ((guchar) (c)) >= 0x80)
 
-  if (!str2)
-      return str1;
+#define CSS_IS_IDENTIFIER_NTH(c) \
+  (CSS_IS_IDENTIFIER_FIRST (c) || g_ascii_isdigit (c) || (c) == '-')
 
-  tmp = g_strconcat (str1, str2, NULL);
-  g_free (str1);
-  return tmp;
+#define CSS_TOKEN_IS_CHAR(token, c) \
+  ((token)->type == CSS_TOKEN_CHAR && *(token)->start == (c))
+
+static void
+css_scanner_advance (CssScanner *scanner,
+                     gsize       n_chars)
+{
+  const gchar *end = scanner->p + n_chars;
+
+  for (; scanner->p < end; scanner->p++)
+    {
+      if (*scanner->p == '\n')
+        {
+          scanner->line++;
+          scanner->position = 0;
+        }
+      else
+        scanner->position++;
+    }
 }
 
-static gchar*
-appendc (gchar *str, gchar c)
+static gboolean
+css_scanner_skip_comment (CssScanner *scanner)
 {
-  gchar *tmp;
-  gint len;
+  const gchar *p = scanner->p;
+
+  if (scanner->end - p < 2 || p[0] != '/' || p[1] != '*')
+    return FALSE;
+
+  for (p += 2; p + 1 < scanner->end; p++)
+    if (p[0] == '*' && p[1] == '/')
+      break;
+
+  /* an unterminated comment runs to the end of the file */
+  if (p + 1 < scanner->end)
+    p += 2;
+  else
+    p = scanner->end;
 
-  if (str == NULL)
+  css_scanner_advance (scanner, p - scanner->p);
+
+  return TRUE;
+}
+
+static void
+css_scanner_skip (CssScanner *scanner)
+{
+  while (scanner->p < scanner->end)
     {
-      tmp = g_malloc (2);
-      len = 0;
+      if (CSS_IS_SPACE (*scanner->p))
+        css_scanner_advance (scanner, 1);
+      else if (!css_scanner_skip_comment (scanner))
+        break;
+    }
+}
+
+static CssTokenType
+css_scanner_peek (CssScanner *scanner,
+                  CssToken   *token)
+{
+  const gchar *p;
+
+  css_scanner_skip (scanner);
+
+  token->start = scanner->p;
+
+  if (scanner->p >= scanner->end)
+    {
+      token->type = CSS_TOKEN_EOF;
+      token->len = 0;
+    }
+  else if (CSS_IS_IDENTIFIER_FIRST (*scanner->p))
+    {
+      for (p = scanner->p + 1; p < scanner->end; p++)
+        if (!CSS_IS_IDENTIFIER_NTH (*p))
+          break;
+
+      token->type = CSS_TOKEN_IDENTIFIER;
+      token->len = p - scanner->p;
     }
   else
     {
-      len = strlen (str);
-      tmp = g_realloc (str, len + 2);
+      token->type = CSS_TOKEN_CHAR;
+      token->len = 1;
     }
 
-  tmp[len] = c;
-  tmp[len + 1] = '\0';
+  return token->type;
+}
 
-  return tmp;
+static CssTokenType
+css_scanner_next (CssScanner *scanner,
+                  CssToken   *token)
+{
+  css_scanner_peek (scanner, token);
+  css_scanner_advance (scanner, token->len);
+
+  return token->type;
 }
 
-static GTokenType
-css_parse_key_value (GScanner *scanner, gchar **key, gchar **value)
+static void
+css_scanner_error (CssScanner  *scanner,
+                   CssToken    *token,
+                   const gchar *expected)
 {
-  GTokenType token;
+  switch (token->type)
+    {
+    case CSS_TOKEN_EOF:
+      g_warning ("%s:%u: error: unexpected end of file, expected %s",
+                 scanner->filename, scanner->line, expected);
+      break;
+
+    case CSS_TOKEN_IDENTIFIER:
+      g_warning ("%s:%u: error: unexpected identifier `%.*s', expected %s",
+                 scanner->filename, scanner->line,
+                 (gint) token->len, token->start, expected);
+      break;
+
+    case CSS_TOKEN_CHAR:
+      g_warning ("%s:%u: error: unexpected character `%c', expected %s",
+                 scanner->filename, scanner->line, *token->start, expected);
+      break;
+    }
+}
+
+/* Returns a copy of the given slice of the file that is owned by the style
+ * sheet. Identical strings share the same copy. */
+static gchar *
+css_scanner_intern (CssScanner  *scanner,
+                    const gchar *prefix,
+                    const gchar *start,
+                    gsize        len)
+{
+  g_string_truncate (scanner->scratch, 0);
+
+  if (prefix)
+    g_string_append (scanner->scratch, prefix);
+  g_string_append_len (scanner->scratch, start, len);
+
+  return g_string_chunk_insert_const (scanner->sheet->strings,
+                                      scanner->scratch->str);
+}
+
+static gboolean
+css_parse_key_value (CssScanner   *scanner,
+                     const gchar **key,
+                     const gchar **value)
+{
+  CssToken token;
+  const gchar *p, *start, *end;
   gboolean start_with_dash = FALSE;
-  gchar *id_first = scanner->config->cset_identifier_first;
-  gchar *id_nth = scanner->config->cset_identifier_nth;
-  guint scan_identifier_1char = scanner->config->scan_identifier_1char;
 
   /* parse property name */
-  token = g_scanner_get_next_token (scanner);
+  css_scanner_next (scanner, &token);
 
   /* allow property names to start with '-' */
-  if (token == '-')
+  if (CSS_TOKEN_IS_CHAR (&token, '-'))
     {
       /* FIXME: this will now ignore whitepsace and comments, but this should
        * not be allowed in the middle of a property name!
        */
-      token = g_scanner_get_next_token (scanner);
+      css_scanner_next (scanner, &token);
       start_with_dash = TRUE;
     }
 
-  if (token != G_TOKEN_IDENTIFIER)
-    return G_TOKEN_IDENTIFIER;
+  if (token.type != CSS_TOKEN_IDENTIFIER)
+    {
+      css_scanner_error (scanner, &token, "identifier");
+      return FALSE;
+    }
 
-  if (start_with_dash)
-    *key = g_strconcat ("-", scanner->value.v_identifier, NULL);
-  else
-    *key = g_strdup (scanner->value.v_identifier);
+  *key = css_scanner_intern (scanner, start_with_dash ? "-" : NULL,
+                             token.start, token.len);
 
-  token = g_scanner_get_next_token (scanner);
-  if (token != ':')
-    return ':';
+  css_scanner_next (scanner, &token);
+  if (!CSS_TOKEN_IS_CHAR (&token, ':'))
+    {
+      css_scanner_error (scanner, &token, "`:'");
+      return FALSE;
+    }
 
-  /* value parsing options */
-  scanner->config->cset_identifier_first = G_CSET_a_2_z "#_-0123456789"
-    G_CSET_A_2_Z G_CSET_LATINS G_CSET_LATINC;
-  scanner->config->cset_identifier_nth = scanner->config->cset_identifier_first;
-  scanner->config->scan_identifier_1char = 1;
-  scanner->config->char_2_token = FALSE;
-  scanner->config->cset_skip_characters = "\n";
+  /* The value is everything up to the next ';', apart from comments and
+   * new lines. In the usual case there are none of those, and the value
+   * can be copied straight out of the file.
+   */
+  start = scanner->p;
+  for (p = start; p < scanner->end && *p != ';'; p++)
+    if (*p == '\n' || (*p == '/' && p + 1 < scanner->end && p[1] == '*'))
+      break;
 
-  /* parse value */
-  while (scanner->next_value.v_char != ';')
+  if (p < scanner->end && *p != ';')
     {
-      token = g_scanner_get_next_token (scanner);
-      switch (token)
+      g_string_truncate (scanner->scratch, 0);
+
+      while (scanner->p < scanner->end && *scanner->p != ';')
         {
-        case G_TOKEN_IDENTIFIER:
-          *value = append (*value, scanner->value.v_identifier);
-          break;
-        case G_TOKEN_CHAR:
-          *value = appendc (*value, scanner->value.v_char);
-          break;
+          if (css_scanner_skip_comment (scanner))
+            continue;
 
-        default:
-          return ';';
+          if (*scanner->p != '\n')
+            g_string_append_c (scanner->scratch, *scanner->p);
+
+          css_scanner_advance (scanner, 1);
         }
 
-      g_scanner_peek_next_token (scanner);
+      start = scanner->scratch->str;
+      end = start + scanner->scratch->len;
+    }
+  else
+    {
+      css_scanner_advance (scanner, p - start);
+      end = p;
     }
 
   /* semi colon */
-  g_scanner_get_next_token (scanner);
-  if (scanner->value.v_char != ';')
-    return ';';
-
-  /* we've come to the end of the value, so reset the options */
-  scanner->config->cset_identifier_nth = id_nth;
-  scanner->config->cset_identifier_first = id_first;
-  scanner->config->scan_identifier_1char = scan_identifier_1char;
-  scanner->config->char_2_token = TRUE;
-  scanner->config->cset_skip_characters = " \t\n";
+  if (css_scanner_next (scanner, &token) == CSS_TOKEN_EOF)
+    {
+      css_scanner_error (scanner, &token, "`;'");
+      return FALSE;
+    }
 
   /* strip the leading and trailing whitespace */
-  g_strstrip (*value);
+  while (start < end && g_ascii_isspace (*start))
+    start++;
+  while (end > start && g_ascii_isspace (end[-1]))
+    end--;
+
+  if (start < end)
+    *value = g_string_chunk_insert_len (scanner->sheet->strings,
+                                        start, end - start);
+  else
+    *value = NULL;
 
-  return G_TOKEN_NONE;
+  return TRUE;
 }
 
-static GTokenType
-css_parse_style (GScanner *scanner, GHashTable *table)
+static gboolean
+css_parse_style (CssScanner *scanner,
+                 GHashTable *table)
 {
-  GTokenType token;
+  CssToken token;
 
   /* { */
-  token = g_scanner_get_next_token (scanner);
-  if (token != G_TOKEN_LEFT_CURLY)
-    return G_TOKEN_LEFT_CURLY;
+  css_scanner_next (scanner, &token);
+  if (!CSS_TOKEN_IS_CHAR (&token, '{'))
+    {
+      css_scanner_error (scanner, &token, "`{'");
+      return FALSE;
+    }
 
   /* keep going until we find '}' */
-  token = g_scanner_peek_next_token (scanner);
-  while (token != G_TOKEN_RIGHT_CURLY)
+  while (css_scanner_peek (scanner, &token) != CSS_TOKEN_EOF &&
+         !CSS_TOKEN_IS_CHAR (&token, '}'))
     {
-      gchar *key = NULL, *value = NULL;
+      const gchar *key = NULL, *value = NULL;
 
-      token = css_parse_key_value (scanner, &key, &value);
-      if (token != G_TOKEN_NONE)
-        return token;
+      if (!css_parse_key_value (scanner, &key, &value))
+        return FALSE;
 
-      g_hash_table_insert (table, key, value);
-
-      token = g_scanner_peek_next_token (scanner);
+      g_hash_table_insert (table, (gpointer) key,
+                           mx_style_sheet_value_new (value,
+                                                     scanner->filename));
     }
 
   /* } */
-  token = g_scanner_get_next_token (scanner);
-  if (token != G_TOKEN_RIGHT_CURLY)
-    return G_TOKEN_RIGHT_CURLY;
+  css_scanner_next (scanner, &token);
+  if (!CSS_TOKEN_IS_CHAR (&token, '}'))
+    {
+      css_scanner_error (scanner, &token, "`}'");
+      return FALSE;
+    }
 
-  return G_TOKEN_NONE;
+  return TRUE;
 }
 
 
-static GTokenType
-css_parse_simple_selector (GScanner      *scanner,
-                           MxSelector    *selector)
+static gboolean
+css_parse_simple_selector (CssScanner *scanner,
+                           MxSelector *selector)
 {
-  guint token;
-  gchar *tmp;
+  CssToken token;
 
   /* parse optional type (either '*' or an identifier) */
-  token = g_scanner_peek_next_token (scanner);
-  switch (token)
+  css_scanner_peek (scanner, &token);
+  if (token.type == CSS_TOKEN_IDENTIFIER || CSS_TOKEN_IS_CHAR (&token, '*'))
     {
-    case '*':
-      g_scanner_get_next_token (scanner);
-      selector->type = g_strdup ("*");
-      break;
-    case G_TOKEN_IDENTIFIER:
-      g_scanner_get_next_token (scanner);
-      selector->type = g_strdup (scanner->value.v_identifier);
-      break;
-    default:
-      break;
+      selector->type = css_scanner_intern (scanner, NULL,
+                                           token.start, token.len);
+      css_scanner_advance (scanner, token.len);
     }
 
   /* Here we look for '#', '.' or ':' and return if we find anything else */
-  token = g_scanner_peek_next_token (scanner);
-  while (token != G_TOKEN_NONE)
+  while (css_scanner_peek (scanner, &token) == CSS_TOKEN_CHAR)
     {
-      switch (token)
+      gchar c = *token.start;
+
+      if (c != '#' && c != '.' && c != ':')
+        break;
+
+      css_scanner_advance (scanner, 1);
+
+      if (css_scanner_next (scanner, &token) != CSS_TOKEN_IDENTIFIER)
+        {
+          css_scanner_error (scanner, &token, "identifier");
+          return FALSE;
+        }
+
+      switch (c)
         {
           /* id */
         case '#':
-          g_scanner_get_next_token (scanner);
-          token = g_scanner_get_next_token (scanner);
-          if (token != G_TOKEN_IDENTIFIER)
-            return G_TOKEN_IDENTIFIER;
-          selector->id = g_strdup (scanner->value.v_identifier);
+          selector->id = css_scanner_intern (scanner, NULL,
+                                             token.start, token.len);
           break;
+
           /* class */
         case '.':
-          g_scanner_get_next_token (scanner);
-          token = g_scanner_get_next_token (scanner);
-          if (token != G_TOKEN_IDENTIFIER)
-            return G_TOKEN_IDENTIFIER;
-          selector->class = g_strdup (scanner->value.v_identifier);
+          selector->class = css_scanner_intern (scanner, NULL,
+                                                token.start, token.len);
           break;
+
           /* pseudo-class */
         case ':':
-          g_scanner_get_next_token (scanner);
-          token = g_scanner_get_next_token (scanner);
-          if (token != G_TOKEN_IDENTIFIER)
-            return G_TOKEN_IDENTIFIER;
-
-          tmp = selector->pseudo_class;
-
           if (selector->pseudo_class)
-            selector->pseudo_class = g_strconcat (selector->pseudo_class, ":",
-                                                  scanner->value.v_identifier,
-                                                  NULL);
-          else
-            selector->pseudo_class = g_strdup (scanner->value.v_identifier);
-
-          g_free (tmp);
-
-          break;
+            {
+              gchar *prefix;
 
-          /* unhandled */
-        default:
-          return G_TOKEN_NONE;
+              prefix = g_strconcat (selector->pseudo_class, ":", NULL);
+              selector->pseudo_class = css_scanner_intern (scanner, prefix,
+                                                           token.start,
+                                                           token.len);
+              g_free (prefix);
+            }
+          else
+            selector->pseudo_class = css_scanner_intern (scanner, NULL,
+                                                         token.start,
+                                                         token.len);
           break;
         }
-      token = g_scanner_peek_next_token (scanner);
     }
-  return G_TOKEN_NONE;
+
+  return TRUE;
 }
 
 static char*
@@ -374,37 +571,30 @@ mx_selector_free (MxSelector *selector)
   if (!selector)
     return;
 
-  g_free (selector->type);
-  g_free (selector->id);
-  g_free (selector->class);
-  g_free (selector->pseudo_class);
-
   mx_selector_free (selector->parent);
 
   g_slice_free (MxSelector, selector);
 }
 
-static GTokenType
-css_parse_ruleset (GScanner *scanner, GList **selectors)
+static gboolean
+css_parse_ruleset (CssScanner  *scanner,
+                   GList      **selectors)
 {
-  guint token;
+  CssToken token;
   MxSelector *selector, *parent;
 
   /* parse the first selector, then keep going until we find left curly */
-  token = g_scanner_peek_next_token (scanner);
+  css_scanner_peek (scanner, &token);
 
   parent = NULL;
   selector = NULL;
-  while (token != G_TOKEN_LEFT_CURLY)
+  while (!CSS_TOKEN_IS_CHAR (&token, '{'))
     {
-      switch (token)
-        {
-        case G_TOKEN_IDENTIFIER:
-        case '*':
-        case '#':
-        case '.':
-        case ':':
+      gchar c = (token.type == CSS_TOKEN_CHAR) ? *token.start : '\0';
 
+      if (token.type == CSS_TOKEN_IDENTIFIER ||
+          c == '*' || c == '#' || c == '.' || c == ':')
+        {
           if (selector)
             parent = selector;
           else
@@ -413,8 +603,7 @@ css_parse_ruleset (GScanner *scanner, GList **selectors)
           /* check if there was a previous selector and if so, the new one
            * should use the previous selector to match an ancestor */
 
-          selector = mx_selector_new (scanner->input_name,
-                                      GPOINTER_TO_INT (scanner->user_data),
+          selector = mx_selector_new (scanner->filename, scanner->priority,
                                       scanner->line, scanner->position);
           *selectors = g_list_prepend (*selectors, selector);
 
@@ -424,14 +613,12 @@ css_parse_ruleset (GScanner *scanner, GList **selectors)
               selector->ancestor = parent;
             }
 
-          token = css_parse_simple_selector (scanner, selector);
-          if (token != G_TOKEN_NONE)
-            return token;
-
-          break;
-
-        case '>':
-          g_scanner_get_next_token (scanner);
+          if (!css_parse_simple_selector (scanner, selector))
+            return FALSE;
+        }
+      else if (c == '>')
+        {
+          css_scanner_advance (scanner, 1);
           if (!selector)
             {
               g_warning ("NULL parent when parsing '>'");
@@ -439,8 +626,7 @@ css_parse_ruleset (GScanner *scanner, GList **selectors)
 
           parent = selector;
 
-          selector = mx_selector_new (scanner->input_name,
-                                      GPOINTER_TO_INT (scanner->user_data),
+          selector = mx_selector_new (scanner->filename, scanner->priority,
                                       scanner->line, scanner->position);
           *selectors = g_list_prepend (*selectors, selector);
 
@@ -449,57 +635,134 @@ css_parse_ruleset (GScanner *scanner, GList **selectors)
           selector->parent = parent;
           *selectors = g_list_remove (*selectors, parent);
 
-          token = css_parse_simple_selector (scanner, selector);
-          if (token != G_TOKEN_NONE)
-            return token;
-
-          break;
-
-        case ',':
-          g_scanner_get_next_token (scanner);
+          if (!css_parse_simple_selector (scanner, selector))
+            return FALSE;
+        }
+      else if (c == ',')
+        {
+          css_scanner_advance (scanner, 1);
 
-          selector = mx_selector_new (scanner->input_name,
-                                      GPOINTER_TO_INT (scanner->user_data),
+          selector = mx_selector_new (scanner->filename, scanner->priority,
                                       scanner->line, scanner->position);
           *selectors = g_list_prepend (*selectors, selector);
 
-          token = css_parse_simple_selector (scanner, selector);
+          if (!css_parse_simple_selector (scanner, selector))
+            return FALSE;
+        }
+      else
+        {
+          css_scanner_error (scanner, &token, "selector");
+          return FALSE;
+        }
 
-          if (token != G_TOKEN_NONE)
-            return token;
+      css_scanner_peek (scanner, &token);
+    }
 
-          break;
+  return TRUE;
+}
+
+static GPtrArray *
+css_bucket_lookup (GHashTable  *buckets,
+                   const gchar *key)
+{
+  GPtrArray *bucket;
+
+  bucket = g_hash_table_lookup (buckets, key);
+  if (!bucket)
+    {
+      bucket = g_ptr_array_new ();
+      g_hash_table_insert (buckets, (gpointer) key, bucket);
+    }
+
+  return bucket;
+}
+
+static void
+css_index_ancestor_features (MxStyleSheet *sheet,
+                             MxSelector   *selector)
+{
+  if (!selector)
+    return;
+
+  if (selector->id)
+    g_hash_table_insert (sheet->ancestor_ids, selector->id, selector->id);
+
+  if (selector->class)
+    g_hash_table_insert (sheet->ancestor_classes, selector->class,
+                         selector->class);
 
-        default:
-          g_scanner_get_next_token (scanner);
-          g_scanner_unexp_token (scanner, G_TOKEN_ERROR, NULL, NULL, NULL,
-                                 "Unhandled selector", 1);
-          return '{';
+  if (selector->pseudo_class)
+    {
+      gchar **pseudo_classes, **p;
+
+      pseudo_classes = g_strsplit (selector->pseudo_class, ":", -1);
+      for (p = pseudo_classes; *p; p++)
+        {
+          gchar *pseudo_class;
+
+          if (!**p)
+            continue;
+
+          pseudo_class = g_string_chunk_insert_const (sheet->strings, *p);
+          g_hash_table_insert (sheet->ancestor_pseudo_classes, pseudo_class,
+                               pseudo_class);
         }
-      token = g_scanner_peek_next_token (scanner);
+      g_strfreev (pseudo_classes);
     }
 
-  return G_TOKEN_NONE;
+  css_index_ancestor_features (sheet, selector->parent);
+  css_index_ancestor_features (sheet, selector->ancestor);
 }
 
-static GTokenType
-css_parse_block (GScanner *scanner, GList **selectors, GList **styles)
+static void
+css_index_selector (MxStyleSheet *sheet,
+                    MxSelector   *selector)
 {
-  GTokenType token;
+  GPtrArray *bucket;
+
+  css_index_ancestor_features (sheet, selector->parent);
+  css_index_ancestor_features (sheet, selector->ancestor);
+
+  selector->index = sheet->n_selectors++;
+
+  /* A node can only match a selector if it matches every part of the
+   * right-most simple selector, so one of its parts is enough to find it.
+   * Prefer the rarest: ids, then classes, then types. */
+  if (selector->id)
+    bucket = css_bucket_lookup (sheet->id_rules, selector->id);
+  else if (selector->class)
+    bucket = css_bucket_lookup (sheet->class_rules, selector->class);
+  else if (selector->type && selector->type[0] != '*')
+    bucket = css_bucket_lookup (sheet->type_rules, selector->type);
+  else
+    bucket = sheet->universal_rules;
+
+  g_ptr_array_add (bucket, selector);
+}
+
+static gboolean
+css_parse_block (CssScanner *scanner)
+{
+  MxStyleSheet *sheet = scanner->sheet;
   GHashTable *table;
   GList *l, *list = NULL;
+  gboolean result;
 
 
-  token = css_parse_ruleset (scanner, &list);
-  if (token != G_TOKEN_NONE)
-    return token;
+  if (!css_parse_ruleset (scanner, &list))
+    {
+      g_list_foreach (list, (GFunc) mx_selector_free, NULL);
+      g_list_free (list);
+      return FALSE;
+    }
 
 
-  /* create a hash table for the properties */
-  table = g_hash_table_new_full (g_str_hash, g_direct_equal, g_free,
+  /* create a hash table for the properties, the names are interned in the
+   * style sheet */
+  table = g_hash_table_new_full (g_str_hash, g_direct_equal, NULL,
                                  (GDestroyNotify) mx_style_sheet_value_free);
 
-  token = css_parse_style (scanner, table);
+  result = css_parse_style (scanner, table);
 
   /* assign all the selectors to this style */
   for (l = list; l; l = l->next)
@@ -509,13 +772,15 @@ css_parse_block (GScanner *scanner, GList **selectors, GList **styles)
       sl = (MxSelector*) l->data;
 
       sl->style = table;
+
+      css_index_selector (sheet, sl);
     }
 
-  *styles = g_list_append (*styles, table);
+  sheet->styles = g_list_append (sheet->styles, table);
 
-  *selectors = g_list_concat (*selectors, list);
+  sheet->selectors = g_list_concat (sheet->selectors, list);
 
-  return token;
+  return result;
 }
 
 
@@ -524,52 +789,579 @@ css_parse_file (MxStyleSheet *sheet,
                 gchar        *filename,
                 gint          priority)
 {
-  GScanner *scanner;
-  int fd;
-  GTokenType token;
+  GMappedFile *file;
+  CssScanner scanner;
+  CssToken token;
+  gboolean result;
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  if (!file)
+    return FALSE;
+
+  scanner.sheet = sheet;
+  scanner.filename = filename;
+  scanner.priority = priority;
+  scanner.p = g_mapped_file_get_contents (file);
+  scanner.end = scanner.p + g_mapped_file_get_length (file);
+  scanner.line = 1;
+  scanner.position = 0;
+  scanner.scratch = g_string_sized_new (64);
+
+  result = TRUE;
+  while (css_scanner_peek (&scanner, &token) != CSS_TOKEN_EOF)
+    {
+      if (!css_parse_block (&scanner))
+        {
+          result = FALSE;
+          break;
+        }
+    }
+
+  g_string_free (scanner.scratch, TRUE);
+  g_mapped_file_unref (file);
+
+  return result;
+}
+
+/* Compiled style sheets
+ *
+ * mx-compile-css stores the parsed selectors and declarations of a style
+ * sheet next to it, as FILENAME + "c". The file is a header followed by
+ * arrays of fixed size records and a table of NUL terminated strings. The
+ * records refer to each other by index and to the strings by offset, so the
+ * file can be mapped anywhere and its strings used in place.
+ *
+ * The header records the size and the SHA-1 checksum of the contents of
+ * the source file. Installing the files does not keep their modification
+ * times, so those are not compared. A compiled file that does not match its
+ * source, or that was written by a different version or on a machine of a
+ * different byte order, is ignored and the source is parsed instead.
+ */
+
+#define CSS_COMPILED_MAGIC      "MXCSSC\r\n"
+#define CSS_COMPILED_VERSION    3
+#define CSS_COMPILED_CHECKSUM   G_CHECKSUM_SHA1
+#define CSS_COMPILED_CHECKSUM_SIZE 20
+#define CSS_COMPILED_BYTE_ORDER 0x01020304
+#define CSS_COMPILED_NONE       G_MAXUINT32
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint64 source_size;
+  guint8  source_checksum[CSS_COMPILED_CHECKSUM_SIZE];
+  guint32 n_selectors;
+  guint32 n_styles;
+  guint32 n_properties;
+  guint32 strings_size;
+  guint32 padding;
+} CssCompiledHeader;
+
+typedef struct
+{
+  /* offsets into the string table */
+  guint32 type;
+  guint32 id;
+  guint32 class;
+  guint32 pseudo_class;
+
+  /* indices of other selector records, parents and ancestors always come
+   * after the selectors that refer to them */
+  guint32 parent;
+  guint32 ancestor;
+
+  /* index of the style record, only set for the selectors of a rule set */
+  guint32 style;
+
+  guint32 line;
+  guint32 position;
+} CssCompiledSelector;
+
+typedef struct
+{
+  guint32 first_property;
+  guint32 n_properties;
+} CssCompiledStyle;
+
+typedef struct
+{
+  guint32 name;
+  guint32 value;
+} CssCompiledProperty;
+
+typedef struct
+{
+  GArray     *selectors;
+  GArray     *styles;
+  GArray     *properties;
+  GString    *strings;
+  GHashTable *string_offsets;
+  GHashTable *style_indices;
+} CssCompiler;
+
+/* Writes the checksum of @len bytes of @data to @digest */
+static void
+css_checksum_data (const gchar *data,
+                   gsize        len,
+                   guint8      *digest)
+{
+  GChecksum *checksum;
+  gsize digest_len = CSS_COMPILED_CHECKSUM_SIZE;
 
-  fd = open (filename, O_RDONLY);
-  if (fd == -1)
+  checksum = g_checksum_new (CSS_COMPILED_CHECKSUM);
+  g_checksum_update (checksum, (const guchar *) data, len);
+  g_checksum_get_digest (checksum, digest, &digest_len);
+  g_checksum_free (checksum);
+}
+
+static gboolean
+css_compiled_is_current (const CssCompiledHeader *header,
+                         const gchar             *filename)
+{
+  guint8 digest[CSS_COMPILED_CHECKSUM_SIZE];
+  GMappedFile *source;
+  gboolean result;
+
+  /* checksumming the contents is still much cheaper than parsing them */
+  source = g_mapped_file_new (filename, FALSE, NULL);
+  if (!source)
     return FALSE;
 
-  scanner = g_scanner_new (NULL);
-  scanner->input_name = filename;
-  scanner->user_data = GINT_TO_POINTER (priority);
+  result = FALSE;
+  if (g_mapped_file_get_length (source) == header->source_size)
+    {
+      css_checksum_data (g_mapped_file_get_contents (source),
+                         g_mapped_file_get_length (source), digest);
+      result = !memcmp (digest, header->source_checksum, sizeof (digest));
+    }
+
+  g_mapped_file_unref (source);
 
-  /* turn off single line comments, we need to parse '#' */
-  scanner->config->cpair_comment_single = "\1\n";
-  scanner->config->cset_identifier_nth = G_CSET_a_2_z "-_0123456789"
-    G_CSET_A_2_Z G_CSET_LATINS G_CSET_LATINC;
-  scanner->config->scan_float = FALSE; /* allows scanning '.' */
-  scanner->config->scan_hex = FALSE;
-  scanner->config->scan_string_sq = FALSE;
-  scanner->config->scan_string_dq = FALSE;
+  return result;
+}
 
-  g_scanner_input_file (scanner, fd);
+static gboolean
+css_compiled_check_string (const CssCompiledHeader *header,
+                           guint32                  offset)
+{
+  return (offset == CSS_COMPILED_NONE || offset < header->strings_size);
+}
 
+static gchar *
+css_compiled_get_string (const gchar *strings,
+                         guint32      offset)
+{
+  if (offset == CSS_COMPILED_NONE)
+    return NULL;
 
-  token = g_scanner_peek_next_token (scanner);
-  while (token != G_TOKEN_EOF)
+  return (gchar *) strings + offset;
+}
+
+static gboolean
+css_load_compiled (MxStyleSheet *sheet,
+                   const gchar  *filename,
+                   gint          priority)
+{
+  const CssCompiledHeader *header;
+  const CssCompiledSelector *records;
+  const CssCompiledStyle *style_records;
+  const CssCompiledProperty *property_records;
+  const gchar *contents, *strings;
+  GMappedFile *file;
+  MxSelector **selectors;
+  GHashTable **styles;
+  gboolean *referenced;
+  gchar *compiled_name;
+  gsize length;
+  guint i, j;
+
+  compiled_name = g_strconcat (filename, "c", NULL);
+  file = g_mapped_file_new (compiled_name, FALSE, NULL);
+  g_free (compiled_name);
+
+  if (!file)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  header = (const CssCompiledHeader *) contents;
+
+  if (length < sizeof (CssCompiledHeader) ||
+      memcmp (header->magic, CSS_COMPILED_MAGIC, sizeof (header->magic)) ||
+      header->version != CSS_COMPILED_VERSION ||
+      header->byte_order != CSS_COMPILED_BYTE_ORDER ||
+      header->n_selectors > length ||
+      header->n_styles > length ||
+      header->n_properties > length ||
+      header->strings_size > length ||
+      header->strings_size == 0 ||
+      length != sizeof (CssCompiledHeader)
+      + header->n_selectors * sizeof (CssCompiledSelector)
+      + header->n_styles * sizeof (CssCompiledStyle)
+      + header->n_properties * sizeof (CssCompiledProperty)
+      + header->strings_size)
     {
-      token = css_parse_block (scanner, &sheet->selectors,
-                               &sheet->styles);
-      if (token != G_TOKEN_NONE)
-        break;
+      MX_NOTE (CSS, "Ignoring invalid compiled style sheet for %s", filename);
+      g_mapped_file_unref (file);
+      return FALSE;
+    }
 
-      token = g_scanner_peek_next_token (scanner);
+  if (!css_compiled_is_current (header, filename))
+    {
+      MX_NOTE (CSS, "Ignoring out of date compiled style sheet for %s",
+               filename);
+      g_mapped_file_unref (file);
+      return FALSE;
     }
 
-  if (token != G_TOKEN_EOF)
-    g_scanner_unexp_token (scanner, token, NULL, NULL, NULL, "Error",
-                           TRUE);
+  records = (const CssCompiledSelector *) (header + 1);
+  style_records = (const CssCompiledStyle *) (records + header->n_selectors);
+  property_records =
+    (const CssCompiledProperty *) (style_records + header->n_styles);
+  strings = (const gchar *) (property_records + header->n_properties);
 
-  close (fd);
-  g_scanner_destroy (scanner);
+  if (strings[header->strings_size - 1] != '\0')
+    {
+      g_mapped_file_unref (file);
+      return FALSE;
+    }
 
-  if (token == G_TOKEN_EOF)
-    return TRUE;
-  else
+  /* check all the records before building anything, so that a damaged file
+   * cannot leave the style sheet half loaded */
+  referenced = g_new0 (gboolean, header->n_selectors);
+  for (i = 0; i < header->n_selectors; i++)
+    {
+      const CssCompiledSelector *record = &records[i];
+      gboolean valid;
+
+      valid = (css_compiled_check_string (header, record->type) &&
+               css_compiled_check_string (header, record->id) &&
+               css_compiled_check_string (header, record->class) &&
+               css_compiled_check_string (header, record->pseudo_class) &&
+               (record->style == CSS_COMPILED_NONE ||
+                record->style < header->n_styles));
+
+      if (valid && record->parent != CSS_COMPILED_NONE)
+        {
+          valid = (record->parent > i && record->parent < header->n_selectors
+                   && !referenced[record->parent]);
+          if (valid)
+            referenced[record->parent] = TRUE;
+        }
+
+      if (valid && record->ancestor != CSS_COMPILED_NONE)
+        {
+          valid = (record->ancestor > i
+                   && record->ancestor < header->n_selectors
+                   && !referenced[record->ancestor]);
+          if (valid)
+            referenced[record->ancestor] = TRUE;
+        }
+
+      /* the selectors of a rule set are not part of another selector */
+      if (valid && record->style != CSS_COMPILED_NONE && referenced[i])
+        valid = FALSE;
+
+      if (!valid)
+        {
+          g_warning ("%s: error: invalid compiled style sheet", filename);
+          g_free (referenced);
+          g_mapped_file_unref (file);
+          return FALSE;
+        }
+    }
+  g_free (referenced);
+
+  for (i = 0; i < header->n_styles; i++)
+    {
+      if (style_records[i].first_property > header->n_properties ||
+          style_records[i].n_properties >
+          header->n_properties - style_records[i].first_property)
+        {
+          g_warning ("%s: error: invalid compiled style sheet", filename);
+          g_mapped_file_unref (file);
+          return FALSE;
+        }
+    }
+
+  for (i = 0; i < header->n_properties; i++)
+    {
+      if (property_records[i].name == CSS_COMPILED_NONE ||
+          !css_compiled_check_string (header, property_records[i].name) ||
+          !css_compiled_check_string (header, property_records[i].value))
+        {
+          g_warning ("%s: error: invalid compiled style sheet", filename);
+          g_mapped_file_unref (file);
+          return FALSE;
+        }
+    }
+
+  /* the property names and values point straight into the mapped file, the
+   * names are unique within it so they can be compared by pointer */
+  styles = g_new (GHashTable *, header->n_styles);
+  for (i = 0; i < header->n_styles; i++)
+    {
+      const CssCompiledStyle *style_record = &style_records[i];
+
+      styles[i] =
+        g_hash_table_new_full (g_str_hash, g_direct_equal, NULL,
+                               (GDestroyNotify) mx_style_sheet_value_free);
+
+      for (j = 0; j < style_record->n_properties; j++)
+        {
+          const CssCompiledProperty *property =
+            &property_records[style_record->first_property + j];
+
+          g_hash_table_insert (styles[i],
+                               css_compiled_get_string (strings,
+                                                        property->name),
+                               mx_style_sheet_value_new (
+                                 css_compiled_get_string (strings,
+                                                          property->value),
+                                 filename));
+        }
+
+      sheet->styles = g_list_append (sheet->styles, styles[i]);
+    }
+
+  /* parents and ancestors come after the selectors that refer to them, so
+   * build the selectors back to front */
+  selectors = g_new (MxSelector *, header->n_selectors);
+  for (i = header->n_selectors; i > 0; i--)
+    {
+      const CssCompiledSelector *record = &records[i - 1];
+      MxSelector *selector;
+
+      selector = mx_selector_new (filename, priority, record->line,
+                                  record->position);
+      selector->type = css_compiled_get_string (strings, record->type);
+      selector->id = css_compiled_get_string (strings, record->id);
+      selector->class = css_compiled_get_string (strings, record->class);
+      selector->pseudo_class = css_compiled_get_string (strings,
+                                                        record->pseudo_class);
+
+      if (record->parent != CSS_COMPILED_NONE)
+        selector->parent = selectors[record->parent];
+      if (record->ancestor != CSS_COMPILED_NONE)
+        selector->ancestor = selectors[record->ancestor];
+
+      selectors[i - 1] = selector;
+    }
+
+  /* add the selectors of the rule sets in their original order */
+  for (i = 0; i < header->n_selectors; i++)
+    {
+      if (records[i].style == CSS_COMPILED_NONE)
+        continue;
+
+      selectors[i]->style = styles[records[i].style];
+      css_index_selector (sheet, selectors[i]);
+      sheet->selectors = g_list_append (sheet->selectors, selectors[i]);
+    }
+
+  g_free (selectors);
+  g_free (styles);
+
+  sheet->mapped_files = g_list_prepend (sheet->mapped_files, file);
+
+  MX_NOTE (CSS, "Loaded compiled style sheet for %s", filename);
+
+  return TRUE;
+}
+
+static guint32
+css_compiler_add_string (CssCompiler *compiler,
+                         const gchar *string)
+{
+  gpointer offset;
+
+  if (!string)
+    return CSS_COMPILED_NONE;
+
+  /* the offsets are stored plus one, so that zero means not found */
+  offset = g_hash_table_lookup (compiler->string_offsets, string);
+  if (offset)
+    return GPOINTER_TO_UINT (offset) - 1;
+
+  offset = GUINT_TO_POINTER (compiler->strings->len + 1);
+  g_string_append_len (compiler->strings, string, strlen (string) + 1);
+  g_hash_table_insert (compiler->string_offsets, (gpointer) string, offset);
+
+  return GPOINTER_TO_UINT (offset) - 1;
+}
+
+static void
+css_compiler_add_property (const gchar       *name,
+                           MxStyleSheetValue *value,
+                           CssCompiler       *compiler)
+{
+  CssCompiledProperty property;
+
+  property.name = css_compiler_add_string (compiler, name);
+  property.value = css_compiler_add_string (compiler, value->string);
+
+  g_array_append_val (compiler->properties, property);
+}
+
+static guint32
+css_compiler_add_style (CssCompiler *compiler,
+                        GHashTable  *table)
+{
+  CssCompiledStyle style;
+  gpointer index;
+
+  if (!table)
+    return CSS_COMPILED_NONE;
+
+  /* the style is shared by all the selectors of its rule set */
+  index = g_hash_table_lookup (compiler->style_indices, table);
+  if (index)
+    return GPOINTER_TO_UINT (index) - 1;
+
+  style.first_property = compiler->properties->len;
+  g_hash_table_foreach (table, (GHFunc) css_compiler_add_property, compiler);
+  style.n_properties = compiler->properties->len - style.first_property;
+
+  g_array_append_val (compiler->styles, style);
+  index = GUINT_TO_POINTER (compiler->styles->len);
+  g_hash_table_insert (compiler->style_indices, table, index);
+
+  return GPOINTER_TO_UINT (index) - 1;
+}
+
+static guint32
+css_compiler_add_selector (CssCompiler *compiler,
+                           MxSelector  *selector)
+{
+  CssCompiledSelector record;
+  guint32 index;
+
+  if (!selector)
+    return CSS_COMPILED_NONE;
+
+  /* reserve the record first, so that the parent and ancestor come after */
+  index = compiler->selectors->len;
+  g_array_set_size (compiler->selectors, index + 1);
+
+  record.type = css_compiler_add_string (compiler, selector->type);
+  record.id = css_compiler_add_string (compiler, selector->id);
+  record.class = css_compiler_add_string (compiler, selector->class);
+  record.pseudo_class = css_compiler_add_string (compiler,
+                                                 selector->pseudo_class);
+  record.parent = css_compiler_add_selector (compiler, selector->parent);
+  record.ancestor = css_compiler_add_selector (compiler, selector->ancestor);
+  record.style = css_compiler_add_style (compiler, selector->style);
+  record.line = selector->line;
+  record.position = selector->position;
+
+  g_array_index (compiler->selectors, CssCompiledSelector, index) = record;
+
+  return index;
+}
+
+/*
+ * mx_style_sheet_compile_file:
+ * @filename: the style sheet to compile
+ * @output: the file to write, or %NULL to write @filename with a "c"
+ *   appended, which is where mx_style_sheet_add_from_file() looks for it
+ * @error: return location for a #GError, or %NULL
+ *
+ * Parses the style sheet in @filename and writes the result in the format
+ * that mx_style_sheet_add_from_file() can map and use directly instead of
+ * parsing @filename again. This is used by the mx-compile-css tool.
+ *
+ * Returns: %TRUE if the compiled style sheet was written
+ */
+gboolean
+mx_style_sheet_compile_file (const gchar  *filename,
+                             const gchar  *output,
+                             GError      **error)
+{
+  CssCompiledHeader header;
+  CssCompiler compiler;
+  MxStyleSheet *sheet;
+  GString *data;
+  gchar *contents, *output_name;
+  gsize length;
+  gboolean result;
+  GList *l;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!g_file_get_contents (filename, &contents, &length, error))
     return FALSE;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CSS_COMPILED_MAGIC, sizeof (header.magic));
+  header.version = CSS_COMPILED_VERSION;
+  header.byte_order = CSS_COMPILED_BYTE_ORDER;
+  header.source_size = length;
+  css_checksum_data (contents, length, header.source_checksum);
+
+  g_free (contents);
+
+  sheet = mx_style_sheet_new ();
+  if (!css_parse_file (sheet, (gchar *) filename, 0))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Could not parse '%s'", filename);
+      mx_style_sheet_destroy (sheet);
+      return FALSE;
+    }
+
+  compiler.selectors = g_array_new (FALSE, FALSE,
+                                    sizeof (CssCompiledSelector));
+  compiler.styles = g_array_new (FALSE, FALSE, sizeof (CssCompiledStyle));
+  compiler.properties = g_array_new (FALSE, FALSE,
+                                     sizeof (CssCompiledProperty));
+  compiler.strings = g_string_new (NULL);
+  compiler.string_offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  compiler.style_indices = g_hash_table_new (NULL, NULL);
+
+  for (l = sheet->selectors; l; l = l->next)
+    css_compiler_add_selector (&compiler, l->data);
+
+  header.n_selectors = compiler.selectors->len;
+  header.n_styles = compiler.styles->len;
+  header.n_properties = compiler.properties->len;
+  header.strings_size = MAX (compiler.strings->len, 1);
+
+  data = g_string_new (NULL);
+  g_string_append_len (data, (gchar *) &header, sizeof (header));
+  g_string_append_len (data, compiler.selectors->data,
+                       compiler.selectors->len
+                       * sizeof (CssCompiledSelector));
+  g_string_append_len (data, compiler.styles->data,
+                       compiler.styles->len * sizeof (CssCompiledStyle));
+  g_string_append_len (data, compiler.properties->data,
+                       compiler.properties->len
+                       * sizeof (CssCompiledProperty));
+  if (compiler.strings->len)
+    g_string_append_len (data, compiler.strings->str, compiler.strings->len);
+  else
+    g_string_append_c (data, '\0');
+
+  if (output)
+    output_name = g_strdup (output);
+  else
+    output_name = g_strconcat (filename, "c", NULL);
+
+  result = g_file_set_contents (output_name, data->str, data->len, error);
+
+  g_free (output_name);
+  g_string_free (data, TRUE);
+  g_array_free (compiler.selectors, TRUE);
+  g_array_free (compiler.styles, TRUE);
+  g_array_free (compiler.properties, TRUE);
+  g_string_free (compiler.strings, TRUE);
+  g_hash_table_destroy (compiler.string_offsets);
+  g_hash_table_destroy (compiler.style_indices);
+  mx_style_sheet_destroy (sheet);
+
+  return result;
 }
 
 static gboolean
@@ -826,27 +1618,17 @@ compare_selector_matches (SelectorMatch *a,
   else if ((position = a->selector->position - b->selector->position) != 0)
     return position;
   else
-    return 0;
+    return (gint) b->selector->index - (gint) a->selector->index;
 }
 
-struct _css_table_copy_data
-{
-  GHashTable *table;
-  const gchar *filename;
-};
-
 static void
-css_table_copy (gpointer                    *key,
-                gpointer                    *value,
-                struct _css_table_copy_data *data)
+css_table_copy (gpointer    key,
+                gpointer    value,
+                GHashTable *table)
 {
-  MxStyleSheetValue *css_value;
-
-  css_value = mx_style_sheet_value_new ();
-  css_value->source = data->filename;
-  css_value->string = (gchar*) value;
-
-  g_hash_table_insert (data->table, key, css_value);
+  /* the values are owned by the style sheet, so that any value transformed
+   * from the declaration is shared between all the stylables it applies to */
+  g_hash_table_insert (table, key, value);
 }
 
 static void
@@ -855,19 +1637,51 @@ free_selector_match (SelectorMatch *data)
   g_slice_free (SelectorMatch, data);
 }
 
+static GList *
+css_bucket_match (GPtrArray  *bucket,
+                  MxStylable *node,
+                  GList      *matches)
+{
+  guint i;
+
+  if (!bucket)
+    return matches;
+
+  for (i = 0; i < bucket->len; i++)
+    {
+      MxSelector *selector = g_ptr_array_index (bucket, i);
+      SelectorMatch *selector_match;
+      gint score;
+
+      score = css_node_matches_selector (selector, node);
+
+      if (score >= 0)
+        {
+          selector_match = g_slice_new (SelectorMatch);
+          selector_match->selector = selector;
+          selector_match->score = score;
+          matches = g_list_prepend (matches, selector_match);
+        }
+    }
+
+  return matches;
+}
+
 GHashTable *
 mx_style_sheet_get_properties (MxStyleSheet *sheet,
                                MxStylable   *node)
 {
   GTimer *timer = NULL;
   GList *l, *matching_selectors = NULL;
-  SelectorMatch *selector_match = NULL;
   GHashTable *result;
+  const gchar *id, *class;
+  GType type_id;
+
+  id = clutter_actor_get_name (CLUTTER_ACTOR (node));
+  class = mx_stylable_get_style_class (node);
 
   if (_mx_debug (MX_DEBUG_CSS))
     {
-      const char *id = clutter_actor_get_name (CLUTTER_ACTOR (node));
-      const char *class = mx_stylable_get_style_class (node);
       const char *pseudo_class = mx_stylable_get_style_pseudo_class (node);
       const char *type_name = G_OBJECT_TYPE_NAME (node);
 
@@ -884,42 +1698,40 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
       g_print ("\x1b[22m");
     }
 
-  /* find matching selectors */
-  for (l = sheet->selectors; l; l = l->next)
-    {
-      gint score;
+  /* find matching selectors, only testing the buckets that could apply */
+  if (id)
+    matching_selectors =
+      css_bucket_match (g_hash_table_lookup (sheet->id_rules, id),
+                        node, matching_selectors);
 
-      score = css_node_matches_selector (l->data, node);
+  if (class)
+    matching_selectors =
+      css_bucket_match (g_hash_table_lookup (sheet->class_rules, class),
+                        node, matching_selectors);
 
-      if (score >= 0)
-        {
-          selector_match = g_slice_new (SelectorMatch);
-          selector_match->selector = l->data;
-          selector_match->score = score;
-          matching_selectors = g_list_prepend (matching_selectors,
-                                               selector_match);
-        }
-    }
+  for (type_id = G_OBJECT_TYPE (node);
+       type_id;
+       type_id = g_type_parent (type_id))
+    matching_selectors =
+      css_bucket_match (g_hash_table_lookup (sheet->type_rules,
+                                             g_type_name (type_id)),
+                        node, matching_selectors);
+
+  matching_selectors = css_bucket_match (sheet->universal_rules, node,
+                                         matching_selectors);
 
   /* score the selectors by their score */
   matching_selectors = g_list_sort (matching_selectors,
                                     (GCompareFunc) compare_selector_matches);
 
   /* get properties from selector's styles */
-  result = g_hash_table_new_full (g_str_hash,
-                                  g_str_equal,
-                                  NULL,
-                                  (GDestroyNotify)mx_style_sheet_value_free);
+  result = g_hash_table_new (g_str_hash, g_str_equal);
   for (l = matching_selectors; l; l = l->next)
     {
       SelectorMatch *match = l->data;
-      struct _css_table_copy_data copy_data;
-
-      copy_data.filename = match->selector->filename;
-      copy_data.table = result;
 
       g_hash_table_foreach (match->selector->style, (GHFunc) css_table_copy,
-                            &copy_data);
+                            result);
 
       if (_mx_debug (MX_DEBUG_CSS))
         print_selector (match->selector, match->score);
@@ -939,15 +1751,284 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
   return result;
 }
 
+static gboolean
+css_key_may_match_selector (MxSelector *selector,
+                            MxStyleKey *key)
+{
+  /* This only checks the right-most simple selector, so it may return TRUE
+   * for a selector that does not match because of its ancestors, but never
+   * FALSE for one that does */
+  if (selector->type && selector->type[0] != '*')
+    {
+      GType type_id;
+
+      for (type_id = key->type; type_id; type_id = g_type_parent (type_id))
+        if (!strcmp (selector->type, g_type_name (type_id)))
+          break;
+
+      if (!type_id)
+        return FALSE;
+    }
+
+  if (selector->id && g_strcmp0 (selector->id, key->id))
+    return FALSE;
+
+  if (selector->class && g_strcmp0 (selector->class, key->class))
+    return FALSE;
+
+  if (selector->pseudo_class)
+    {
+      gchar *needle;
+
+      if (!key->pseudo_class)
+        return FALSE;
+
+      for (needle = selector->pseudo_class;
+           needle; needle = strchr (needle, ':'))
+        {
+          gint needle_len;
+          gchar *next;
+
+          if (needle[0] == ':')
+            needle++;
+
+          next = strchr (needle, ':');
+          if (next)
+            needle_len = next - needle;
+          else
+            needle_len = strlen (needle);
+
+          if (!list_contains (needle, needle_len, key->pseudo_class, ':'))
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+css_bucket_may_match_key (GPtrArray  *bucket,
+                          guint       first_selector,
+                          MxStyleKey *key)
+{
+  gint i;
+
+  if (!bucket)
+    return FALSE;
+
+  /* buckets are in sheet order, so the newest selectors are at the end */
+  for (i = (gint) bucket->len - 1; i >= 0; i--)
+    {
+      MxSelector *selector = g_ptr_array_index (bucket, i);
+
+      if (selector->index < first_selector)
+        break;
+
+      if (css_key_may_match_selector (selector, key))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * mx_style_sheet_may_match_key:
+ * @sheet: a #MxStyleSheet
+ * @first_selector: index of the first selector to consider
+ * @key: a style key
+ *
+ * Checks whether any of the selectors added to @sheet since it had
+ * @first_selector selectors (see mx_style_sheet_get_n_selectors()) could
+ * match a stylable with the style key @key. This is used to only invalidate
+ * the style cache entries affected by a newly loaded file.
+ */
+gboolean
+mx_style_sheet_may_match_key (MxStyleSheet *sheet,
+                              guint         first_selector,
+                              MxStyleKey   *key)
+{
+  GType type_id;
+
+  if (key->id &&
+      css_bucket_may_match_key (g_hash_table_lookup (sheet->id_rules, key->id),
+                                first_selector, key))
+    return TRUE;
+
+  if (key->class &&
+      css_bucket_may_match_key (g_hash_table_lookup (sheet->class_rules,
+                                                     key->class),
+                                first_selector, key))
+    return TRUE;
+
+  for (type_id = key->type; type_id; type_id = g_type_parent (type_id))
+    if (css_bucket_may_match_key (g_hash_table_lookup (sheet->type_rules,
+                                                       g_type_name (type_id)),
+                                  first_selector, key))
+      return TRUE;
+
+  return css_bucket_may_match_key (sheet->universal_rules, first_selector,
+                                   key);
+}
+
+static gboolean
+css_pseudo_classes_changed (GHashTable  *features,
+                            const gchar *pseudo_class,
+                            const gchar *other)
+{
+  gchar **pseudo_classes, **p;
+  gboolean result = FALSE;
+
+  if (!pseudo_class)
+    return FALSE;
+
+  /* check whether any pseudo-class that was removed or added is tested */
+  pseudo_classes = g_strsplit (pseudo_class, ":", -1);
+  for (p = pseudo_classes; *p && !result; p++)
+    {
+      if (!**p || !g_hash_table_lookup (features, *p))
+        continue;
+
+      if (!other || !list_contains (*p, strlen (*p), other, ':'))
+        result = TRUE;
+    }
+  g_strfreev (pseudo_classes);
+
+  return result;
+}
+
+static gboolean
+css_feature_changed (GHashTable  *features,
+                     const gchar *old_value,
+                     const gchar *new_value)
+{
+  if (!g_strcmp0 (old_value, new_value))
+    return FALSE;
+
+  return ((old_value && g_hash_table_lookup (features, old_value)) ||
+          (new_value && g_hash_table_lookup (features, new_value)));
+}
+
+/*
+ * mx_style_sheet_change_affects_descendants:
+ * @sheet: a #MxStyleSheet
+ * @old_key: the previous style key of a stylable
+ * @new_key: the current style key of the stylable
+ *
+ * Checks whether the change of a stylable's own state from @old_key to
+ * @new_key could change the rules that match any of its descendants, i.e.
+ * whether the id, class or a pseudo-class that changed is tested by the
+ * parent or ancestor part of any selector in @sheet.
+ */
+gboolean
+mx_style_sheet_change_affects_descendants (MxStyleSheet *sheet,
+                                           MxStyleKey   *old_key,
+                                           MxStyleKey   *new_key)
+{
+  if (old_key == new_key)
+    return FALSE;
+
+  if (old_key->type != new_key->type ||
+      old_key->parent != new_key->parent)
+    return TRUE;
+
+  return (css_feature_changed (sheet->ancestor_ids,
+                               old_key->id, new_key->id) ||
+          css_feature_changed (sheet->ancestor_classes,
+                               old_key->class, new_key->class) ||
+          css_pseudo_classes_changed (sheet->ancestor_pseudo_classes,
+                                      old_key->pseudo_class,
+                                      new_key->pseudo_class) ||
+          css_pseudo_classes_changed (sheet->ancestor_pseudo_classes,
+                                      new_key->pseudo_class,
+                                      old_key->pseudo_class));
+}
+
+guint
+mx_style_sheet_get_n_selectors (MxStyleSheet *sheet)
+{
+  return sheet->n_selectors;
+}
+
+/* Writes out the selectors of @sheet in order, each followed by its
+ * declarations sorted by name. Used to compare parsers in the tests. */
+gchar *
+mx_style_sheet_to_string (MxStyleSheet *sheet)
+{
+  GString *string;
+  GList *l, *k, *keys;
+
+  string = g_string_new (NULL);
+
+  for (l = sheet->selectors; l; l = l->next)
+    {
+      MxSelector *selector = l->data;
+      gchar *name;
+
+      name = selector_to_string (selector);
+      g_string_append_printf (string, "%s {\n", name);
+      g_free (name);
+
+      keys = g_hash_table_get_keys (selector->style);
+      keys = g_list_sort (keys, (GCompareFunc) strcmp);
+
+      for (k = keys; k; k = k->next)
+        {
+          MxStyleSheetValue *value;
+
+          value = g_hash_table_lookup (selector->style, k->data);
+          g_string_append_printf (string, "  %s: %s;\n",
+                                  (gchar *) k->data,
+                                  value->string ? value->string : "");
+        }
+      g_list_free (keys);
+
+      g_string_append (string, "}\n");
+    }
+
+  return g_string_free (string, FALSE);
+}
+
 MxStyleSheet *
 mx_style_sheet_new ()
 {
-  return g_new0 (MxStyleSheet, 1);
+  MxStyleSheet *sheet;
+
+  sheet = g_new0 (MxStyleSheet, 1);
+
+  sheet->strings = g_string_chunk_new (4096);
+
+  /* the keys are owned by the selectors */
+  sheet->id_rules =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                           (GDestroyNotify) g_ptr_array_unref);
+  sheet->class_rules =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                           (GDestroyNotify) g_ptr_array_unref);
+  sheet->type_rules =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                           (GDestroyNotify) g_ptr_array_unref);
+  sheet->universal_rules = g_ptr_array_new ();
+
+  sheet->ancestor_ids = g_hash_table_new (g_str_hash, g_str_equal);
+  sheet->ancestor_classes = g_hash_table_new (g_str_hash, g_str_equal);
+  sheet->ancestor_pseudo_classes = g_hash_table_new (g_str_hash,
+                                                     g_str_equal);
+
+  return sheet;
 }
 
 void
 mx_style_sheet_destroy (MxStyleSheet *sheet)
 {
+  g_hash_table_destroy (sheet->id_rules);
+  g_hash_table_destroy (sheet->class_rules);
+  g_hash_table_destroy (sheet->type_rules);
+  g_ptr_array_unref (sheet->universal_rules);
+
+  g_hash_table_destroy (sheet->ancestor_ids);
+  g_hash_table_destroy (sheet->ancestor_classes);
+  g_hash_table_destroy (sheet->ancestor_pseudo_classes);
+
   g_list_foreach (sheet->selectors, (GFunc) mx_selector_free, NULL);
   g_list_free (sheet->selectors);
 
@@ -957,6 +2038,11 @@ mx_style_sheet_destroy (MxStyleSheet *sheet)
   g_list_foreach (sheet->filenames, (GFunc) g_free, NULL);
   g_list_free (sheet->filenames);
 
+  g_string_chunk_free (sheet->strings);
+
+  g_list_foreach (sheet->mapped_files, (GFunc) g_mapped_file_unref, NULL);
+  g_list_free (sheet->mapped_files);
+
   g_free (sheet);
 }
 
@@ -967,13 +2053,20 @@ mx_style_sheet_add_from_file (MxStyleSheet *sheet,
 {
   gboolean result;
   gchar *input_name;
+  gint priority;
 
   g_return_val_if_fail (sheet != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error != NULL, FALSE);
   g_return_val_if_fail (filename != NULL, FALSE);
 
   input_name = g_strdup (filename);
-  result = css_parse_file (sheet, input_name, g_list_length (sheet->filenames));
+  priority = g_list_length (sheet->filenames);
+
+  /* prefer an up to date compiled copy of the file, see
+   * mx_style_sheet_compile_file() */
+  result = css_load_compiled (sheet, input_name, priority);
+  if (!result)
+    result = css_parse_file (sheet, input_name, priority);
   sheet->filenames = g_list_prepend (sheet->filenames, input_name);
 
   return result;
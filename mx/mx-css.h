@@ -22,8 +22,9 @@
 #ifndef MX_CSS_H
 #define MX_CSS_H
 
-#include <glib.h>
+#include <glib-object.h>
 #include "mx-stylable.h"
+#include "mx-private.h"
 
 typedef struct _MxNode MxNode;
 typedef struct _MxStyleSheetValue MxStyleSheetValue;
@@ -42,6 +43,10 @@ struct _MxStyleSheetValue
 {
   const gchar *string;
   const gchar *source;
+
+  /* the string transformed into each of the value types it has been
+   * requested as, see mx_style_get_css_value() */
+  GArray *values;
 };
 
 MxStyleSheet*  mx_style_sheet_new            ();
@@ -52,4 +57,17 @@ gboolean       mx_style_sheet_add_from_file  (MxStyleSheet *sheet,
 GHashTable*    mx_style_sheet_get_properties (MxStyleSheet *sheet,
                                               MxStylable   *node);
 
+gboolean       mx_style_sheet_compile_file   (const gchar  *filename,
+                                              const gchar  *output,
+                                              GError      **error);
+
+guint          mx_style_sheet_get_n_selectors (MxStyleSheet *sheet);
+gchar*         mx_style_sheet_to_string       (MxStyleSheet *sheet);
+gboolean       mx_style_sheet_may_match_key   (MxStyleSheet *sheet,
+                                               guint         first_selector,
+                                               MxStyleKey   *key);
+gboolean       mx_style_sheet_change_affects_descendants (MxStyleSheet *sheet,
+                                                          MxStyleKey   *old_key,
+                                                          MxStyleKey   *new_key);
+
 #endif /* MX_CSS_H */
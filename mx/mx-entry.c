@@ -739,16 +739,16 @@ mx_entry_paint (ClutterActor *actor)
     {
       ClutterGeometry geo;
       CoglTextureVertex top[4] = { { 0,}, };
-      ClutterColor *color;
+      const ClutterColor *color;
       guint8 r, g, b;
 
 
-      mx_stylable_get (MX_STYLABLE (actor), "background-color", &color, NULL);
+      color = &_mx_widget_get_applied_style (MX_WIDGET (actor))
+        ->background_color;
 
       r = color->red;
       g = color->green;
       b = color->blue;
-      clutter_color_free (color);
 
       cogl_set_source_color4ub (0, 0, 0, 0);
 
@@ -211,6 +211,9 @@ struct _MxGridPrivate
   MxAdjustment *vadjustment;
 
   MxFocusable  *last_focus;
+
+  /* the children by position, built when painting */
+  MxChildIndex *child_index;
 };
 
 enum
@@ -730,6 +733,7 @@ mx_grid_finalize (GObject *object)
   MxGridPrivate *priv = self->priv;
 
   g_hash_table_destroy (priv->hash_table);
+  _mx_grid_invalidate_child_index (self);
 
   G_OBJECT_CLASS (mx_grid_parent_class)->finalize (object);
 }
@@ -1021,6 +1025,21 @@ mx_grid_new (void)
   return (ClutterActor*) self;
 }
 
+/* Drops the index of the children by position, for when they move or are
+ * restacked. Subclasses that allocate the children themselves call this
+ * too. */
+void
+_mx_grid_invalidate_child_index (MxGrid *grid)
+{
+  MxGridPrivate *priv = grid->priv;
+
+  if (priv->child_index)
+    {
+      _mx_child_index_free (priv->child_index);
+      priv->child_index = NULL;
+    }
+}
+
 static void
 mx_grid_real_add (ClutterContainer *container,
                   ClutterActor     *actor)
@@ -1040,6 +1059,7 @@ mx_grid_real_add (ClutterContainer *container,
 
   priv->list = g_list_append (priv->list, actor);
   g_hash_table_insert (priv->hash_table, actor, data);
+  _mx_grid_invalidate_child_index (MX_GRID (container));
 
   g_signal_emit_by_name (container, "actor-added", actor);
 
@@ -1066,6 +1086,7 @@ mx_grid_real_remove (ClutterContainer *container,
       g_signal_emit_by_name (container, "actor-removed", actor);
     }
   priv->list = g_list_remove (priv->list, actor);
+  _mx_grid_invalidate_child_index (layout);
 
   g_object_unref (actor);
 }
@@ -1102,6 +1123,7 @@ mx_grid_real_raise (ClutterContainer *container,
 
       priv->list = g_list_insert (priv->list, actor, index_);
     }
+  _mx_grid_invalidate_child_index (MX_GRID (container));
 
   clutter_actor_queue_relayout (CLUTTER_ACTOR (container));
 }
@@ -1123,6 +1145,7 @@ mx_grid_real_lower (ClutterContainer *container,
 
       priv->list = g_list_insert (priv->list, actor, index_);
     }
+  _mx_grid_invalidate_child_index (MX_GRID (container));
 
   clutter_actor_queue_relayout (CLUTTER_ACTOR (container));
 }
@@ -1149,16 +1172,18 @@ mx_grid_real_sort_depth_order (ClutterContainer *container)
   MxGridPrivate *priv = MX_GRID (container)->priv;
 
   priv->list = g_list_sort (priv->list, sort_by_depth);
+  _mx_grid_invalidate_child_index (MX_GRID (container));
 
   clutter_actor_queue_relayout (CLUTTER_ACTOR (container));
 }
 
+/* Paints the children inside the scrolled area, found through the index
+ * of the children by position. Rows scroll vertically and columns
+ * horizontally, so the index is sorted across the lines. */
 static void
-mx_grid_paint (ClutterActor *actor)
+mx_grid_paint_children (MxGrid *grid)
 {
-  MxGrid *layout = (MxGrid *) actor;
-  MxGridPrivate *priv = layout->priv;
-  GList *child_item;
+  MxGridPrivate *priv = grid->priv;
   gfloat x, y;
   ClutterActorBox grid_b;
 
@@ -1172,88 +1197,38 @@ mx_grid_paint (ClutterActor *actor)
   else
     y = 0;
 
-  CLUTTER_ACTOR_CLASS (mx_grid_parent_class)->paint (actor);
-
-  clutter_actor_get_allocation_box (actor, &grid_b);
+  clutter_actor_get_allocation_box (CLUTTER_ACTOR (grid), &grid_b);
   grid_b.x2 = (grid_b.x2 - grid_b.x1) + x;
   grid_b.x1 = x;
   grid_b.y2 = (grid_b.y2 - grid_b.y1) + y;
   grid_b.y1 = y;
 
-  for (child_item = priv->list;
-       child_item != NULL;
-       child_item = child_item->next)
-    {
-      ClutterActor *child = child_item->data;
-      ClutterActorBox child_b;
+  if (!priv->child_index)
+    priv->child_index =
+      _mx_child_index_new (priv->list,
+                           (priv->orientation == MX_ORIENTATION_HORIZONTAL) ?
+                           MX_ORIENTATION_VERTICAL :
+                           MX_ORIENTATION_HORIZONTAL);
 
-      g_assert (child != NULL);
+  _mx_child_index_paint (priv->child_index, &grid_b);
+}
 
-      /* ensure the child is "on screen" */
-      clutter_actor_get_allocation_box (CLUTTER_ACTOR (child), &child_b);
+static void
+mx_grid_paint (ClutterActor *actor)
+{
+  CLUTTER_ACTOR_CLASS (mx_grid_parent_class)->paint (actor);
 
-      if ((child_b.x1 < grid_b.x2)
-          && (child_b.x2 > grid_b.x1)
-          && (child_b.y1 < grid_b.y2)
-          && (child_b.y2 > grid_b.y1)
-          && CLUTTER_ACTOR_IS_VISIBLE (child))
-        {
-          clutter_actor_paint (child);
-        }
-    }
+  mx_grid_paint_children (MX_GRID (actor));
 }
 
 static void
 mx_grid_pick (ClutterActor       *actor,
               const ClutterColor *color)
 {
-  MxGrid *layout = (MxGrid *) actor;
-  MxGridPrivate *priv = layout->priv;
-  GList *child_item;
-  gfloat x, y;
-  ClutterActorBox grid_b;
-
-  if (priv->hadjustment)
-    x = mx_adjustment_get_value (priv->hadjustment);
-  else
-    x = 0;
-
-  if (priv->vadjustment)
-    y = mx_adjustment_get_value (priv->vadjustment);
-  else
-    y = 0;
-
   /* Chain up so we get a bounding box pained (if we are reactive) */
   CLUTTER_ACTOR_CLASS (mx_grid_parent_class)->pick (actor, color);
 
-
-  clutter_actor_get_allocation_box (actor, &grid_b);
-  grid_b.x2 = (grid_b.x2 - grid_b.x1) + x;
-  grid_b.x1 = x;
-  grid_b.y2 = (grid_b.y2 - grid_b.y1) + y;
-  grid_b.y1 = y;
-
-  for (child_item = priv->list;
-       child_item != NULL;
-       child_item = child_item->next)
-    {
-      ClutterActor *child = child_item->data;
-      ClutterActorBox child_b;
-
-      g_assert (child != NULL);
-
-      /* ensure the child is "on screen" */
-      clutter_actor_get_allocation_box (CLUTTER_ACTOR (child), &child_b);
-
-      if ((child_b.x1 < grid_b.x2)
-          && (child_b.x2 > grid_b.x1)
-          && (child_b.y1 < grid_b.y2)
-          && (child_b.y2 > grid_b.y1)
-          && CLUTTER_ACTOR_IS_VISIBLE (child))
-        {
-          clutter_actor_paint (child);
-        }
-    }
+  mx_grid_paint_children (MX_GRID (actor));
 }
 
 static void
@@ -1749,6 +1724,8 @@ mx_grid_allocate (ClutterActor          *self,
 
   mx_grid_do_allocate (self, &alloc_box, flags, FALSE, NULL, NULL,
       NULL, NULL);
+
+  _mx_grid_invalidate_child_index (MX_GRID (self));
 }
 
 
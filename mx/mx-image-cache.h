@@ -0,0 +1,72 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-image-cache.h: format of the image cache
+ *
+ * Copyright 2010 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __MX_IMAGE_CACHE_H__
+#define __MX_IMAGE_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* mx-create-image-cache packs the small images of a directory into one
+ * atlas and writes it to MX_IMAGE_CACHE_NAME in that directory, which
+ * MxTextureCache maps and uploads without decoding any of the images.
+ *
+ * The file holds a header, an entry for each image, the image names
+ * (nul-terminated, relative to the directory) and the atlas pixels as
+ * premultiplied RGBA with no padding between rows. Values are stored in
+ * the byte order of the machine that wrote them, and the file is ignored
+ * if byte_order doesn't read back as MX_IMAGE_CACHE_BYTE_ORDER.
+ */
+#define MX_IMAGE_CACHE_NAME       "mx.cache"
+#define MX_IMAGE_CACHE_MAGIC      "MXIMGC\r\n"
+#define MX_IMAGE_CACHE_VERSION    1
+#define MX_IMAGE_CACHE_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 byte_order;
+
+  guint32 n_images;
+  guint32 strings_offset;
+  guint32 strings_size;
+  guint32 pixels_offset;
+  guint32 width;
+  guint32 height;
+} MxImageCacheHeader;
+
+/* The image is at (x, y) in the atlas. The modification time and size of
+ * the image file tell whether the entry is still up to date. */
+typedef struct
+{
+  guint32 name;
+  guint32 x, y;
+  guint32 width, height;
+  guint32 padding;
+  guint64 mtime;
+  guint64 size;
+} MxImageCacheEntry;
+
+G_END_DECLS
+
+#endif /* __MX_IMAGE_CACHE_H__ */
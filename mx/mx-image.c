@@ -28,13 +28,18 @@
  * Since: 1.2
  */
 
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 #include <cogl/cogl.h>
 
 #include "mx-image.h"
 #include "mx-enum-types.h"
 #include "mx-marshal.h"
 #include "mx-texture-cache.h"
+#include "mx-scrollable.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
@@ -45,11 +50,49 @@ G_DEFINE_TYPE (MxImage, mx_image, MX_TYPE_WIDGET)
 
 #define DEFAULT_DURATION 250
 
+/* Padded images up to this many bytes are composed in a buffer that is
+ * kept between uploads, rather than in one allocated for each image */
+#define MX_IMAGE_SCRATCH_SIZE (1024 * 1024)
+
+/* Images in the disk cache start with this header, followed by their
+ * pixels in the layout of an MxImage texture: premultiplied RGBA with a
+ * transparent border of one pixel and no padding between rows */
+#define MX_IMAGE_DISK_CACHE_MAGIC "MXIMAGE1"
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 width;
+  guint32 height;
+} MxImageDiskCacheHeader;
+
+/* Only images decoded at a requested size of up to this many pixels are
+ * stored in the disk cache, large images are cheap enough to decode next to
+ * the space they would take */
+#define MX_IMAGE_DISK_CACHE_MAX_PIXELS (1024 * 1024)
+
+/* The size the disk cache is kept under, the least recently used images are
+ * removed when it grows past it */
+#define MX_IMAGE_DISK_CACHE_MAX_SIZE (128 * 1024 * 1024)
+
+/* The parameters an image was loaded with at a requested size, which
+ * identify it in the texture cache, see mx_image_get_cache_ident() */
+typedef struct
+{
+  gint     width, height;
+  guint    width_threshold, height_threshold;
+  gboolean upscale;
+} MxImageCacheIdent;
+
+#define MX_IMAGE_MAX_CACHE_IDENTS 256
+
 /* This stucture holds all that is necessary for cancellable async
  * image loading using thread pools.
  *
- * The idea is that you create this structure (with the pixbuf as NULL)
- * and add it to the thread-pool.
+ * The idea is that you create this structure (with the pixels as NULL)
+ * and add it to the load queue, which the threads in the pool take the
+ * most important load from. A load that is cancelled while it is still
+ * queued is taken out of the queue and freed straight away.
  *
  * The 'complete' member of the struct is protected by the mutex.
  * The thread handler uses this to indicate that the load was completed.
@@ -71,8 +114,12 @@ typedef struct
   guint           complete  : 1;
   guint           cancelled : 1;
   guint           upscale   : 1;
+  guint           use_disk_cache : 1;
   guint           idle_handler;
 
+  /* Protected by mx_image_queue_lock */
+  gint            priority;
+
   gchar          *filename;
   guchar         *buffer;
   gsize           count;
@@ -83,7 +130,10 @@ typedef struct
   guint           width_threshold;
   guint           height_threshold;
 
-  GdkPixbuf      *pixbuf;
+  guchar         *padded;
+  gint            image_width;
+  gint            image_height;
+  GMappedFile    *cached;
   GError         *error;
 } MxImageAsyncData;
 
@@ -93,6 +143,7 @@ struct _MxImagePrivate
   MxImageScaleMode previous_mode;
   guint            load_async : 1;
   guint            upscale    : 1;
+  guint            use_disk_cache : 1;
   guint            width_threshold;
   guint            height_threshold;
 
@@ -126,7 +177,8 @@ enum
   PROP_SCALE_WIDTH_THRESHOLD,
   PROP_SCALE_HEIGHT_THRESHOLD,
   PROP_IMAGE_ROTATION,
-  PROP_TRANSITION_DURATION
+  PROP_TRANSITION_DURATION,
+  PROP_USE_DISK_CACHE
 };
 
 enum
@@ -139,19 +191,37 @@ enum
 
 static guint signals[LAST_SIGNAL] = { 0, };
 
+/* Loads waiting for a thread, and how important they are */
+enum
+{
+  MX_IMAGE_PRIORITY_HIDDEN,
+  MX_IMAGE_PRIORITY_NEAR,
+  MX_IMAGE_PRIORITY_VISIBLE
+};
+
 static GThreadPool *mx_image_threads = NULL;
+static guint mx_image_max_threads = 0;
+static GMutex *mx_image_queue_lock = NULL;
+static GQueue mx_image_queue = G_QUEUE_INIT;
+static guint mx_image_reprioritize_id = 0;
 static GQuark mx_image_cache_quark = 0;
+static GHashTable *mx_image_cache_idents = NULL;
+static GMutex *mx_image_disk_cache_lock = NULL;
+static gint64 mx_image_disk_cache_size = -1;
+static guchar *mx_image_scratch = NULL;
 
 static gboolean
 mx_image_set_from_data_internal (MxImage          *image,
                                  const guchar     *data,
                                  const gchar      *uri,
+                                 gpointer          cache_ident,
                                  gboolean          use_cache,
                                  CoglPixelFormat   pixel_format,
                                  gint              width,
                                  gint              height,
                                  gint              rowstride,
                                  GError          **error);
+static void mx_image_cancel_in_progress (MxImage *image);
 
 GQuark
 mx_image_error_quark (void)
@@ -172,8 +242,10 @@ mx_image_async_data_free (MxImageAsyncData *data)
   if (data->idle_handler)
     g_source_remove (data->idle_handler);
 
-  if (data->pixbuf)
-    g_object_unref (data->pixbuf);
+  g_free (data->padded);
+
+  if (data->cached)
+    g_mapped_file_unref (data->cached);
 
   if (data->error)
     g_error_free (data->error);
@@ -191,6 +263,7 @@ mx_image_async_data_new (MxImage *parent)
   data->width = -1;
   data->height = -1;
   data->upscale = parent->priv->upscale;
+  data->use_disk_cache = parent->priv->use_disk_cache;
   data->width_threshold = parent->priv->width_threshold;
   data->height_threshold = parent->priv->height_threshold;
 
@@ -454,6 +527,10 @@ mx_image_set_property (GObject      *object,
       mx_image_set_transition_duration (image, g_value_get_uint (value));
       break;
 
+    case PROP_USE_DISK_CACHE:
+      mx_image_set_use_disk_cache (image, g_value_get_boolean (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -498,6 +575,10 @@ mx_image_get_property (GObject    *object,
       g_value_set_uint (value, priv->transition_duration);
       break;
 
+    case PROP_USE_DISK_CACHE:
+      g_value_set_boolean (value, priv->use_disk_cache);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -569,15 +650,40 @@ mx_image_dispose (GObject *object)
       priv->template_material = NULL;
     }
 
-  if (priv->async_load_data)
-    {
-      priv->async_load_data->cancelled = TRUE;
-      priv->async_load_data = NULL;
-    }
+  mx_image_cancel_in_progress (MX_IMAGE (object));
 
   G_OBJECT_CLASS (mx_image_parent_class)->dispose (object);
 }
 
+static guint
+mx_image_cache_ident_hash (gconstpointer key)
+{
+  const MxImageCacheIdent *ident = key;
+  guint hash = 5381;
+
+  hash = hash * 33 + (guint) ident->width;
+  hash = hash * 33 + (guint) ident->height;
+  hash = hash * 33 + ident->width_threshold;
+  hash = hash * 33 + ident->height_threshold;
+  hash = hash * 33 + (ident->upscale ? 1 : 0);
+
+  return hash;
+}
+
+static gboolean
+mx_image_cache_ident_equal (gconstpointer a,
+                            gconstpointer b)
+{
+  const MxImageCacheIdent *ident_a = a;
+  const MxImageCacheIdent *ident_b = b;
+
+  return (ident_a->width == ident_b->width &&
+          ident_a->height == ident_b->height &&
+          ident_a->width_threshold == ident_b->width_threshold &&
+          ident_a->height_threshold == ident_b->height_threshold &&
+          !ident_a->upscale == !ident_b->upscale);
+}
+
 static void
 mx_image_class_init (MxImageClass *klass)
 {
@@ -658,6 +764,22 @@ mx_image_class_init (MxImageClass *klass)
 
   g_object_class_install_property (object_class, PROP_TRANSITION_DURATION, pspec);
 
+  /**
+   * MxImage:use-disk-cache:
+   *
+   * Whether images loaded from files are kept in decoded form in the
+   * user's cache directory, so later loads don't have to decode them.
+   *
+   * Since: 1.6
+   */
+  pspec = g_param_spec_boolean ("use-disk-cache",
+                                "Use Disk Cache",
+                                "Whether to keep decoded images on disk",
+                                FALSE,
+                                G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_property (object_class, PROP_USE_DISK_CACHE, pspec);
+
 
   /**
    * MxImage::image-loaded:
@@ -695,6 +817,14 @@ mx_image_class_init (MxImageClass *klass)
                   G_TYPE_NONE, 1, G_TYPE_ERROR);
 
   mx_image_cache_quark = g_quark_from_static_string ("mx-image-cache");
+  mx_image_cache_idents = g_hash_table_new (mx_image_cache_ident_hash,
+                                            mx_image_cache_ident_equal);
+
+  if (!mx_image_queue_lock)
+    mx_image_queue_lock = g_mutex_new ();
+
+  if (!mx_image_disk_cache_lock)
+    mx_image_disk_cache_lock = g_mutex_new ();
 }
 
 static void
@@ -961,13 +1091,26 @@ static void
 mx_image_cancel_in_progress (MxImage *image)
 {
   MxImagePrivate *priv = image->priv;
+  MxImageAsyncData *data = priv->async_load_data;
+  GList *link;
 
   /* Cancel any asynchronous image load */
-  if (priv->async_load_data)
-    {
-      priv->async_load_data->cancelled = TRUE;
-      priv->async_load_data = NULL;
-    }
+  if (!data)
+    return;
+
+  priv->async_load_data = NULL;
+
+  /* A load that hasn't started can be dropped without a thread seeing it */
+  g_mutex_lock (mx_image_queue_lock);
+  link = g_queue_find (&mx_image_queue, data);
+  if (link)
+    g_queue_delete_link (&mx_image_queue, link);
+  g_mutex_unlock (mx_image_queue_lock);
+
+  if (link)
+    mx_image_async_data_free (data);
+  else
+    data->cancelled = TRUE;
 }
 
 /**
@@ -1010,11 +1153,201 @@ mx_image_clear (MxImage *image)
   clutter_actor_queue_relayout (CLUTTER_ACTOR (image));
 }
 
+/* Returns the identifier that an image loaded to fit in @width x @height is
+ * stored under in the texture cache. Each requested size has its own
+ * entry, so showing the same image at thumbnail size doesn't decode it
+ * again. The identifier is a copy of the parameters that change the
+ * decoded image, shared by every load with the same parameters. At most
+ * MX_IMAGE_MAX_CACHE_IDENTS of them are kept; once there are that many,
+ * %NULL is returned for new parameters and the image isn't cached. */
+static gpointer
+mx_image_get_cache_ident (gint     width,
+                          gint     height,
+                          guint    width_threshold,
+                          guint    height_threshold,
+                          gboolean upscale)
+{
+  MxImageCacheIdent key, *ident;
+
+  if (width < 0 && height < 0)
+    return GINT_TO_POINTER (mx_image_cache_quark);
+
+  key.width = width;
+  key.height = height;
+  key.width_threshold = width_threshold;
+  key.height_threshold = height_threshold;
+  key.upscale = upscale;
+
+  ident = g_hash_table_lookup (mx_image_cache_idents, &key);
+  if (ident)
+    return ident;
+
+  if (g_hash_table_size (mx_image_cache_idents) >= MX_IMAGE_MAX_CACHE_IDENTS)
+    return NULL;
+
+  ident = g_slice_dup (MxImageCacheIdent, &key);
+  g_hash_table_insert (mx_image_cache_idents, ident, ident);
+
+  return ident;
+}
+
+/* Makes @old_texture the texture the image changes from, now that it has
+ * a new one */
+static void
+mx_image_replace_texture (MxImage    *image,
+                          CoglHandle  old_texture)
+{
+  MxImagePrivate *priv = image->priv;
+
+  if (priv->old_texture)
+    cogl_object_unref (priv->old_texture);
+
+  priv->old_texture = old_texture;
+  priv->old_rotation = priv->rotation;
+  priv->old_mode = priv->mode;
+
+  mx_image_prepare_texture (image);
+}
+
+/* Returns the pixels of @pixbuf in the layout of the image's texture:
+ * premultiplied RGBA with a one pixel transparent border around them. The
+ * loading threads call this, so that the main thread only has to hand the
+ * result to Cogl. Returns %NULL if the format of @pixbuf isn't supported.
+ */
+static guchar *
+mx_image_pad_pixbuf (GdkPixbuf *pixbuf)
+{
+  gint x, y, width, height, channels, rowstride, padded_rowstride;
+  const guchar *pixels, *src;
+  guchar *padded, *dst;
+
+  channels = gdk_pixbuf_get_n_channels (pixbuf);
+  if ((gdk_pixbuf_get_bits_per_sample (pixbuf) != 8) ||
+      (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB) ||
+      (channels != (gdk_pixbuf_get_has_alpha (pixbuf) ? 4 : 3)))
+    return NULL;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+  padded_rowstride = (width + 2) * 4;
+  padded = g_malloc ((gsize) padded_rowstride * (height + 2));
+
+  memset (padded, 0, padded_rowstride);
+  memset (padded + (height + 1) * padded_rowstride, 0, padded_rowstride);
+
+  for (y = 0; y < height; y++)
+    {
+      src = pixels + y * rowstride;
+      dst = padded + (y + 1) * padded_rowstride;
+
+      memset (dst, 0, 4);
+      dst += 4;
+
+      for (x = 0; x < width; x++)
+        {
+          if (channels == 4)
+            {
+              guint alpha = src[3];
+
+              dst[0] = (src[0] * alpha + 127) / 255;
+              dst[1] = (src[1] * alpha + 127) / 255;
+              dst[2] = (src[2] * alpha + 127) / 255;
+              dst[3] = alpha;
+            }
+          else
+            {
+              dst[0] = src[0];
+              dst[1] = src[1];
+              dst[2] = src[2];
+              dst[3] = 0xff;
+            }
+
+          src += channels;
+          dst += 4;
+        }
+
+      memset (dst, 0, 4);
+    }
+
+  return padded;
+}
+
+/* Copies @data into a buffer with a one pixel transparent border around
+ * it, so the texture can be uploaded in one go. Returns %NULL if @format
+ * isn't one of the four byte formats, as three byte data would need an
+ * alpha channel for the border and take a third more texture memory. The
+ * result must be freed with mx_image_free_padded_data(). */
+static guchar *
+mx_image_pad_data (const guchar    *data,
+                   CoglPixelFormat  format,
+                   gint             width,
+                   gint             height,
+                   gint             rowstride)
+{
+  gint y, padded_rowstride;
+  guchar *padded, *dst;
+  gsize size;
+
+  switch (format)
+    {
+    case COGL_PIXEL_FORMAT_RGBA_8888:
+    case COGL_PIXEL_FORMAT_BGRA_8888:
+    case COGL_PIXEL_FORMAT_ARGB_8888:
+    case COGL_PIXEL_FORMAT_ABGR_8888:
+    case COGL_PIXEL_FORMAT_RGBA_8888_PRE:
+    case COGL_PIXEL_FORMAT_BGRA_8888_PRE:
+    case COGL_PIXEL_FORMAT_ARGB_8888_PRE:
+    case COGL_PIXEL_FORMAT_ABGR_8888_PRE:
+      break;
+
+    default:
+      return NULL;
+    }
+
+  padded_rowstride = (width + 2) * 4;
+  size = (gsize) padded_rowstride * (height + 2);
+
+  if (size <= MX_IMAGE_SCRATCH_SIZE)
+    {
+      if (!mx_image_scratch)
+        mx_image_scratch = g_malloc (MX_IMAGE_SCRATCH_SIZE);
+      padded = mx_image_scratch;
+    }
+  else
+    padded = g_malloc (size);
+
+  /* Transparent black is all zeroes in every format above */
+  memset (padded, 0, padded_rowstride);
+  memset (padded + (height + 1) * padded_rowstride, 0, padded_rowstride);
+
+  for (y = 0; y < height; y++)
+    {
+      dst = padded + (y + 1) * padded_rowstride;
+
+      memset (dst, 0, 4);
+      memcpy (dst + 4, data + y * rowstride, width * 4);
+      memset (dst + 4 + width * 4, 0, 4);
+    }
+
+  return padded;
+}
+
+static void
+mx_image_free_padded_data (guchar *padded)
+{
+  if (padded != mx_image_scratch)
+    g_free (padded);
+}
+
 /*
  * mx_image_set_from_data_internal:
  * @image: An #MxImage
  * @data: Image data, or %NULL
  * @uri: A local file path / URI, or %NULL
+ * @cache_ident: The identifier of the image in the texture cache
  * @use_cache: Whether the texture cache should be used
  * @pixel_format: The #CoglPixelFormat of the buffer
  * @width: Width in pixels of image data.
@@ -1032,6 +1365,7 @@ static gboolean
 mx_image_set_from_data_internal (MxImage          *image,
                                  const guchar     *data,
                                  const gchar      *uri,
+                                 gpointer          cache_ident,
                                  gboolean          use_cache,
                                  CoglPixelFormat   pixel_format,
                                  gint              width,
@@ -1064,8 +1398,8 @@ mx_image_set_from_data_internal (MxImage          *image,
 
   if (use_cache && uri && !data)
     {
-      priv->texture = mx_texture_cache_get_meta_cogl_texture (
-        cache, uri, GINT_TO_POINTER (mx_image_cache_quark));
+      priv->texture = mx_texture_cache_get_meta_cogl_texture (cache, uri,
+                                                              cache_ident);
 
       if (!priv->texture)
         {
@@ -1079,11 +1413,25 @@ mx_image_set_from_data_internal (MxImage          *image,
     }
   else
     {
-      gint *blank_area;
+      guchar *padded;
 
-      priv->texture = cogl_texture_new_with_size (width + 2, height + 2,
-                                                  COGL_TEXTURE_NO_ATLAS,
-                                                  COGL_PIXEL_FORMAT_ANY);
+      padded = mx_image_pad_data (data, pixel_format, width, height,
+                                  rowstride);
+
+      if (padded)
+        {
+          priv->texture = cogl_texture_new_from_data (width + 2, height + 2,
+                                                      COGL_TEXTURE_NO_ATLAS,
+                                                      pixel_format,
+                                                      COGL_PIXEL_FORMAT_ANY,
+                                                      (width + 2) * 4,
+                                                      padded);
+          mx_image_free_padded_data (padded);
+        }
+      else
+        priv->texture = cogl_texture_new_with_size (width + 2, height + 2,
+                                                    COGL_TEXTURE_NO_ATLAS,
+                                                    COGL_PIXEL_FORMAT_ANY);
 
       if (!priv->texture)
         {
@@ -1096,49 +1444,103 @@ mx_image_set_from_data_internal (MxImage          *image,
           return FALSE;
         }
 
-      /* Create the new texture */
-      cogl_texture_set_region (priv->texture, 0, 0, 1, 1,
-                               width, height, width, height,
-                               pixel_format, rowstride, data);
-
-      /* Blit a transparent buffer around the texture */
-      blank_area = g_new0 (gint, MAX (width, height) + 2);
-      cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
-                               width, 1, width, 1,
-                               COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
-                               (const guint8 *)blank_area);
-      cogl_texture_set_region (priv->texture, 0, 0, 0, height + 1,
-                               width + 2, 1, width + 2, 1,
-                               COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
-                               (const guint8 *)blank_area);
-      cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
-                               1, height + 2, 1, height + 2,
-                               COGL_PIXEL_FORMAT_RGBA_8888, 4,
-                               (const guint8 *)blank_area);
-      cogl_texture_set_region (priv->texture, 0, 0, width + 1, 0,
-                               1, height + 2, 1, height + 2,
-                               COGL_PIXEL_FORMAT_RGBA_8888, 4,
-                               (const guint8 *)blank_area);
-      g_free (blank_area);
+      /* Every format mx_image_pad_data() doesn't copy, including the
+       * three byte ones, is uploaded into the middle of the texture and
+       * the transparent border is blitted around it */
+      if (!padded)
+        {
+          gint *blank_area;
+
+          cogl_texture_set_region (priv->texture, 0, 0, 1, 1,
+                                   width, height, width, height,
+                                   pixel_format, rowstride, data);
+
+          blank_area = g_new0 (gint, MAX (width, height) + 2);
+          cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
+                                   width, 1, width, 1,
+                                   COGL_PIXEL_FORMAT_RGBA_8888,
+                                   (width + 2) * 4,
+                                   (const guint8 *)blank_area);
+          cogl_texture_set_region (priv->texture, 0, 0, 0, height + 1,
+                                   width + 2, 1, width + 2, 1,
+                                   COGL_PIXEL_FORMAT_RGBA_8888,
+                                   (width + 2) * 4,
+                                   (const guint8 *)blank_area);
+          cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
+                                   1, height + 2, 1, height + 2,
+                                   COGL_PIXEL_FORMAT_RGBA_8888, 4,
+                                   (const guint8 *)blank_area);
+          cogl_texture_set_region (priv->texture, 0, 0, width + 1, 0,
+                                   1, height + 2, 1, height + 2,
+                                   COGL_PIXEL_FORMAT_RGBA_8888, 4,
+                                   (const guint8 *)blank_area);
+          g_free (blank_area);
+        }
 
       /* Insert the processed image into the cache, if we have a URI */
-      if (uri)
+      if (uri && cache_ident)
         {
-          mx_texture_cache_insert_meta (cache, uri,
-                                        GINT_TO_POINTER (mx_image_cache_quark),
+          mx_texture_cache_insert_meta (cache, uri, cache_ident,
                                         priv->texture, NULL);
         }
     }
 
-  /* Replace the old texture */
-  if (priv->old_texture)
-    cogl_object_unref (priv->old_texture);
+  mx_image_replace_texture (image, old_texture);
 
-  priv->old_texture = old_texture;
-  priv->old_rotation = priv->rotation;
-  priv->old_mode = priv->mode;
+  return TRUE;
+}
 
-  mx_image_prepare_texture (image);
+/*
+ * mx_image_set_from_padded_data:
+ * @image: An #MxImage
+ * @padded: Image data in the layout returned by mx_image_pad_pixbuf()
+ * @width: Width in pixels of the image, without its border
+ * @height: Height in pixels of the image, without its border
+ * @uri: A local file path / URI, or %NULL
+ * @cache_ident: The identifier of the image in the texture cache
+ * @error: Return location for a #GError, or #NULL
+ *
+ * Set the image data from a buffer that is already laid out like the
+ * texture, so it is uploaded without being converted or copied first.
+ *
+ * Returns: #TRUE if the image was successfully updated
+ */
+static gboolean
+mx_image_set_from_padded_data (MxImage       *image,
+                               const guchar  *padded,
+                               gint           width,
+                               gint           height,
+                               const gchar   *uri,
+                               gpointer       cache_ident,
+                               GError       **error)
+{
+  MxImagePrivate *priv = image->priv;
+  CoglHandle old_texture;
+
+  mx_image_cancel_in_progress (image);
+
+  old_texture = priv->texture;
+  priv->texture = cogl_texture_new_from_data (width + 2, height + 2,
+                                              COGL_TEXTURE_NO_ATLAS,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                              (width + 2) * 4, padded);
+  if (!priv->texture)
+    {
+      priv->texture = old_texture;
+
+      if (error)
+        g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
+                     "Failed to create Cogl texture");
+
+      return FALSE;
+    }
+
+  if (uri && cache_ident)
+    mx_texture_cache_insert_meta (mx_texture_cache_get_default (), uri,
+                                  cache_ident, priv->texture, NULL);
+
+  mx_image_replace_texture (image, old_texture);
 
   return TRUE;
 }
@@ -1178,7 +1580,7 @@ mx_image_set_from_data (MxImage          *image,
       return FALSE;
     }
 
-  return mx_image_set_from_data_internal (image, data, NULL, FALSE,
+  return mx_image_set_from_data_internal (image, data, NULL, NULL, FALSE,
                                           pixel_format, width, height,
                                           rowstride, error);
 }
@@ -1188,10 +1590,12 @@ mx_image_set_from_data (MxImage          *image,
  * @image: A #MxImage
  * @pixbuf: A #GdkPixbuf, or %NULL
  * @filename: A path or URI to an image file, or %NULL
+ * @cache_ident: The identifier of the image in the texture cache
  * @error: A pointer to a #GError, or %NULL
  *
  * Sets the MxImage from a #GdkPixbuf, or from the cache if a filename is
- * given, no pixbuf is given and the filename has been previously cached.
+ * given, no pixbuf is given and the filename has been previously cached
+ * under @cache_ident.
  *
  * Returns: %TRUE on success, %FALSE otherwise. @error is set on failure
  */
@@ -1199,6 +1603,7 @@ static gboolean
 mx_image_set_from_pixbuf (MxImage      *image,
                           GdkPixbuf    *pixbuf,
                           const gchar  *filename,
+                          gpointer      cache_ident,
                           GError      **error)
 {
   gboolean has_alpha;
@@ -1218,8 +1623,7 @@ mx_image_set_from_pixbuf (MxImage      *image,
 
   /* Check if we have valid input arguments */
   if ((!pixbuf && !filename) || (!pixbuf && filename &&
-      !mx_texture_cache_contains_meta (cache, filename,
-                                       GINT_TO_POINTER (mx_image_cache_quark))))
+      !mx_texture_cache_contains_meta (cache, filename, cache_ident)))
     {
       if (error)
         {
@@ -1255,7 +1659,6 @@ mx_image_set_from_pixbuf (MxImage      *image,
           if (error)
             g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
                          "Unsupported image formatting");
-          g_object_unref (pixbuf);
           return FALSE;
         }
     }
@@ -1271,12 +1674,280 @@ mx_image_set_from_pixbuf (MxImage      *image,
   return
     mx_image_set_from_data_internal (image,
                                  pixbuf ? gdk_pixbuf_get_pixels (pixbuf) : NULL,
-                                 filename, TRUE,
+                                 filename, cache_ident, TRUE,
                                  has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 :
                                              COGL_PIXEL_FORMAT_RGB_888,
                                  width, height, rowstride, error);
 }
 
+/* Returns the file in the disk cache that holds @filename loaded at
+ * @width x @height, or %NULL if @filename doesn't exist or isn't loaded at
+ * a smaller size than its own. The name depends on the modification time
+ * and size of @filename, so a changed image is never read back from a
+ * stale entry. */
+static gchar *
+mx_image_disk_cache_get_path (const gchar *filename,
+                              gint         width,
+                              gint         height,
+                              guint        width_threshold,
+                              guint        height_threshold,
+                              gboolean     upscale)
+{
+  gchar *cwd, *absolute, *key, *checksum, *name, *path;
+  struct stat info;
+
+  /* storing images at their own size would only copy the files */
+  if (width < 0 && height < 0)
+    return NULL;
+
+  if (g_stat (filename, &info))
+    return NULL;
+
+  if (g_path_is_absolute (filename))
+    absolute = g_strdup (filename);
+  else
+    {
+      cwd = g_get_current_dir ();
+      absolute = g_build_filename (cwd, filename, NULL);
+      g_free (cwd);
+    }
+
+  key = g_strdup_printf ("%s\n%" G_GUINT64_FORMAT "\n%" G_GUINT64_FORMAT
+                         "\n%dx%d\n%ux%u%s", absolute,
+                         (guint64) info.st_mtime, (guint64) info.st_size,
+                         width, height, width_threshold, height_threshold,
+                         upscale ? "-upscale" : "");
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, key, -1);
+  name = g_strconcat (checksum, ".rgba", NULL);
+  path = g_build_filename (g_get_user_cache_dir (), "mx", "images", name,
+                           NULL);
+
+  g_free (name);
+  g_free (checksum);
+  g_free (key);
+  g_free (absolute);
+
+  return path;
+}
+
+/* Maps the image stored at @path, or returns %NULL if it isn't there or
+ * is damaged */
+static GMappedFile *
+mx_image_disk_cache_load (const gchar *path)
+{
+  const MxImageDiskCacheHeader *header;
+  GMappedFile *file;
+  gsize length;
+
+  file = g_mapped_file_new (path, FALSE, NULL);
+  if (!file)
+    return NULL;
+
+  header = (const MxImageDiskCacheHeader *) g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+
+  if (length < sizeof (MxImageDiskCacheHeader) ||
+      memcmp (header->magic, MX_IMAGE_DISK_CACHE_MAGIC,
+              sizeof (header->magic)) ||
+      header->width == 0 || header->height == 0 ||
+      header->width > G_MAXUINT16 || header->height > G_MAXUINT16 ||
+      length - sizeof (MxImageDiskCacheHeader) !=
+        (gsize) (header->width + 2) * (header->height + 2) * 4)
+    {
+      g_mapped_file_unref (file);
+      return NULL;
+    }
+
+  /* the cache is trimmed by the time of the last use */
+  g_utime (path, NULL);
+
+  return file;
+}
+
+typedef struct
+{
+  gchar  *name;
+  time_t  mtime;
+  gint64  size;
+} MxImageDiskCacheEntry;
+
+static gint
+mx_image_disk_cache_compare_mtime (gconstpointer a,
+                                   gconstpointer b)
+{
+  const MxImageDiskCacheEntry *entry_a = a;
+  const MxImageDiskCacheEntry *entry_b = b;
+
+  if (entry_a->mtime < entry_b->mtime)
+    return -1;
+  if (entry_a->mtime > entry_b->mtime)
+    return 1;
+
+  return 0;
+}
+
+/* Totals the size of the images in the disk cache at @dirname and, if it
+ * is over MX_IMAGE_DISK_CACHE_MAX_SIZE, removes the least recently used
+ * images until it is well under it. Called with mx_image_disk_cache_lock
+ * held. */
+static void
+mx_image_disk_cache_trim (const gchar *dirname)
+{
+  MxImageDiskCacheEntry entry;
+  const gchar *name;
+  GArray *entries;
+  gint64 total;
+  GDir *dir;
+  guint i;
+
+  dir = g_dir_open (dirname, 0, NULL);
+  if (!dir)
+    return;
+
+  entries = g_array_new (FALSE, FALSE, sizeof (MxImageDiskCacheEntry));
+  total = 0;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      struct stat info;
+      gchar *path;
+
+      if (!g_str_has_suffix (name, ".rgba"))
+        continue;
+
+      path = g_build_filename (dirname, name, NULL);
+      if (!g_stat (path, &info))
+        {
+          entry.name = path;
+          entry.mtime = info.st_mtime;
+          entry.size = info.st_size;
+          total += entry.size;
+
+          g_array_append_val (entries, entry);
+        }
+      else
+        g_free (path);
+    }
+
+  g_dir_close (dir);
+
+  if (total > MX_IMAGE_DISK_CACHE_MAX_SIZE)
+    {
+      g_array_sort (entries, mx_image_disk_cache_compare_mtime);
+
+      /* leave some room, so the next few images don't trim it again */
+      for (i = 0;
+           i < entries->len && total > MX_IMAGE_DISK_CACHE_MAX_SIZE / 4 * 3;
+           i++)
+        {
+          MxImageDiskCacheEntry *old =
+            &g_array_index (entries, MxImageDiskCacheEntry, i);
+
+          if (!g_unlink (old->name))
+            total -= old->size;
+        }
+    }
+
+  for (i = 0; i < entries->len; i++)
+    g_free (g_array_index (entries, MxImageDiskCacheEntry, i).name);
+  g_array_free (entries, TRUE);
+
+  mx_image_disk_cache_size = total;
+}
+
+/* Stores @padded, laid out by mx_image_pad_pixbuf(), in the disk cache at
+ * @path. Failing to do so isn't an error, the image will just be decoded
+ * again next time. */
+static void
+mx_image_disk_cache_save (const gchar  *path,
+                          const guchar *padded,
+                          gint          width,
+                          gint          height)
+{
+  MxImageDiskCacheHeader header;
+  gchar *dirname, *tmp_path;
+  gboolean written;
+  FILE *file;
+  gint fd;
+
+  if ((gint64) width * height > MX_IMAGE_DISK_CACHE_MAX_PIXELS)
+    return;
+
+  dirname = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dirname, 0700))
+    {
+      g_free (dirname);
+      return;
+    }
+
+  /* Write to a temporary file first, so other threads or processes never
+   * map a partly written image */
+  tmp_path = g_strconcat (path, ".XXXXXX", NULL);
+  fd = g_mkstemp (tmp_path);
+  if (fd == -1 || !(file = fdopen (fd, "wb")))
+    {
+      if (fd != -1)
+        {
+          close (fd);
+          g_unlink (tmp_path);
+        }
+      g_free (tmp_path);
+      g_free (dirname);
+      return;
+    }
+
+  memcpy (header.magic, MX_IMAGE_DISK_CACHE_MAGIC, sizeof (header.magic));
+  header.width = width;
+  header.height = height;
+
+  written = (fwrite (&header, sizeof (header), 1, file) == 1 &&
+             fwrite (padded, (gsize) (width + 2) * 4, height + 2, file) ==
+               (gsize) (height + 2));
+
+  if (fclose (file) || !written || g_rename (tmp_path, path))
+    {
+      g_unlink (tmp_path);
+      written = FALSE;
+    }
+
+  g_free (tmp_path);
+
+  /* keep the cache under its size, counting what the other processes have
+   * stored the first time and whenever it looks full */
+  if (written)
+    {
+      g_mutex_lock (mx_image_disk_cache_lock);
+
+      if (mx_image_disk_cache_size >= 0)
+        mx_image_disk_cache_size += sizeof (header) +
+          (gint64) (width + 2) * (height + 2) * 4;
+
+      if (mx_image_disk_cache_size < 0 ||
+          mx_image_disk_cache_size > MX_IMAGE_DISK_CACHE_MAX_SIZE)
+        mx_image_disk_cache_trim (dirname);
+
+      g_mutex_unlock (mx_image_disk_cache_lock);
+    }
+
+  g_free (dirname);
+}
+
+/* Sets the image from a file mapped from the disk cache */
+static gboolean
+mx_image_set_from_disk_cache (MxImage      *image,
+                              GMappedFile  *file,
+                              const gchar  *filename,
+                              gpointer      cache_ident,
+                              GError      **error)
+{
+  const MxImageDiskCacheHeader *header =
+    (const MxImageDiskCacheHeader *) g_mapped_file_get_contents (file);
+
+  return mx_image_set_from_padded_data (image, (const guchar *) (header + 1),
+                                        header->width, header->height,
+                                        filename, cache_ident, error);
+}
+
 static gboolean
 mx_image_load_complete_cb (gpointer task_data)
 {
@@ -1304,13 +1975,26 @@ mx_image_load_complete_cb (gpointer task_data)
       /* If we managed to load the pixbuf, set it now, otherwise forward the
        * error on to the user via a signal.
        */
-      if (data->pixbuf)
+      if (data->padded || data->cached)
         {
           GError *error = NULL;
-          gboolean resized = (data->width != -1 || data->height != -1);
-          gboolean success =
-            mx_image_set_from_pixbuf (data->parent, data->pixbuf,
-                                      resized ? data->filename : NULL, &error);
+          gpointer ident = mx_image_get_cache_ident (data->width, data->height,
+                                                     data->width_threshold,
+                                                     data->height_threshold,
+                                                     data->upscale);
+          gboolean success;
+
+          if (data->cached)
+            success = mx_image_set_from_disk_cache (data->parent, data->cached,
+                                                    data->filename, ident,
+                                                    &error);
+          else
+            success = mx_image_set_from_padded_data (data->parent,
+                                                     data->padded,
+                                                     data->image_width,
+                                                     data->image_height,
+                                                     data->filename, ident,
+                                                     &error);
 
           if (success)
             g_signal_emit (data->parent, signals[IMAGE_LOADED], 0);
@@ -1337,7 +2021,6 @@ typedef struct
   guint    width_threshold;
   guint    height_threshold;
   gboolean upscale;
-  gboolean scaled;
 } MxImageSizeRequest;
 
 static void
@@ -1377,7 +2060,6 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
       gdk_pixbuf_loader_set_size (loader, constraints->width,
                                   (constraints->width / (gfloat)width) *
                                   (gfloat)height);
-      constraints->scaled = TRUE;
     }
   else
     {
@@ -1391,7 +2073,6 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
                                   (constraints->height / (gfloat)height) *
                                   (gfloat)width,
                                   constraints->height);
-      constraints->scaled = TRUE;
     }
 }
 
@@ -1421,7 +2102,6 @@ mx_image_pixbuf_new (const gchar  *filename,
                      guint         width_threshold,
                      guint         height_threshold,
                      gboolean      upscale,
-                     gboolean     *scaled,
                      GError      **error)
 {
   GdkPixbuf *pixbuf;
@@ -1487,18 +2167,220 @@ mx_image_pixbuf_new (const gchar  *filename,
 
   g_object_unref (loader);
 
-  if (scaled)
-    *scaled = constraints.scaled;
-
   return pixbuf;
 }
 
+/* Gets the bounding box of the allocation of @actor in stage coordinates.
+ * The allocation is transformed by the parent of @actor only, so that a
+ * scrollable's own scrolling doesn't move it. */
+static void
+mx_image_get_stage_box (ClutterActor    *actor,
+                        ClutterActorBox *box)
+{
+  ClutterActor *parent = clutter_actor_get_parent (actor);
+  ClutterActorBox allocation;
+  ClutterVertex verts[4];
+  gint i;
+
+  clutter_actor_get_allocation_box (actor, &allocation);
+
+  for (i = 0; i < 4; i++)
+    {
+      ClutterVertex point;
+
+      point.x = (i & 1) ? allocation.x2 : allocation.x1;
+      point.y = (i & 2) ? allocation.y2 : allocation.y1;
+      point.z = 0;
+
+      clutter_actor_apply_transform_to_point (parent, &point, &verts[i]);
+    }
+
+  box->x1 = box->x2 = verts[0].x;
+  box->y1 = box->y2 = verts[0].y;
+  for (i = 1; i < 4; i++)
+    {
+      box->x1 = MIN (box->x1, verts[i].x);
+      box->y1 = MIN (box->y1, verts[i].y);
+      box->x2 = MAX (box->x2, verts[i].x);
+      box->y2 = MAX (box->y2, verts[i].y);
+    }
+}
+
+/* Works out how soon @image should be loaded, from whether it is in view
+ * or within a view's width or height of it. The view is the part of the
+ * stage shown by the nearest scrollable ancestor, which is allocated the
+ * size of its viewport and scrolls its children within it, or the stage
+ * when the image isn't scrolled. */
+static gint
+mx_image_get_load_priority (MxImage *image)
+{
+  ClutterActor *actor = CLUTTER_ACTOR (image);
+  ClutterActor *stage, *parent;
+  ClutterActorBox box, view;
+  gfloat width, height;
+
+  if (!CLUTTER_ACTOR_IS_MAPPED (actor) ||
+      !(stage = clutter_actor_get_stage (actor)))
+    return MX_IMAGE_PRIORITY_HIDDEN;
+
+  view.x1 = 0;
+  view.y1 = 0;
+  clutter_actor_get_size (stage, &view.x2, &view.y2);
+
+  for (parent = clutter_actor_get_parent (actor);
+       parent && parent != stage;
+       parent = clutter_actor_get_parent (parent))
+    {
+      if (MX_IS_SCROLLABLE (parent))
+        {
+          ClutterActorBox scrollable;
+
+          mx_image_get_stage_box (parent, &scrollable);
+          view.x1 = MAX (view.x1, scrollable.x1);
+          view.y1 = MAX (view.y1, scrollable.y1);
+          view.x2 = MIN (view.x2, scrollable.x2);
+          view.y2 = MIN (view.y2, scrollable.y2);
+          break;
+        }
+    }
+
+  if (view.x2 <= view.x1 || view.y2 <= view.y1)
+    return MX_IMAGE_PRIORITY_HIDDEN;
+
+  mx_image_get_stage_box (actor, &box);
+
+  if (box.x2 >= view.x1 && box.y2 >= view.y1 &&
+      box.x1 <= view.x2 && box.y1 <= view.y2)
+    return MX_IMAGE_PRIORITY_VISIBLE;
+
+  width = view.x2 - view.x1;
+  height = view.y2 - view.y1;
+
+  if (box.x2 >= view.x1 - width && box.y2 >= view.y1 - height &&
+      box.x1 <= view.x2 + width && box.y1 <= view.y2 + height)
+    return MX_IMAGE_PRIORITY_NEAR;
+
+  return MX_IMAGE_PRIORITY_HIDDEN;
+}
+
+/* Updates the priorities of the queued loads once per frame, so that the
+ * images scrolled into view since they were queued are loaded first. The
+ * priorities are worked out without the queue locked, so that the loading
+ * threads aren't held up by it. Queued loads are only freed from the main
+ * thread, so they stay valid meanwhile. */
+static gboolean
+mx_image_queue_reprioritize (gpointer user_data)
+{
+  GPtrArray *loads;
+  gint *priorities;
+  gboolean queued;
+  GList *l;
+  guint i;
+
+  g_mutex_lock (mx_image_queue_lock);
+
+  loads = g_ptr_array_sized_new (g_queue_get_length (&mx_image_queue));
+  for (l = mx_image_queue.head; l; l = l->next)
+    g_ptr_array_add (loads, l->data);
+
+  g_mutex_unlock (mx_image_queue_lock);
+
+  priorities = g_new (gint, loads->len + 1);
+  for (i = 0; i < loads->len; i++)
+    {
+      MxImageAsyncData *data = g_ptr_array_index (loads, i);
+
+      priorities[i] = mx_image_get_load_priority (data->parent);
+    }
+
+  g_mutex_lock (mx_image_queue_lock);
+
+  for (i = 0; i < loads->len; i++)
+    ((MxImageAsyncData *) g_ptr_array_index (loads, i))->priority =
+      priorities[i];
+
+  queued = !g_queue_is_empty (&mx_image_queue);
+  if (!queued)
+    mx_image_reprioritize_id = 0;
+
+  g_mutex_unlock (mx_image_queue_lock);
+
+  g_free (priorities);
+  g_ptr_array_free (loads, TRUE);
+
+  return queued;
+}
+
+static void
+mx_image_queue_push (MxImageAsyncData *data)
+{
+  data->priority = mx_image_get_load_priority (data->parent);
+
+  g_mutex_lock (mx_image_queue_lock);
+  g_queue_push_tail (&mx_image_queue, data);
+  g_mutex_unlock (mx_image_queue_lock);
+
+  if (!mx_image_reprioritize_id)
+    mx_image_reprioritize_id =
+      clutter_threads_add_repaint_func (mx_image_queue_reprioritize,
+                                        NULL, NULL);
+
+  /* The pool only counts loads, the thread takes whichever load is the
+   * most important when it gets to run */
+  g_thread_pool_push (mx_image_threads, GINT_TO_POINTER (TRUE), NULL);
+}
+
+/* Takes the most important load out of the queue, the oldest first among
+ * loads that are equally important. Returns %NULL if the load this thread
+ * was started for has since been cancelled. */
+static MxImageAsyncData *
+mx_image_queue_pop (void)
+{
+  MxImageAsyncData *best = NULL;
+  GList *l, *best_link = NULL;
+
+  g_mutex_lock (mx_image_queue_lock);
+
+  for (l = mx_image_queue.head; l; l = l->next)
+    {
+      MxImageAsyncData *data = l->data;
+
+      if (!best || data->priority > best->priority)
+        {
+          best = data;
+          best_link = l;
+        }
+    }
+
+  if (best_link)
+    g_queue_delete_link (&mx_image_queue, best_link);
+
+  g_mutex_unlock (mx_image_queue_lock);
+
+  return best;
+}
+
+static guint
+mx_image_get_n_processors (void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  return MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+#else
+  /* FIXME: add more OSs */
+  return 1;
+#endif
+}
+
 static void
 mx_image_async_cb (gpointer task_data,
                    gpointer user_data)
 {
-  gboolean scaled;
-  MxImageAsyncData *data = task_data;
+  MxImageAsyncData *data;
+  gchar *cache_path = NULL;
+
+  data = mx_image_queue_pop ();
+  if (!data)
+    return;
 
   g_mutex_lock (data->mutex);
 
@@ -1515,21 +2397,48 @@ mx_image_async_cb (gpointer task_data,
       return;
     }
 
-  /* Try to load the pixbuf */
-  data->pixbuf = mx_image_pixbuf_new (data->filename, data->buffer,
-                                      data->count, data->width, data->height,
-                                      data->width_threshold,
-                                      data->height_threshold, data->upscale,
-                                      &scaled,
-                                      &data->error);
+  /* Try the disk cache before decoding the image */
+  if (data->use_disk_cache && data->filename)
+    {
+      cache_path = mx_image_disk_cache_get_path (data->filename,
+                                                 data->width, data->height,
+                                                 data->width_threshold,
+                                                 data->height_threshold,
+                                                 data->upscale);
+      if (cache_path)
+        data->cached = mx_image_disk_cache_load (cache_path);
+    }
 
-  /* If scaling was unnecessary, we can cache the result */
-  if (!scaled)
+  /* Try to load the pixbuf, and lay it out ready for uploading */
+  if (!data->cached)
     {
-      data->width = -1;
-      data->height = -1;
+      GdkPixbuf *pixbuf;
+
+      pixbuf = mx_image_pixbuf_new (data->filename, data->buffer,
+                                    data->count, data->width, data->height,
+                                    data->width_threshold,
+                                    data->height_threshold, data->upscale,
+                                    &data->error);
+      if (pixbuf)
+        {
+          data->image_width = gdk_pixbuf_get_width (pixbuf);
+          data->image_height = gdk_pixbuf_get_height (pixbuf);
+          data->padded = mx_image_pad_pixbuf (pixbuf);
+
+          if (!data->padded)
+            g_set_error (&data->error, MX_IMAGE_ERROR,
+                         MX_IMAGE_ERROR_BAD_FORMAT,
+                         "Unsupported image formatting");
+          else if (cache_path)
+            mx_image_disk_cache_save (cache_path, data->padded,
+                                      data->image_width, data->image_height);
+
+          g_object_unref (pixbuf);
+        }
     }
 
+  g_free (cache_path);
+
   data->complete = TRUE;
   data->idle_handler =
     clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
@@ -1571,19 +2480,12 @@ mx_image_set_async (MxImage         *image,
       return FALSE;
     }
 
-  err = NULL;
-  data = NULL;
-
   /* Load the pixbuf in a thread, then later on upload it to the GPU */
   if (!mx_image_threads)
     {
+      err = NULL;
       mx_image_threads = g_thread_pool_new (mx_image_async_cb, NULL,
-#ifdef _SC_NPROCESSORS_ONLN
-                                            sysconf (_SC_NPROCESSORS_ONLN),
-#else
-                                            /* FIXME: add more OSs */
-                                            1,
-#endif
+                                            mx_image_get_max_load_threads (),
                                             FALSE, &err);
       if (!mx_image_threads)
         {
@@ -1593,53 +2495,17 @@ mx_image_set_async (MxImage         *image,
     }
 
   /* Cancel/free any in-progress load */
-  if (priv->async_load_data)
-    {
-      MxImageAsyncData *old_data = priv->async_load_data;
-
-      if (!g_mutex_trylock (old_data->mutex))
-        {
-          /* The thread is busy, cancel it and start a new one */
-          old_data->cancelled = TRUE;
-        }
-      else
-        {
-          if (old_data->complete)
-            {
-              /* The load finished, cancel the upload */
-              old_data->cancelled = TRUE;
-              g_mutex_unlock (old_data->mutex);
-            }
-          else
-            {
-              /* The load hasn't begun, we'll hijack it */
-              g_free (old_data->filename);
-              old_data->filename = g_strdup (filename);
-              old_data->buffer = buffer;
-              old_data->count = count;
-              old_data->free_func = free_func;
-              old_data->width = width;
-              old_data->height = height;
-              old_data->cancelled = FALSE;
-              g_mutex_unlock (old_data->mutex);
-
-              data = old_data;
-            }
-        }
-    }
+  mx_image_cancel_in_progress (image);
 
-  if (!data)
-    {
-      /* Create the async load data and add it to the thread-pool */
-      priv->async_load_data = data = mx_image_async_data_new (image);
-      data->filename = g_strdup (filename);
-      data->buffer = buffer;
-      data->count = count;
-      data->free_func = free_func;
-      data->width = width;
-      data->height = height;
-      g_thread_pool_push (mx_image_threads, data, NULL);
-    }
+  /* Create the async load data and add it to the queue */
+  priv->async_load_data = data = mx_image_async_data_new (image);
+  data->filename = g_strdup (filename);
+  data->buffer = buffer;
+  data->count = count;
+  data->free_func = free_func;
+  data->width = width;
+  data->height = height;
+  mx_image_queue_push (data);
 
   return TRUE;
 }
@@ -1691,7 +2557,11 @@ mx_image_set_from_file_at_size (MxImage      *image,
   GdkPixbuf *pixbuf;
   MxImagePrivate *priv;
   MxTextureCache *cache;
-  gboolean retval, use_cache;
+  gchar *cache_path;
+  GMappedFile *cached;
+  guchar *padded;
+  gpointer ident;
+  gboolean retval;
 
   if (G_UNLIKELY (!MX_IS_IMAGE (image)))
     {
@@ -1704,16 +2574,16 @@ mx_image_set_from_file_at_size (MxImage      *image,
 
   priv = image->priv;
   pixbuf = NULL;
+  cache_path = NULL;
 
-  /* Check if the processed image is in the cache - we don't use the cache
-   * if we're loading at a particular size.
-   */
+  /* Check if the processed image is in the cache, at the requested size */
   cache = mx_texture_cache_get_default ();
-  use_cache = TRUE;
+  ident = mx_image_get_cache_ident (width, height,
+                                    priv->width_threshold,
+                                    priv->height_threshold,
+                                    priv->upscale);
 
-  if ((width != -1) || (height != -1) ||
-      !mx_texture_cache_contains_meta (cache, filename,
-                                       GINT_TO_POINTER (mx_image_cache_quark)))
+  if (!mx_texture_cache_contains_meta (cache, filename, ident))
     {
       /* Check if the unprocessed image is in the cache, and if so, skip
        * loading it and set it from the Cogl texture handle.
@@ -1725,9 +2595,8 @@ mx_image_set_from_file_at_size (MxImage      *image,
               mx_texture_cache_get_cogl_texture (cache, filename)))
             {
               /* Add the processed image to the cache */
-              mx_texture_cache_insert_meta (cache, filename,
-                                        GINT_TO_POINTER (mx_image_cache_quark),
-                                        priv->texture, NULL);
+              mx_texture_cache_insert_meta (cache, filename, ident,
+                                            priv->texture, NULL);
               return TRUE;
             }
           else
@@ -1745,22 +2614,64 @@ mx_image_set_from_file_at_size (MxImage      *image,
         return mx_image_set_async (image, filename, NULL, 0, NULL,
                                    width, height, error);
 
+      /* Use the decoded image from the disk cache if there is one */
+      if (priv->use_disk_cache)
+        {
+          cache_path = mx_image_disk_cache_get_path (filename, width, height,
+                                                     priv->width_threshold,
+                                                     priv->height_threshold,
+                                                     priv->upscale);
+          cached = cache_path ? mx_image_disk_cache_load (cache_path) : NULL;
+
+          if (cached)
+            {
+              retval = mx_image_set_from_disk_cache (image, cached, filename,
+                                                     ident, error);
+              g_mapped_file_unref (cached);
+              g_free (cache_path);
+
+              return retval;
+            }
+        }
+
       /* Synchronously load the pixbuf and set it */
       pixbuf = mx_image_pixbuf_new (filename, NULL, 0, width, height,
                                     priv->width_threshold,
                                     priv->height_threshold,
-                                    priv->upscale, &use_cache, error);
+                                    priv->upscale, error);
       if (!pixbuf)
-        return FALSE;
-    }
+        {
+          g_free (cache_path);
+          return FALSE;
+        }
 
-  retval = mx_image_set_from_pixbuf (image, pixbuf,
-                                     use_cache ? filename : NULL, error);
+      /* Unsupported formats are reported by mx_image_set_from_pixbuf() */
+      padded = mx_image_pad_pixbuf (pixbuf);
+      if (padded)
+        {
+          gint image_width = gdk_pixbuf_get_width (pixbuf);
+          gint image_height = gdk_pixbuf_get_height (pixbuf);
 
-  if (pixbuf)
-    g_object_unref (pixbuf);
+          if (cache_path)
+            mx_image_disk_cache_save (cache_path, padded,
+                                      image_width, image_height);
 
-  return retval;
+          retval = mx_image_set_from_padded_data (image, padded,
+                                                  image_width, image_height,
+                                                  filename, ident, error);
+          g_free (padded);
+        }
+      else
+        retval = mx_image_set_from_pixbuf (image, pixbuf, filename, ident,
+                                           error);
+
+      g_free (cache_path);
+      g_object_unref (pixbuf);
+
+      return retval;
+    }
+
+  return mx_image_set_from_pixbuf (image, NULL, filename, ident, error);
 }
 
 /**
@@ -1947,11 +2858,11 @@ mx_image_set_from_buffer_at_size (MxImage         *image,
 
   pixbuf = mx_image_pixbuf_new (NULL, buffer, buffer_size, width, height,
                                 priv->width_threshold, priv->height_threshold,
-                                priv->upscale, NULL, error);
+                                priv->upscale, error);
   if (!pixbuf)
     return FALSE;
 
-  retval = mx_image_set_from_pixbuf (image, pixbuf, NULL, error);
+  retval = mx_image_set_from_pixbuf (image, pixbuf, NULL, NULL, error);
 
   g_object_unref (pixbuf);
 
@@ -1991,11 +2902,8 @@ mx_image_set_load_async (MxImage  *image,
       g_object_notify (G_OBJECT (image), "load-async");
 
       /* Cancel the old transfer if we're turning async off */
-      if (!load_async && priv->async_load_data)
-        {
-          priv->async_load_data->cancelled = TRUE;
-          priv->async_load_data = NULL;
-        }
+      if (!load_async)
+        mx_image_cancel_in_progress (image);
     }
 }
 
@@ -2242,3 +3150,91 @@ mx_image_get_transition_duration (MxImage *image)
 
   return image->priv->transition_duration;
 }
+
+/**
+ * mx_image_set_use_disk_cache:
+ * @image: A #MxImage
+ * @use_disk_cache: %TRUE to keep decoded images on disk
+ *
+ * Sets whether images loaded from files are stored in decoded form in the
+ * user's cache directory. When they are, loading the same file at the same
+ * size again maps the stored pixels instead of decoding the file, even
+ * after the application restarts. Entries are tied to the modification
+ * time and size of the file, so changed files are decoded again.
+ *
+ * Only images loaded at a requested size, such as thumbnails, are stored,
+ * and only up to about a megapixel. Images loaded at their own size are
+ * always decoded from the file. The least recently used images are
+ * removed once the cache grows past 128 MiB.
+ *
+ * Since: 1.6
+ */
+void
+mx_image_set_use_disk_cache (MxImage  *image,
+                             gboolean  use_disk_cache)
+{
+  MxImagePrivate *priv;
+
+  g_return_if_fail (MX_IS_IMAGE (image));
+
+  priv = image->priv;
+  if (priv->use_disk_cache != use_disk_cache)
+    {
+      priv->use_disk_cache = use_disk_cache;
+      g_object_notify (G_OBJECT (image), "use-disk-cache");
+    }
+}
+
+/**
+ * mx_image_get_use_disk_cache:
+ * @image: A #MxImage
+ *
+ * Determines whether decoded images are stored in the disk cache.
+ *
+ * Returns: %TRUE if the disk cache is used, %FALSE otherwise
+ *
+ * Since: 1.6
+ */
+gboolean
+mx_image_get_use_disk_cache (MxImage *image)
+{
+  g_return_val_if_fail (MX_IS_IMAGE (image), FALSE);
+  return image->priv->use_disk_cache;
+}
+
+/**
+ * mx_image_set_max_load_threads:
+ * @max_threads: The number of threads, or 0 for one per processor
+ *
+ * Sets the number of threads that decode images that are loaded
+ * asynchronously. This affects every #MxImage. The default is one thread
+ * per processor.
+ *
+ * Since: 1.6
+ */
+void
+mx_image_set_max_load_threads (guint max_threads)
+{
+  mx_image_max_threads = max_threads;
+
+  if (mx_image_threads)
+    g_thread_pool_set_max_threads (mx_image_threads,
+                                   mx_image_get_max_load_threads (), NULL);
+}
+
+/**
+ * mx_image_get_max_load_threads:
+ *
+ * Gets the number of threads that decode images that are loaded
+ * asynchronously.
+ *
+ * Returns: the number of threads
+ *
+ * Since: 1.6
+ */
+guint
+mx_image_get_max_load_threads (void)
+{
+  return mx_image_max_threads ? mx_image_max_threads :
+                                mx_image_get_n_processors ();
+}
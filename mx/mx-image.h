@@ -138,6 +138,13 @@ void     mx_image_set_allow_upscale (MxImage *image,
                                      gboolean allow);
 gboolean mx_image_get_allow_upscale (MxImage *image);
 
+void     mx_image_set_use_disk_cache (MxImage  *image,
+                                      gboolean  use_disk_cache);
+gboolean mx_image_get_use_disk_cache (MxImage  *image);
+
+void     mx_image_set_max_load_threads (guint max_threads);
+guint    mx_image_get_max_load_threads (void);
+
 void     mx_image_set_scale_width_threshold (MxImage *image,
                                              guint    pixels);
 guint    mx_image_get_scale_width_threshold (MxImage *image);
@@ -32,21 +32,26 @@
  *
  * Data is set on the children by mapping columns in the model to object
  * properties on the children.
+ *
+ * For large models, #MxItemView:virtual can be set so that children are
+ * only created for the rows that fit in the view, plus a few lines either
+ * side. Children that scroll out of view are reused for the rows that
+ * scroll into it. In this mode, the items are laid out in lines of equally
+ * sized cells and the view should be placed in a #MxScrollView.
  */
 
 #include "mx-item-view.h"
 #include "mx-private.h"
+#include "mx-view-items.h"
 
 G_DEFINE_TYPE (MxItemView, mx_item_view, MX_TYPE_GRID)
 
 #define ITEM_VIEW_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), MX_TYPE_ITEM_VIEW, MxItemViewPrivate))
 
-typedef struct
-{
-  gchar *name;
-  gint   col;
-} AttributeData;
+/* Lines kept either side of the viewport in virtual mode, so that slow
+ * scrolling doesn't have to rebind items on every step */
+#define MX_ITEM_VIEW_VIRTUAL_MARGIN 2
 
 enum
 {
@@ -54,24 +59,29 @@ enum
 
   PROP_MODEL,
   PROP_ITEM_TYPE,
-  PROP_FACTORY
+  PROP_FACTORY,
+  PROP_VIRTUAL,
+  PROP_USE_ACTOR_MANAGER
 };
 
-struct _MxItemViewPrivate
+enum
 {
-  ClutterModel  *model;
-  GSList        *attributes;
-  GType          item_type;
+  POPULATED,
 
-  MxItemFactory *factory;
+  LAST_SIGNAL
+};
 
-  gulong         filter_changed;
-  gulong         row_added;
-  gulong         row_changed;
-  gulong         row_removed;
-  gulong         sort_changed;
+static guint signals[LAST_SIGNAL] = { 0, };
 
-  guint          is_frozen : 1;
+struct _MxItemViewPrivate
+{
+  /* the model, and the items showing its rows */
+  MxViewItems *view_items;
+
+  /* the size of the cells in virtual mode */
+  gfloat       cell_width;
+  gfloat       cell_height;
+  gint         columns;
 };
 
 /* gobject implementations */
@@ -82,17 +92,23 @@ mx_item_view_get_property (GObject    *object,
                            GValue     *value,
                            GParamSpec *pspec)
 {
-  MxItemViewPrivate *priv = MX_ITEM_VIEW (object)->priv;
+  MxViewItems *view_items = MX_ITEM_VIEW (object)->priv->view_items;
   switch (property_id)
     {
     case PROP_MODEL:
-      g_value_set_object (value, priv->model);
+      g_value_set_object (value, view_items->model);
       break;
     case PROP_ITEM_TYPE:
-      g_value_set_gtype (value, priv->item_type);
+      g_value_set_gtype (value, view_items->item_type);
       break;
     case PROP_FACTORY:
-      g_value_set_object (value, priv->factory);
+      g_value_set_object (value, view_items->factory);
+      break;
+    case PROP_VIRTUAL:
+      g_value_set_boolean (value, view_items->is_virtual);
+      break;
+    case PROP_USE_ACTOR_MANAGER:
+      g_value_set_boolean (value, view_items->use_actor_manager);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -118,6 +134,14 @@ mx_item_view_set_property (GObject      *object,
       mx_item_view_set_factory ((MxItemView*) object,
                                 (MxItemFactory*) g_value_get_object (value));
       break;
+    case PROP_VIRTUAL:
+      mx_item_view_set_virtual ((MxItemView*) object,
+                                g_value_get_boolean (value));
+      break;
+    case PROP_USE_ACTOR_MANAGER:
+      mx_item_view_set_use_actor_manager ((MxItemView*) object,
+                                          g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -126,8 +150,7 @@ mx_item_view_set_property (GObject      *object,
 static void
 mx_item_view_dispose (GObject *object)
 {
-  /* This will cause the unref of the model and also disconnect the signals */
-  mx_item_view_set_model (MX_ITEM_VIEW (object), NULL);
+  _mx_view_items_dispose (MX_ITEM_VIEW (object)->priv->view_items);
 
   G_OBJECT_CLASS (mx_item_view_parent_class)->dispose (object);
 }
@@ -135,198 +158,314 @@ mx_item_view_dispose (GObject *object)
 static void
 mx_item_view_finalize (GObject *object)
 {
-  MxItemViewPrivate *priv = MX_ITEM_VIEW (object)->priv;
-
-  if (priv->attributes)
-    {
-      g_slist_foreach (priv->attributes, (GFunc) g_free, NULL);
-      g_slist_free (priv->attributes);
-      priv->attributes = NULL;
-    }
+  _mx_view_items_free (MX_ITEM_VIEW (object)->priv->view_items);
 
   G_OBJECT_CLASS (mx_item_view_parent_class)->finalize (object);
 }
 
-static void
-mx_item_view_class_init (MxItemViewClass *klass)
+/* virtual mode */
+
+/* The number of cells that fit on a line of the given width */
+static gint
+mx_item_view_get_columns (MxItemView *item_view,
+                          gfloat      avail_width)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  GParamSpec *pspec;
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat spacing;
 
-  g_type_class_add_private (klass, sizeof (MxItemViewPrivate));
+  if (avail_width <= 0 || priv->cell_width <= 0)
+    return MAX (priv->columns, 1);
 
-  object_class->get_property = mx_item_view_get_property;
-  object_class->set_property = mx_item_view_set_property;
-  object_class->dispose = mx_item_view_dispose;
-  object_class->finalize = mx_item_view_finalize;
+  spacing = mx_grid_get_column_spacing (MX_GRID (item_view));
 
-  pspec = g_param_spec_object ("model",
-                               "model",
-                               "The model for the item view",
-                               CLUTTER_TYPE_MODEL,
-                               MX_PARAM_READWRITE);
-  g_object_class_install_property (object_class, PROP_MODEL, pspec);
+  return MAX (1, (gint) ((avail_width + spacing) /
+                         (priv->cell_width + spacing)));
+}
 
-  pspec = g_param_spec_gtype ("item-type",
-                              "Item Type",
-                              "The GType to use as the items in the view. "
-                              "Must be a subclass of ClutterActor",
-                              CLUTTER_TYPE_ACTOR,
-                              MX_PARAM_READWRITE);
-  g_object_class_install_property (object_class, PROP_ITEM_TYPE, pspec);
+static void
+mx_item_view_get_lines (ClutterActor *actor,
+                        gfloat       *line_height,
+                        gfloat       *spacing,
+                        gint         *columns)
+{
+  MxItemViewPrivate *priv = MX_ITEM_VIEW (actor)->priv;
 
-  /* Note, interfaces aren't necessarily objects, so you can't use
-   * MX_TYPE_ITEM_FACTORY here. The function mx_item_view_set_factory does
-   * a type check, so this is still safe.
-   */
-  pspec = g_param_spec_object ("factory",
-                               "Factory",
-                               "The MxItemFactory used for creating new items.",
-                               G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
-                               MX_PARAM_READWRITE);
-  g_object_class_install_property (object_class, PROP_FACTORY, pspec);
+  *line_height = priv->cell_height;
+  *spacing = mx_grid_get_row_spacing (MX_GRID (actor));
+  *columns = priv->columns;
 }
 
 static void
-mx_item_view_init (MxItemView *item_view)
+mx_item_view_measure (ClutterActor *actor,
+                      ClutterActor *item)
 {
-  item_view->priv = ITEM_VIEW_PRIVATE (item_view);
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  MxItemViewPrivate *priv = item_view->priv;
+  ClutterActorBox box = { 0, };
+  MxPadding padding = { 0, };
+
+  clutter_actor_get_preferred_size (item, NULL, NULL,
+                                    &priv->cell_width, &priv->cell_height);
+  priv->cell_width = MAX (1, priv->cell_width);
+  priv->cell_height = MAX (1, priv->cell_height);
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+  clutter_actor_get_allocation_box (actor, &box);
+  priv->columns =
+    mx_item_view_get_columns (item_view, box.x2 - box.x1 -
+                              padding.left - padding.right);
 }
 
+static const MxViewItemsFuncs mx_item_view_items_funcs =
+{
+  mx_item_view_get_lines,
+  mx_item_view_measure
+};
 
-/* model monitors */
-static void
-model_changed_cb (ClutterModel *model,
-                  MxItemView   *item_view)
+static gfloat
+mx_item_view_get_lines_height (MxItemView *item_view,
+                               gint        columns)
 {
-  GSList *p;
-  GList *l, *children;
   MxItemViewPrivate *priv = item_view->priv;
-  ClutterModelIter *iter = NULL;
-  gint model_n = 0, child_n = 0;
+  ClutterModel *model = priv->view_items->model;
+  gint n_rows, n_lines;
+  gfloat height;
 
+  n_rows = model ? clutter_model_get_n_rows (model) : 0;
+  n_lines = (n_rows + columns - 1) / columns;
 
-  /* bail out if we don't yet have an item type */
-  if (!priv->item_type && !priv->factory)
-    return;
+  height = n_lines * priv->cell_height;
+  if (n_lines > 1)
+    height += (n_lines - 1) * mx_grid_get_row_spacing (MX_GRID (item_view));
 
-  if (priv->is_frozen)
-    return;
+  return height;
+}
+
+static void
+mx_item_view_get_preferred_height (ClutterActor *actor,
+                                   gfloat        for_width,
+                                   gfloat       *min_height_p,
+                                   gfloat       *natural_height_p)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  MxPadding padding = { 0, };
+  gfloat height;
 
-  if (priv->item_type)
+  if (!item_view->priv->view_items->is_virtual)
     {
-      /* check the item-type is an descendant of ClutterActor */
-      if (!g_type_is_a (priv->item_type, CLUTTER_TYPE_ACTOR))
-        {
-          g_warning ("%s is not a subclass of ClutterActor and therefore"
-                     " cannot be used as items in an MxItemView",
-                     g_type_name (priv->item_type));
-          return;
-        }
+      CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->
+        get_preferred_height (actor, for_width, min_height_p,
+                              natural_height_p);
+      return;
     }
 
-  children = clutter_container_get_children (CLUTTER_CONTAINER (item_view));
-  child_n = g_list_length (children);
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
 
-  if (model)
-    model_n = clutter_model_get_n_rows (priv->model);
-  else
-    model_n = 0;
+  if (for_width > 0)
+    for_width = MAX (0, for_width - padding.left - padding.right);
 
-  /* add children as needed */
-  while (model_n > child_n)
-    {
-      ClutterActor *new_child;
-
-      if (priv->item_type)
-        {
-          new_child = g_object_new (priv->item_type, NULL);
-        }
-      else
-        {
-          new_child = mx_item_factory_create (priv->factory);
-        }
-
-      clutter_container_add_actor (CLUTTER_CONTAINER (item_view),
-                                   new_child);
-      child_n++;
-    }
+  /* only some rows have items, the others take up the same size */
+  height = mx_item_view_get_lines_height (item_view,
+                                          mx_item_view_get_columns (item_view,
+                                                                    for_width))
+    + padding.top + padding.bottom;
+
+  if (min_height_p)
+    *min_height_p = height;
+
+  if (natural_height_p)
+    *natural_height_p = height;
+}
 
-  /* remove children as needed */
-  l = g_list_last (children);
-  while (child_n > model_n)
+static void
+mx_item_view_allocate (ClutterActor          *actor,
+                       const ClutterActorBox *box,
+                       ClutterAllocationFlags flags)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  MxItemViewPrivate *priv = item_view->priv;
+  MxViewItems *view_items = priv->view_items;
+  GPtrArray *items = view_items->items;
+  ClutterActorClass *widget_class;
+  gfloat avail_width, avail_height, column_spacing, row_spacing;
+  MxPadding padding = { 0, };
+  guint i;
+
+  if (!view_items->is_virtual)
     {
-      clutter_container_remove_actor (CLUTTER_CONTAINER (item_view),
-                                      (ClutterActor*) l->data);
-      l = g_list_previous (l);
-      child_n--;
+      CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->allocate (actor, box,
+                                                                 flags);
+      return;
     }
 
-  g_list_free (children);
+  /* MxGrid would flow the items from the top-left corner, so skip it and
+   * place them in the cells of the rows they show */
+  widget_class = g_type_class_peek_parent (mx_item_view_parent_class);
+  widget_class->allocate (actor, box, flags);
 
-  if (!priv->model)
-    return;
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
 
-  children = clutter_container_get_children (CLUTTER_CONTAINER (item_view));
+  avail_width = box->x2 - box->x1 - padding.left - padding.right;
+  avail_height = box->y2 - box->y1 - padding.top - padding.bottom;
+  column_spacing = mx_grid_get_column_spacing (MX_GRID (actor));
+  row_spacing = mx_grid_get_row_spacing (MX_GRID (actor));
 
-  /* set the properties on the children */
-  iter = clutter_model_get_first_iter (priv->model);
-  l = children;
-  while (iter && !clutter_model_iter_is_last (iter))
+  /* the cells are big enough for the largest item that has been seen */
+  for (i = 0; i < items->len; i++)
     {
-      GObject *child;
-
-      child = G_OBJECT (l->data);
+      ClutterActor *child = g_ptr_array_index (items, i);
+      gfloat child_width, child_height;
 
-      g_object_freeze_notify (child);
-      for (p = priv->attributes; p; p = p->next)
-        {
-          GValue value = { 0, };
-          AttributeData *attr = p->data;
+      clutter_actor_get_preferred_size (child, NULL, NULL,
+                                        &child_width, &child_height);
+      priv->cell_width = MAX (priv->cell_width, child_width);
+      priv->cell_height = MAX (priv->cell_height, child_height);
+    }
 
-          clutter_model_iter_get_value (iter, attr->col, &value);
+  priv->columns = mx_item_view_get_columns (item_view, avail_width);
 
-          g_object_set_property (child, attr->name, &value);
+  for (i = 0; i < items->len; i++)
+    {
+      ClutterActor *child = g_ptr_array_index (items, i);
+      gint index_ = view_items->first_row + i;
+      ClutterActorBox child_box;
+
+      child_box.x1 = (int) (padding.left + (index_ % priv->columns) *
+                            (priv->cell_width + column_spacing));
+      child_box.y1 = (int) (padding.top + (index_ / priv->columns) *
+                            (priv->cell_height + row_spacing));
+      child_box.x2 = child_box.x1 + priv->cell_width;
+      child_box.y2 = child_box.y1 + priv->cell_height;
+
+      clutter_actor_allocate (child, &child_box, flags);
+    }
 
-          g_value_unset (&value);
-        }
-      g_object_thaw_notify (child);
+  /* the items have moved without going through MxGrid's allocate */
+  _mx_grid_invalidate_child_index (MX_GRID (item_view));
 
-      l = g_list_next (l);
-      clutter_model_iter_next (iter);
+  if (view_items->vadjustment)
+    {
+      gdouble upper;
+
+      upper = mx_item_view_get_lines_height (item_view, priv->columns) +
+        padding.top + padding.bottom;
+
+      g_object_set (G_OBJECT (view_items->vadjustment),
+                    "lower", 0.0,
+                    "upper", upper,
+                    "page-size", (gdouble) avail_height,
+                    "step-increment", (gdouble) priv->cell_height,
+                    "page-increment", (gdouble) avail_height,
+                    NULL);
     }
 
-  g_list_free (children);
-
-  if (iter)
-    g_object_unref (iter);
+  /* the viewport may have grown, or the cells changed size */
+  _mx_view_items_check_window (view_items);
 }
 
 static void
-row_changed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxItemView       *item_view)
+mx_item_view_class_init (MxItemViewClass *klass)
 {
-  model_changed_cb (model, item_view);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
+  GParamSpec *pspec;
+
+  g_type_class_add_private (klass, sizeof (MxItemViewPrivate));
+
+  object_class->get_property = mx_item_view_get_property;
+  object_class->set_property = mx_item_view_set_property;
+  object_class->dispose = mx_item_view_dispose;
+  object_class->finalize = mx_item_view_finalize;
+
+  actor_class->get_preferred_height = mx_item_view_get_preferred_height;
+  actor_class->allocate = mx_item_view_allocate;
+
+  pspec = g_param_spec_object ("model",
+                               "model",
+                               "The model for the item view",
+                               CLUTTER_TYPE_MODEL,
+                               MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MODEL, pspec);
+
+  pspec = g_param_spec_gtype ("item-type",
+                              "Item Type",
+                              "The GType to use as the items in the view. "
+                              "Must be a subclass of ClutterActor",
+                              CLUTTER_TYPE_ACTOR,
+                              MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_ITEM_TYPE, pspec);
+
+  /* Note, interfaces aren't necessarily objects, so you can't use
+   * MX_TYPE_ITEM_FACTORY here. The function mx_item_view_set_factory does
+   * a type check, so this is still safe.
+   */
+  pspec = g_param_spec_object ("factory",
+                               "Factory",
+                               "The MxItemFactory used for creating new items.",
+                               G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
+                               MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_FACTORY, pspec);
+
+  /**
+   * MxItemView:virtual:
+   *
+   * Whether items are only created for the rows in or near the visible
+   * part of the view, and reused for other rows as the view scrolls.
+   *
+   * Since: 1.6
+   */
+  pspec = g_param_spec_boolean ("virtual",
+                                "Virtual",
+                                "Only create items for the visible rows",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_VIRTUAL, pspec);
+
+  /**
+   * MxItemView:use-actor-manager:
+   *
+   * Whether new items are created and added through the #MxActorManager
+   * of the stage, spread over several frames.
+   *
+   * Since: 1.6
+   */
+  pspec = g_param_spec_boolean ("use-actor-manager",
+                                "Use Actor Manager",
+                                "Create items through the actor manager "
+                                "of the stage",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_USE_ACTOR_MANAGER,
+                                   pspec);
+
+  /**
+   * MxItemView::populated:
+   * @view: the #MxItemView that received the signal
+   *
+   * Emitted when the items created through the #MxActorManager have all
+   * been added, see mx_item_view_set_use_actor_manager().
+   *
+   * Since: 1.6
+   */
+  signals[POPULATED] =
+    g_signal_new ("populated",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (MxItemViewClass, populated),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE, 0);
 }
 
 static void
-row_removed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxItemView       *item_view)
+mx_item_view_init (MxItemView *item_view)
 {
-  GList *children;
-  GList *l;
-  ClutterActor *child;
-
-  if (item_view->priv->is_frozen)
-    return;
+  item_view->priv = ITEM_VIEW_PRIVATE (item_view);
 
-  children = clutter_container_get_children (CLUTTER_CONTAINER (item_view));
-  l = g_list_nth (children, clutter_model_iter_get_row (iter));
-  child = (ClutterActor *) l->data;
-  clutter_container_remove_actor (CLUTTER_CONTAINER (item_view), child);
-  g_list_free (children);
+  item_view->priv->view_items =
+    _mx_view_items_new (CLUTTER_ACTOR (item_view), &mx_item_view_items_funcs,
+                        MX_ITEM_VIEW_VIRTUAL_MARGIN);
+  item_view->priv->columns = 1;
 }
 
 /* public api */
@@ -357,7 +496,7 @@ mx_item_view_get_item_type (MxItemView *item_view)
 {
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), G_TYPE_INVALID);
 
-  return item_view->priv->item_type;
+  return item_view->priv->view_items->item_type;
 }
 
 
@@ -376,10 +515,7 @@ mx_item_view_set_item_type (MxItemView *item_view,
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (g_type_is_a (item_type, CLUTTER_TYPE_ACTOR));
 
-  item_view->priv->item_type = item_type;
-
-  /* update the view */
-  model_changed_cb (item_view->priv->model, item_view);
+  _mx_view_items_set_item_type (item_view->priv->view_items, item_type);
 }
 
 /**
@@ -395,7 +531,7 @@ mx_item_view_get_model (MxItemView *item_view)
 {
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), NULL);
 
-  return item_view->priv->model;
+  return item_view->priv->view_items->model;
 }
 
 /**
@@ -409,70 +545,10 @@ void
 mx_item_view_set_model (MxItemView   *item_view,
                         ClutterModel *model)
 {
-  MxItemViewPrivate *priv;
-
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (model == NULL || CLUTTER_IS_MODEL (model));
 
-  priv = item_view->priv;
-
-  if (priv->model)
-    {
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) model_changed_cb,
-                                            item_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_changed_cb,
-                                            item_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_removed_cb,
-                                            item_view);
-      g_object_unref (priv->model);
-
-      priv->model = NULL;
-    }
-
-  if (model)
-    {
-      g_return_if_fail (CLUTTER_IS_MODEL (model));
-
-      priv->model = g_object_ref (model);
-
-      priv->filter_changed = g_signal_connect (priv->model,
-                                               "filter-changed",
-                                               G_CALLBACK (model_changed_cb),
-                                               item_view);
-
-      priv->row_added = g_signal_connect (priv->model,
-                                          "row-added",
-                                          G_CALLBACK (row_changed_cb),
-                                          item_view);
-
-      priv->row_changed = g_signal_connect (priv->model,
-                                            "row-changed",
-                                            G_CALLBACK (row_changed_cb),
-                                            item_view);
-
-      /*
-       * model_changed_cb (called from row_changed_cb) expect the row to already
-       * have been removed, thus we need to use _after
-       */
-      priv->row_removed = g_signal_connect_after (priv->model,
-                                                  "row-removed",
-                                                  G_CALLBACK (row_removed_cb),
-                                                  item_view);
-
-      priv->sort_changed = g_signal_connect (priv->model,
-                                             "sort-changed",
-                                             G_CALLBACK (model_changed_cb),
-                                             item_view);
-
-      /*
-       * Only do this inside this block, setting the model to NULL should have
-       * the effect of preserving the view; just disconnect the handlers
-       */
-      model_changed_cb (priv->model, item_view);
-    }
+  _mx_view_items_set_model (item_view->priv->view_items, model);
 }
 
 /**
@@ -490,21 +566,12 @@ mx_item_view_add_attribute (MxItemView  *item_view,
                             const gchar *_attribute,
                             gint         column)
 {
-  MxItemViewPrivate *priv;
-  AttributeData *prop;
-
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (_attribute != NULL);
   g_return_if_fail (column >= 0);
 
-  priv = item_view->priv;
-
-  prop = g_new (AttributeData, 1);
-  prop->name = g_strdup (_attribute);
-  prop->col = column;
-
-  priv->attributes = g_slist_prepend (priv->attributes, prop);
-  model_changed_cb (priv->model, item_view);
+  _mx_view_items_add_attribute (item_view->priv->view_items, _attribute,
+                                column);
 }
 
 /**
@@ -519,7 +586,7 @@ mx_item_view_freeze (MxItemView *item_view)
 {
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
 
-  item_view->priv->is_frozen = TRUE;
+  _mx_view_items_freeze (item_view->priv->view_items);
 }
 
 /**
@@ -527,21 +594,16 @@ mx_item_view_freeze (MxItemView *item_view)
  * @item_view: An #MxItemView
  *
  * Thaw the view. This means that the view will now act on changes to the
- * model.
+ * model. The changes made while the view was frozen are applied at once:
+ * items are kept for the rows that are still in the model and only the
+ * new rows need new items.
  */
 void
 mx_item_view_thaw (MxItemView *item_view)
 {
-  MxItemViewPrivate *priv;
-
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
 
-  priv = item_view->priv;
-
-  priv->is_frozen = FALSE;
-
-  /* Repopulate */
-  model_changed_cb (priv->model, item_view);
+  _mx_view_items_thaw (item_view->priv->view_items);
 }
 
 /**
@@ -555,24 +617,17 @@ void
 mx_item_view_set_factory (MxItemView    *item_view,
                           MxItemFactory *factory)
 {
-  MxItemViewPrivate *priv;
+  MxViewItems *view_items;
 
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (!factory || MX_IS_ITEM_FACTORY (factory));
 
-  priv = item_view->priv;
+  view_items = item_view->priv->view_items;
 
-  if (priv->factory == factory)
+  if (view_items->factory == factory)
     return;
 
-  if (priv->factory)
-    {
-      g_object_unref (priv->factory);
-      priv->factory = NULL;
-    }
-
-  if (factory)
-    priv->factory = g_object_ref (factory);
+  _mx_view_items_set_factory (view_items, factory);
 
   g_object_notify (G_OBJECT (item_view), "factory");
 }
@@ -589,5 +644,113 @@ MxItemFactory *
 mx_item_view_get_factory (MxItemView *item_view)
 {
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), NULL);
-  return item_view->priv->factory;
+  return item_view->priv->view_items->factory;
+}
+
+/**
+ * mx_item_view_set_virtual:
+ * @item_view: A #MxItemView
+ * @is_virtual: %TRUE to only create items for the visible rows
+ *
+ * Sets whether @item_view only creates items for the rows in or near the
+ * visible part of the view. Items that scroll out of view are reused for
+ * the rows that scroll into it, so large models don't need an item per
+ * row. The items are laid out in lines of equally sized cells, big enough
+ * for the largest item seen so far.
+ *
+ * Since: 1.6
+ */
+void
+mx_item_view_set_virtual (MxItemView *item_view,
+                          gboolean    is_virtual)
+{
+  MxItemViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  priv = item_view->priv;
+
+  if (priv->view_items->is_virtual == is_virtual)
+    return;
+
+  /* the cells are measured again in the new mode */
+  priv->cell_width = 0;
+  priv->cell_height = 0;
+  priv->columns = 1;
+
+  _mx_view_items_set_virtual (priv->view_items, is_virtual);
+
+  g_object_notify (G_OBJECT (item_view), "virtual");
+}
+
+/**
+ * mx_item_view_get_virtual:
+ * @item_view: A #MxItemView
+ *
+ * Gets whether @item_view only creates items for the visible rows. See
+ * mx_item_view_set_virtual().
+ *
+ * Returns: %TRUE if only the visible rows have items
+ *
+ * Since: 1.6
+ */
+gboolean
+mx_item_view_get_virtual (MxItemView *item_view)
+{
+  g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), FALSE);
+
+  return item_view->priv->view_items->is_virtual;
+}
+
+/**
+ * mx_item_view_set_use_actor_manager:
+ * @item_view: A #MxItemView
+ * @use_actor_manager: %TRUE to create items through the actor manager
+ *
+ * Sets whether @item_view creates the items for new rows through the
+ * #MxActorManager of its stage, rather than all at once. The items are
+ * then created and added a few at a time, within the time slice of the
+ * manager, and the view fills up over several frames. The
+ * #MxItemView::populated signal is emitted once every row has an item.
+ *
+ * Virtual views only create the items that are visible and ignore this
+ * setting.
+ *
+ * Since: 1.6
+ */
+void
+mx_item_view_set_use_actor_manager (MxItemView *item_view,
+                                    gboolean    use_actor_manager)
+{
+  MxViewItems *view_items;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  view_items = item_view->priv->view_items;
+
+  if (view_items->use_actor_manager == use_actor_manager)
+    return;
+
+  _mx_view_items_set_use_actor_manager (view_items, use_actor_manager);
+
+  g_object_notify (G_OBJECT (item_view), "use-actor-manager");
+}
+
+/**
+ * mx_item_view_get_use_actor_manager:
+ * @item_view: A #MxItemView
+ *
+ * Gets whether @item_view creates its items through the #MxActorManager
+ * of its stage. See mx_item_view_set_use_actor_manager().
+ *
+ * Returns: %TRUE if items are created through the actor manager
+ *
+ * Since: 1.6
+ */
+gboolean
+mx_item_view_get_use_actor_manager (MxItemView *item_view)
+{
+  g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), FALSE);
+
+  return item_view->priv->view_items->use_actor_manager;
 }
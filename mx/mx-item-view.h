@@ -76,12 +76,14 @@ typedef struct {
 typedef struct {
   MxGridClass parent_class;
 
+  /* signals */
+  void (*populated) (MxItemView *view);
+
   /* padding for future expansion */
   void (*_padding_0) (void);
   void (*_padding_1) (void);
   void (*_padding_2) (void);
   void (*_padding_3) (void);
-  void (*_padding_4) (void);
 } MxItemViewClass;
 
 GType mx_item_view_get_type (void);
@@ -106,6 +108,14 @@ void          mx_item_view_set_factory   (MxItemView    *item_view,
                                           MxItemFactory *factory);
 MxItemFactory* mx_item_view_get_factory  (MxItemView    *item_view);
 
+void          mx_item_view_set_virtual   (MxItemView    *item_view,
+                                          gboolean       is_virtual);
+gboolean      mx_item_view_get_virtual   (MxItemView    *item_view);
+
+void          mx_item_view_set_use_actor_manager (MxItemView *item_view,
+                                                  gboolean    use_actor_manager);
+gboolean      mx_item_view_get_use_actor_manager (MxItemView *item_view);
+
 G_END_DECLS
 
 #endif /* _MX_ITEM_VIEW_H */
@@ -32,23 +32,26 @@
  *
  * Data is set on the children by mapping columns in the model to object
  * properties on the children.
+ *
+ * For large models, #MxListView:virtual can be set so that children are only
+ * created for the rows that fit in the view, plus a few either side. As the
+ * view scrolls, children that move out of view are reused for the rows that
+ * come into it. A virtual list view should be placed in a #MxScrollView.
  */
 
 #include "mx-list-view.h"
 #include "mx-box-layout.h"
 #include "mx-private.h"
-#include "mx-item-factory.h"
+#include "mx-view-items.h"
 
 G_DEFINE_TYPE (MxListView, mx_list_view, MX_TYPE_BOX_LAYOUT)
 
 #define LIST_VIEW_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), MX_TYPE_LIST_VIEW, MxListViewPrivate))
 
-typedef struct
-{
-  gchar *name;
-  gint   col;
-} AttributeData;
+/* Rows kept either side of the viewport in virtual mode, so that slow
+ * scrolling doesn't have to rebind items on every step */
+#define MX_LIST_VIEW_VIRTUAL_MARGIN 4
 
 enum
 {
@@ -56,24 +59,27 @@ enum
 
   PROP_MODEL,
   PROP_ITEM_TYPE,
-  PROP_FACTORY
+  PROP_FACTORY,
+  PROP_VIRTUAL,
+  PROP_USE_ACTOR_MANAGER
 };
 
-struct _MxListViewPrivate
+enum
 {
-  ClutterModel  *model;
-  GSList        *attributes;
-  GType          item_type;
+  POPULATED,
 
-  MxItemFactory *factory;
+  LAST_SIGNAL
+};
 
-  gulong         filter_changed;
-  gulong         row_added;
-  gulong         row_changed;
-  gulong         row_removed;
-  gulong         sort_changed;
+static guint signals[LAST_SIGNAL] = { 0, };
 
-  guint          is_frozen : 1;
+struct _MxListViewPrivate
+{
+  /* the model, and the items showing its rows */
+  MxViewItems *view_items;
+
+  /* the estimated height of a row in virtual mode */
+  gfloat       row_height;
 };
 
 /* gobject implementations */
@@ -84,17 +90,23 @@ mx_list_view_get_property (GObject    *object,
                            GValue     *value,
                            GParamSpec *pspec)
 {
-  MxListViewPrivate *priv = MX_LIST_VIEW (object)->priv;
+  MxViewItems *view_items = MX_LIST_VIEW (object)->priv->view_items;
   switch (property_id)
     {
     case PROP_MODEL:
-      g_value_set_object (value, priv->model);
+      g_value_set_object (value, view_items->model);
       break;
     case PROP_ITEM_TYPE:
-      g_value_set_gtype (value, priv->item_type);
+      g_value_set_gtype (value, view_items->item_type);
       break;
     case PROP_FACTORY:
-      g_value_set_object (value, priv->factory);
+      g_value_set_object (value, view_items->factory);
+      break;
+    case PROP_VIRTUAL:
+      g_value_set_boolean (value, view_items->is_virtual);
+      break;
+    case PROP_USE_ACTOR_MANAGER:
+      g_value_set_boolean (value, view_items->use_actor_manager);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -121,6 +133,14 @@ mx_list_view_set_property (GObject      *object,
       mx_list_view_set_factory ((MxListView*) object,
                                 (MxItemFactory*) g_value_get_object (value));
       break;
+    case PROP_VIRTUAL:
+      mx_list_view_set_virtual ((MxListView*) object,
+                                g_value_get_boolean (value));
+      break;
+    case PROP_USE_ACTOR_MANAGER:
+      mx_list_view_set_use_actor_manager ((MxListView*) object,
+                                          g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -129,46 +149,191 @@ mx_list_view_set_property (GObject      *object,
 static void
 mx_list_view_dispose (GObject *object)
 {
-  MxListViewPrivate *priv = MX_LIST_VIEW (object)->priv;
+  _mx_view_items_dispose (MX_LIST_VIEW (object)->priv->view_items);
 
-  /* This will cause the unref of the model and also disconnect the signals */
-  mx_list_view_set_model (MX_LIST_VIEW (object), NULL);
+  G_OBJECT_CLASS (mx_list_view_parent_class)->dispose (object);
+}
 
-  if (priv->factory)
-    {
-      g_object_unref (priv->factory);
-      priv->factory = NULL;
-    }
+static void
+mx_list_view_finalize (GObject *object)
+{
+  _mx_view_items_free (MX_LIST_VIEW (object)->priv->view_items);
 
-  G_OBJECT_CLASS (mx_list_view_parent_class)->dispose (object);
+  G_OBJECT_CLASS (mx_list_view_parent_class)->finalize (object);
 }
 
+/* virtual mode */
+
 static void
-free_attribute (AttributeData *data)
+mx_list_view_get_lines (ClutterActor *actor,
+                        gfloat       *line_height,
+                        gfloat       *spacing,
+                        gint         *columns)
 {
-  g_free (data->name);
-  g_free (data);
+  *line_height = MX_LIST_VIEW (actor)->priv->row_height;
+  *spacing = mx_box_layout_get_spacing (MX_BOX_LAYOUT (actor));
+  *columns = 1;
 }
 
 static void
-mx_list_view_finalize (GObject *object)
+mx_list_view_measure (ClutterActor *actor,
+                      ClutterActor *item)
+{
+  MxListViewPrivate *priv = MX_LIST_VIEW (actor)->priv;
+  ClutterActorBox box = { 0, };
+  MxPadding padding = { 0, };
+  gfloat for_width;
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+  clutter_actor_get_allocation_box (actor, &box);
+  for_width = box.x2 - box.x1 - padding.left - padding.right;
+
+  clutter_actor_get_preferred_height (item, for_width > 0 ? for_width : -1,
+                                      NULL, &priv->row_height);
+  priv->row_height = MAX (1, priv->row_height);
+}
+
+static const MxViewItemsFuncs mx_list_view_items_funcs =
 {
-  MxListViewPrivate *priv = MX_LIST_VIEW (object)->priv;
+  mx_list_view_get_lines,
+  mx_list_view_measure
+};
 
-  if (priv->attributes)
+static void
+mx_list_view_get_preferred_height (ClutterActor *actor,
+                                   gfloat        for_width,
+                                   gfloat       *min_height_p,
+                                   gfloat       *natural_height_p)
+{
+  MxListViewPrivate *priv = MX_LIST_VIEW (actor)->priv;
+  MxViewItems *view_items = priv->view_items;
+  MxPadding padding = { 0, };
+  gfloat height;
+  gint n_rows;
+
+  if (!view_items->is_virtual)
     {
-      g_slist_foreach (priv->attributes, (GFunc) free_attribute, NULL);
-      g_slist_free (priv->attributes);
-      priv->attributes = NULL;
+      CLUTTER_ACTOR_CLASS (mx_list_view_parent_class)->
+        get_preferred_height (actor, for_width, min_height_p,
+                              natural_height_p);
+      return;
     }
 
-  G_OBJECT_CLASS (mx_list_view_parent_class)->finalize (object);
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  /* only some rows have items, so estimate the height of the others */
+  n_rows = view_items->model ?
+    clutter_model_get_n_rows (view_items->model) : 0;
+  height = n_rows * priv->row_height + padding.top + padding.bottom;
+  if (n_rows > 1)
+    height += (n_rows - 1) *
+      mx_box_layout_get_spacing (MX_BOX_LAYOUT (actor));
+
+  if (min_height_p)
+    *min_height_p = height;
+
+  if (natural_height_p)
+    *natural_height_p = height;
+}
+
+static void
+mx_list_view_allocate (ClutterActor          *actor,
+                       const ClutterActorBox *box,
+                       ClutterAllocationFlags flags)
+{
+  MxListViewPrivate *priv = MX_LIST_VIEW (actor)->priv;
+  MxViewItems *view_items = priv->view_items;
+  GPtrArray *items = view_items->items;
+  ClutterActorClass *widget_class;
+  gfloat avail_width, avail_height, spacing, position, total;
+  MxPadding padding = { 0, };
+  gint n_rows;
+  guint i;
+
+  if (!view_items->is_virtual)
+    {
+      CLUTTER_ACTOR_CLASS (mx_list_view_parent_class)->allocate (actor, box,
+                                                                 flags);
+      return;
+    }
+
+  /* MxBoxLayout would place the items one after the other from the top,
+   * so skip it and place them at the rows they show */
+  widget_class = g_type_class_peek_parent (mx_list_view_parent_class);
+  widget_class->allocate (actor, box, flags);
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  avail_width = box->x2 - box->x1 - padding.left - padding.right;
+  avail_height = box->y2 - box->y1 - padding.top - padding.bottom;
+  spacing = mx_box_layout_get_spacing (MX_BOX_LAYOUT (actor));
+  n_rows = view_items->model ?
+    clutter_model_get_n_rows (view_items->model) : 0;
+
+  /* the rows that have items give the estimate for the rows that don't */
+  total = 0;
+  for (i = 0; i < items->len; i++)
+    {
+      gfloat child_nat;
+
+      clutter_actor_get_preferred_height (g_ptr_array_index (items, i),
+                                          avail_width, NULL, &child_nat);
+      total += child_nat;
+    }
+
+  if (items->len)
+    priv->row_height = MAX (1, total / items->len);
+
+  position = padding.top +
+    view_items->first_row * (priv->row_height + spacing);
+  for (i = 0; i < items->len; i++)
+    {
+      ClutterActor *child = g_ptr_array_index (items, i);
+      ClutterActorBox child_box;
+      gfloat child_nat;
+
+      clutter_actor_get_preferred_height (child, avail_width,
+                                          NULL, &child_nat);
+
+      child_box.x1 = padding.left;
+      child_box.x2 = padding.left + avail_width;
+      child_box.y1 = (int) position;
+      child_box.y2 = (int) (position + child_nat);
+
+      clutter_actor_allocate (child, &child_box, flags);
+
+      position += child_nat + spacing;
+    }
+
+  if (view_items->vadjustment)
+    {
+      gdouble step_inc, page_inc, upper;
+
+      upper = n_rows * priv->row_height + padding.top + padding.bottom;
+      if (n_rows > 1)
+        upper += (n_rows - 1) * spacing;
+
+      step_inc = priv->row_height;
+      page_inc = ((gint)(avail_height / step_inc)) * step_inc;
+
+      g_object_set (G_OBJECT (view_items->vadjustment),
+                    "lower", 0.0,
+                    "upper", upper,
+                    "page-size", (gdouble) avail_height,
+                    "step-increment", step_inc,
+                    "page-increment", page_inc,
+                    NULL);
+    }
+
+  /* the viewport may have grown, or the estimate changed */
+  _mx_view_items_check_window (view_items);
 }
 
 static void
 mx_list_view_class_init (MxListViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxListViewPrivate));
@@ -178,6 +343,9 @@ mx_list_view_class_init (MxListViewClass *klass)
   object_class->dispose = mx_list_view_dispose;
   object_class->finalize = mx_list_view_finalize;
 
+  actor_class->get_preferred_height = mx_list_view_get_preferred_height;
+  actor_class->allocate = mx_list_view_allocate;
+
   pspec = g_param_spec_object ("model",
                                "model",
                                "The model for the item view",
@@ -203,6 +371,56 @@ mx_list_view_class_init (MxListViewClass *klass)
                                G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
                                MX_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_FACTORY, pspec);
+
+  /**
+   * MxListView:virtual:
+   *
+   * Whether items are only created for the rows in or near the visible
+   * part of the view, and reused for other rows as the view scrolls.
+   *
+   * Since: 1.6
+   */
+  pspec = g_param_spec_boolean ("virtual",
+                                "Virtual",
+                                "Only create items for the visible rows",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_VIRTUAL, pspec);
+
+  /**
+   * MxListView:use-actor-manager:
+   *
+   * Whether new items are created and added through the #MxActorManager
+   * of the stage, spread over several frames.
+   *
+   * Since: 1.6
+   */
+  pspec = g_param_spec_boolean ("use-actor-manager",
+                                "Use Actor Manager",
+                                "Create items through the actor manager "
+                                "of the stage",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_USE_ACTOR_MANAGER,
+                                   pspec);
+
+  /**
+   * MxListView::populated:
+   * @view: the #MxListView that received the signal
+   *
+   * Emitted when the items created through the #MxActorManager have all
+   * been added, see mx_list_view_set_use_actor_manager().
+   *
+   * Since: 1.6
+   */
+  signals[POPULATED] =
+    g_signal_new ("populated",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (MxListViewClass, populated),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE, 0);
 }
 
 static void
@@ -210,143 +428,11 @@ mx_list_view_init (MxListView *list_view)
 {
   list_view->priv = LIST_VIEW_PRIVATE (list_view);
 
-  mx_box_layout_set_orientation (MX_BOX_LAYOUT (list_view), MX_ORIENTATION_VERTICAL);
-}
-
-
-/* model monitors */
-static void
-model_changed_cb (ClutterModel *model,
-                  MxListView   *list_view)
-{
-  GSList *p;
-  GList *l, *children;
-  MxListViewPrivate *priv = list_view->priv;
-  ClutterModelIter *iter = NULL;
-  gint model_n = 0, child_n = 0;
-
-
-  /* bail out if we don't yet have an item type or a factory */
-  if (!priv->item_type && !priv->factory)
-    return;
-
-  if (priv->is_frozen)
-    return;
-
-  if (priv->item_type)
-    {
-      /* check the item-type is an descendant of ClutterActor */
-      if (!g_type_is_a (priv->item_type, CLUTTER_TYPE_ACTOR))
-        {
-          g_warning ("%s is not a subclass of ClutterActor and therefore"
-                     " cannot be used as items in an MxListView",
-                     g_type_name (priv->item_type));
-          return;
-        }
-    }
-
-  children = clutter_container_get_children (CLUTTER_CONTAINER (list_view));
-  child_n = g_list_length (children);
-
-  if (model)
-    model_n = clutter_model_get_n_rows (priv->model);
-  else
-    model_n = 0;
-
-  /* add children as needed */
-  while (model_n > child_n)
-    {
-      ClutterActor *new_child;
-
-      if (priv->item_type)
-        {
-          new_child = g_object_new (priv->item_type, NULL);
-        }
-      else
-        {
-          new_child = mx_item_factory_create (priv->factory);
-        }
-
-      clutter_container_add_actor (CLUTTER_CONTAINER (list_view),
-                                   new_child);
-      child_n++;
-    }
-
-  /* remove children as needed */
-  l = g_list_last (children);
-  while (child_n > model_n)
-    {
-      clutter_container_remove_actor (CLUTTER_CONTAINER (list_view),
-                                      (ClutterActor*) l->data);
-      l = g_list_previous (l);
-      child_n--;
-    }
-
-  g_list_free (children);
-
-  if (!priv->model)
-    return;
-
-  children = clutter_container_get_children (CLUTTER_CONTAINER (list_view));
-
-  /* set the properties on the children */
-  iter = clutter_model_get_first_iter (priv->model);
-  l = children;
-  while (iter && !clutter_model_iter_is_last (iter))
-    {
-      GObject *child;
-
-      child = G_OBJECT (l->data);
-
-      g_object_freeze_notify (child);
-      for (p = priv->attributes; p; p = p->next)
-        {
-          GValue value = { 0, };
-          AttributeData *attr = p->data;
-
-          clutter_model_iter_get_value (iter, attr->col, &value);
-
-          g_object_set_property (child, attr->name, &value);
-
-          g_value_unset (&value);
-        }
-      g_object_thaw_notify (child);
-
-      l = g_list_next (l);
-      clutter_model_iter_next (iter);
-    }
+  list_view->priv->view_items =
+    _mx_view_items_new (CLUTTER_ACTOR (list_view), &mx_list_view_items_funcs,
+                        MX_LIST_VIEW_VIRTUAL_MARGIN);
 
-  g_list_free (children);
-
-  if (iter)
-    g_object_unref (iter);
-}
-
-static void
-row_changed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxListView       *list_view)
-{
-  model_changed_cb (model, list_view);
-}
-
-static void
-row_removed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxListView       *list_view)
-{
-  GList *children;
-  GList *l;
-  ClutterActor *child;
-
-  if (list_view->priv->is_frozen)
-    return;
-
-  children = clutter_container_get_children (CLUTTER_CONTAINER (list_view));
-  l = g_list_nth (children, clutter_model_iter_get_row (iter));
-  child = (ClutterActor *) l->data;
-  clutter_container_remove_actor (CLUTTER_CONTAINER (list_view), child);
-  g_list_free (children);
+  mx_box_layout_set_orientation (MX_BOX_LAYOUT (list_view), MX_ORIENTATION_VERTICAL);
 }
 
 /* public api */
@@ -377,7 +463,7 @@ mx_list_view_get_item_type (MxListView *list_view)
 {
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), G_TYPE_INVALID);
 
-  return list_view->priv->item_type;
+  return list_view->priv->view_items->item_type;
 }
 
 
@@ -396,10 +482,7 @@ mx_list_view_set_item_type (MxListView *list_view,
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (g_type_is_a (item_type, CLUTTER_TYPE_ACTOR));
 
-  list_view->priv->item_type = item_type;
-
-  /* update the view */
-  model_changed_cb (list_view->priv->model, list_view);
+  _mx_view_items_set_item_type (list_view->priv->view_items, item_type);
 }
 
 /**
@@ -415,7 +498,7 @@ mx_list_view_get_model (MxListView *list_view)
 {
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), NULL);
 
-  return list_view->priv->model;
+  return list_view->priv->view_items->model;
 }
 
 /**
@@ -429,70 +512,10 @@ void
 mx_list_view_set_model (MxListView   *list_view,
                         ClutterModel *model)
 {
-  MxListViewPrivate *priv;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (model == NULL || CLUTTER_IS_MODEL (model));
 
-  priv = list_view->priv;
-
-  if (priv->model)
-    {
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) model_changed_cb,
-                                            list_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_changed_cb,
-                                            list_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_removed_cb,
-                                            list_view);
-      g_object_unref (priv->model);
-
-      priv->model = NULL;
-    }
-
-  if (model)
-    {
-      g_return_if_fail (CLUTTER_IS_MODEL (model));
-
-      priv->model = g_object_ref (model);
-
-      priv->filter_changed = g_signal_connect (priv->model,
-                                               "filter-changed",
-                                               G_CALLBACK (model_changed_cb),
-                                               list_view);
-
-      priv->row_added = g_signal_connect (priv->model,
-                                          "row-added",
-                                          G_CALLBACK (row_changed_cb),
-                                          list_view);
-
-      priv->row_changed = g_signal_connect (priv->model,
-                                            "row-changed",
-                                            G_CALLBACK (row_changed_cb),
-                                            list_view);
-
-      /*
-       * model_changed_cb (called from row_changed_cb) expect the row to already
-       * have been removed, thus we need to use _after
-       */
-      priv->row_removed = g_signal_connect_after (priv->model,
-                                                  "row-removed",
-                                                  G_CALLBACK (row_removed_cb),
-                                                  list_view);
-
-      priv->sort_changed = g_signal_connect (priv->model,
-                                             "sort-changed",
-                                             G_CALLBACK (model_changed_cb),
-                                             list_view);
-
-      /*
-       * Only do this inside this block, setting the model to NULL should have
-       * the effect of preserving the view; just disconnect the handlers
-       */
-      model_changed_cb (priv->model, list_view);
-    }
+  _mx_view_items_set_model (list_view->priv->view_items, model);
 }
 
 /**
@@ -510,21 +533,12 @@ mx_list_view_add_attribute (MxListView  *list_view,
                             const gchar *_attribute,
                             gint         column)
 {
-  MxListViewPrivate *priv;
-  AttributeData *prop;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (_attribute != NULL);
   g_return_if_fail (column >= 0);
 
-  priv = list_view->priv;
-
-  prop = g_new (AttributeData, 1);
-  prop->name = g_strdup (_attribute);
-  prop->col = column;
-
-  priv->attributes = g_slist_prepend (priv->attributes, prop);
-  model_changed_cb (priv->model, list_view);
+  _mx_view_items_add_attribute (list_view->priv->view_items, _attribute,
+                                column);
 }
 
 /**
@@ -537,13 +551,9 @@ mx_list_view_add_attribute (MxListView  *list_view,
 void
 mx_list_view_freeze (MxListView *list_view)
 {
-  MxListViewPrivate *priv;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
 
-  priv = list_view->priv;
-
-  priv->is_frozen = TRUE;
+  _mx_view_items_freeze (list_view->priv->view_items);
 }
 
 /**
@@ -551,21 +561,16 @@ mx_list_view_freeze (MxListView *list_view)
  * @list_view: An #MxListView
  *
  * Thaw the view. This means that the view will now act on changes to the
- * model.
+ * model. The changes made while the view was frozen are applied at once:
+ * items are kept for the rows that are still in the model and only the
+ * new rows need new items.
  */
 void
 mx_list_view_thaw (MxListView *list_view)
 {
-  MxListViewPrivate *priv;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
 
-  priv = list_view->priv;
-
-  priv->is_frozen = FALSE;
-
-  /* Repopulate */
-  model_changed_cb (priv->model, list_view);
+  _mx_view_items_thaw (list_view->priv->view_items);
 }
 
 /**
@@ -579,24 +584,17 @@ void
 mx_list_view_set_factory (MxListView    *list_view,
                           MxItemFactory *factory)
 {
-  MxListViewPrivate *priv;
+  MxViewItems *view_items;
 
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (!factory || MX_IS_ITEM_FACTORY (factory));
 
-  priv = list_view->priv;
+  view_items = list_view->priv->view_items;
 
-  if (priv->factory == factory)
+  if (view_items->factory == factory)
     return;
 
-  if (priv->factory)
-    {
-      g_object_unref (priv->factory);
-      priv->factory = NULL;
-    }
-
-  if (factory)
-    priv->factory = g_object_ref (factory);
+  _mx_view_items_set_factory (view_items, factory);
 
   g_object_notify (G_OBJECT (list_view), "factory");
 }
@@ -613,5 +611,111 @@ MxItemFactory *
 mx_list_view_get_factory (MxListView *list_view)
 {
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), NULL);
-  return list_view->priv->factory;
+  return list_view->priv->view_items->factory;
+}
+
+/**
+ * mx_list_view_set_virtual:
+ * @list_view: A #MxListView
+ * @is_virtual: %TRUE to only create items for the visible rows
+ *
+ * Sets whether @list_view only creates items for the rows in or near the
+ * visible part of the view. Items that scroll out of view are reused for
+ * the rows that scroll into it, so large models don't need an item per
+ * row. Rows are assumed to be about the same height; the height of the
+ * rows that have items is used to estimate the height of those that don't.
+ *
+ * Since: 1.6
+ */
+void
+mx_list_view_set_virtual (MxListView *list_view,
+                          gboolean    is_virtual)
+{
+  MxListViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+
+  priv = list_view->priv;
+
+  if (priv->view_items->is_virtual == is_virtual)
+    return;
+
+  /* the rows are measured again in the new mode */
+  priv->row_height = 0;
+
+  _mx_view_items_set_virtual (priv->view_items, is_virtual);
+
+  g_object_notify (G_OBJECT (list_view), "virtual");
+}
+
+/**
+ * mx_list_view_get_virtual:
+ * @list_view: A #MxListView
+ *
+ * Gets whether @list_view only creates items for the visible rows. See
+ * mx_list_view_set_virtual().
+ *
+ * Returns: %TRUE if only the visible rows have items
+ *
+ * Since: 1.6
+ */
+gboolean
+mx_list_view_get_virtual (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), FALSE);
+
+  return list_view->priv->view_items->is_virtual;
+}
+
+/**
+ * mx_list_view_set_use_actor_manager:
+ * @list_view: A #MxListView
+ * @use_actor_manager: %TRUE to create items through the actor manager
+ *
+ * Sets whether @list_view creates the items for new rows through the
+ * #MxActorManager of its stage, rather than all at once. The items are
+ * then created and added a few at a time, within the time slice of the
+ * manager, and the view fills up over several frames. The
+ * #MxListView::populated signal is emitted once every row has an item.
+ *
+ * Virtual views only create the items that are visible and ignore this
+ * setting.
+ *
+ * Since: 1.6
+ */
+void
+mx_list_view_set_use_actor_manager (MxListView *list_view,
+                                    gboolean    use_actor_manager)
+{
+  MxViewItems *view_items;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+
+  view_items = list_view->priv->view_items;
+
+  if (view_items->use_actor_manager == use_actor_manager)
+    return;
+
+  _mx_view_items_set_use_actor_manager (view_items, use_actor_manager);
+
+  g_object_notify (G_OBJECT (list_view), "use-actor-manager");
+}
+
+/**
+ * mx_list_view_get_use_actor_manager:
+ * @list_view: A #MxListView
+ *
+ * Gets whether @list_view creates its items through the #MxActorManager
+ * of its stage. See mx_list_view_set_use_actor_manager().
+ *
+ * Returns: %TRUE if items are created through the actor manager
+ *
+ * Since: 1.6
+ */
+gboolean
+mx_list_view_get_use_actor_manager (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), FALSE);
+
+  return list_view->priv->view_items->use_actor_manager;
 }
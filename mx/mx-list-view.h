@@ -75,12 +75,14 @@ typedef struct {
 typedef struct {
   MxBoxLayoutClass parent_class;
 
+  /* signals */
+  void (*populated) (MxListView *view);
+
   /* padding for future expansion */
   void (*_padding_0) (void);
   void (*_padding_1) (void);
   void (*_padding_2) (void);
   void (*_padding_3) (void);
-  void (*_padding_4) (void);
 } MxListViewClass;
 
 GType mx_list_view_get_type (void);
@@ -105,6 +107,14 @@ void          mx_list_view_set_factory   (MxListView    *list_view,
                                           MxItemFactory *factory);
 MxItemFactory *mx_list_view_get_factory  (MxListView    *list_view);
 
+void          mx_list_view_set_virtual   (MxListView    *list_view,
+                                          gboolean       is_virtual);
+gboolean      mx_list_view_get_virtual   (MxListView    *list_view);
+
+void          mx_list_view_set_use_actor_manager (MxListView *list_view,
+                                                  gboolean    use_actor_manager);
+gboolean      mx_list_view_get_use_actor_manager (MxListView *list_view);
+
 G_END_DECLS
 
 #endif /* _MX_LIST_VIEW_H */
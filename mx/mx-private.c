@@ -28,7 +28,8 @@ static GDebugKey debug_keys[] =
     {"layout", MX_DEBUG_LAYOUT},
     {"inspector", MX_DEBUG_INSPECTOR},
     {"focus", MX_DEBUG_FOCUS},
-    {"css", MX_DEBUG_CSS}
+    {"css", MX_DEBUG_CSS},
+    {"texture-cache", MX_DEBUG_TEXTURE_CACHE}
 };
 
 
@@ -92,3 +93,184 @@ _mx_string_to_enum (GType        type,
 
   return ret;
 }
+
+/* An index of the allocation boxes of the children of a container, sorted
+ * along one axis, so that only the children inside a box have to be looked
+ * at to paint it. The index is only valid until the children are added,
+ * removed, restacked or allocated again. */
+
+typedef struct
+{
+  ClutterActor    *actor;
+  ClutterActorBox  box;
+  gint             order;
+} MxChildIndexEntry;
+
+struct _MxChildIndex
+{
+  MxOrientation  orientation;
+
+  /* sorted by the start of the boxes along the axis */
+  GArray        *entries;
+  gfloat         max_extent;
+
+  /* the entries found by the last _mx_child_index_paint() */
+  GArray        *found;
+};
+
+#define ENTRY_START(idx, entry) \
+  (((idx)->orientation == MX_ORIENTATION_VERTICAL) ? \
+   (entry)->box.y1 : (entry)->box.x1)
+
+static gint
+_mx_child_index_compare_start (gconstpointer a,
+                               gconstpointer b,
+                               gpointer      user_data)
+{
+  const MxChildIndexEntry *entry_a = a, *entry_b = b;
+  MxChildIndex *child_index = user_data;
+  gfloat start_a = ENTRY_START (child_index, entry_a);
+  gfloat start_b = ENTRY_START (child_index, entry_b);
+
+  if (start_a < start_b)
+    return -1;
+  if (start_a > start_b)
+    return 1;
+
+  return entry_a->order - entry_b->order;
+}
+
+static gint
+_mx_child_index_compare_order (gconstpointer a,
+                               gconstpointer b)
+{
+  const MxChildIndexEntry *entry_a = a, *entry_b = b;
+
+  return entry_a->order - entry_b->order;
+}
+
+/*
+ * _mx_child_index_new:
+ * @children: the children, in paint order
+ * @orientation: the axis to sort the children along
+ *
+ * Indexes the current allocation of @children. The axis should be the one
+ * the container scrolls along.
+ */
+MxChildIndex *
+_mx_child_index_new (GList         *children,
+                     MxOrientation  orientation)
+{
+  MxChildIndex *child_index;
+  MxChildIndexEntry entry;
+  GList *l;
+
+  child_index = g_slice_new (MxChildIndex);
+  child_index->orientation = orientation;
+  child_index->entries = g_array_new (FALSE, FALSE,
+                                      sizeof (MxChildIndexEntry));
+  child_index->found = g_array_new (FALSE, FALSE,
+                                    sizeof (MxChildIndexEntry));
+  child_index->max_extent = 0;
+
+  for (l = children, entry.order = 0; l; l = l->next, entry.order++)
+    {
+      gfloat extent;
+
+      entry.actor = l->data;
+      clutter_actor_get_allocation_box (entry.actor, &entry.box);
+
+      if (orientation == MX_ORIENTATION_VERTICAL)
+        extent = entry.box.y2 - entry.box.y1;
+      else
+        extent = entry.box.x2 - entry.box.x1;
+
+      child_index->max_extent = MAX (child_index->max_extent, extent);
+
+      g_array_append_val (child_index->entries, entry);
+    }
+
+  g_array_sort_with_data (child_index->entries,
+                          _mx_child_index_compare_start,
+                          child_index);
+
+  return child_index;
+}
+
+void
+_mx_child_index_free (MxChildIndex *child_index)
+{
+  g_array_free (child_index->entries, TRUE);
+  g_array_free (child_index->found, TRUE);
+  g_slice_free (MxChildIndex, child_index);
+}
+
+/*
+ * _mx_child_index_paint:
+ * @child_index: an #MxChildIndex
+ * @box: the area to paint, in the coordinates of the container
+ *
+ * Paints the visible children that overlap @box, in paint order. The
+ * children are found with a binary search for the first box that can
+ * reach @box, so painting costs O(log n) plus the number of children
+ * around @box.
+ */
+void
+_mx_child_index_paint (MxChildIndex          *child_index,
+                       const ClutterActorBox *box)
+{
+  MxChildIndexEntry *entries;
+  gfloat start, end;
+  guint low, high, i;
+
+  entries = (MxChildIndexEntry *) child_index->entries->data;
+
+  if (child_index->orientation == MX_ORIENTATION_VERTICAL)
+    {
+      start = box->y1;
+      end = box->y2;
+    }
+  else
+    {
+      start = box->x1;
+      end = box->x2;
+    }
+
+  /* no box starting at or before this can reach the area */
+  start -= child_index->max_extent;
+
+  low = 0;
+  high = child_index->entries->len;
+  while (low < high)
+    {
+      guint mid = (low + high) / 2;
+
+      if (ENTRY_START (child_index, &entries[mid]) <= start)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  g_array_set_size (child_index->found, 0);
+  for (i = low;
+       i < child_index->entries->len &&
+       ENTRY_START (child_index, &entries[i]) < end;
+       i++)
+    {
+      MxChildIndexEntry *entry = &entries[i];
+
+      if ((entry->box.x1 < box->x2) &&
+          (entry->box.x2 > box->x1) &&
+          (entry->box.y1 < box->y2) &&
+          (entry->box.y2 > box->y1) &&
+          CLUTTER_ACTOR_IS_VISIBLE (entry->actor))
+        g_array_append_val (child_index->found, *entry);
+    }
+
+  /* back to the stacking order of the container */
+  g_array_sort (child_index->found, _mx_child_index_compare_order);
+
+  for (i = 0; i < child_index->found->len; i++)
+    clutter_actor_paint (g_array_index (child_index->found,
+                                        MxChildIndexEntry, i).actor);
+}
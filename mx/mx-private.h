@@ -82,13 +82,101 @@ void _mx_table_update_row_col (MxTable *table,
                                gint     row,
                                gint     col);
 
+void _mx_grid_invalidate_child_index (MxGrid *grid);
+
 CoglHandle _mx_window_get_icon_cogl_texture (MxWindow *window);
 
 ClutterActor * _mx_window_get_resize_grip (MxWindow *window);
 
-void _mx_style_invalidate_cache (MxStylable *stylable);
+/* A style key uniquely identifies all the properties of a stylable that can
+ * be matched against in the CSS: its type, id, class and pseudo-class, and
+ * the key of its nearest stylable ancestor. Keys are interned, so two
+ * stylables that would match the same rules share the same key and keys can
+ * be hashed and compared by pointer.
+ */
+typedef struct _MxStyleKey MxStyleKey;
+
+/* The style properties of MxWidget, resolved once for each set of matched
+ * properties and shared by reference between all the widgets with the same
+ * style key (see _mx_widget_get_computed_style()), so that they can be read
+ * directly instead of through mx_stylable_get().
+ */
+typedef struct _MxComputedStyle MxComputedStyle;
+
+struct _MxComputedStyle
+{
+  gint           ref_count;
+
+  /* the properties and the font settings the values were computed from */
+  GHashTable    *properties;
+  guint          settings_serial;
+
+  ClutterColor   background_color;
+  ClutterColor   color;
+  guint          has_background_color : 1;
+  guint          has_color : 1;
+
+  MxBorderImage *background_image;
+  MxBorderImage *border_image;
+  MxPadding      padding;
+  guint          border_image_transition_duration;
+
+  gchar         *font_family;
+  gint           font_size;
+  MxFontWeight   font_weight;
+
+  /* the font family, size and weight as a Pango font description */
+  gchar         *font_name;
+};
+
+struct _MxStyleKey
+{
+  MxStyleKey *parent;
+  GType       type;
+  gchar      *id;
+  gchar      *class;
+  gchar      *pseudo_class;
+
+  guint       hash;
+  gint        ref_count;
+
+  /* the last properties resolved for this key, shared by every stylable
+   * with the same key (see _mx_style_key_get_properties()) */
+  guint       style_serial;
+  gint        style_age;
+  GHashTable *properties;
+
+  /* the MxWidget style values computed from the properties */
+  MxComputedStyle *computed;
+};
+
+MxStyleKey * _mx_stylable_get_style_key (MxStylable *stylable);
+MxStyleKey * _mx_style_key_ref          (MxStyleKey *key);
+void         _mx_style_key_unref        (MxStyleKey *key);
+
+GHashTable * _mx_style_key_get_properties (MxStyleKey *key,
+                                           guint       style_serial,
+                                           gint        style_age);
+void         _mx_style_key_set_properties (MxStyleKey *key,
+                                           guint       style_serial,
+                                           gint        style_age,
+                                           GHashTable *properties);
 
-gchar * _mx_stylable_get_style_string (MxStylable *stylable);
+gboolean     _mx_style_change_affects_descendants (MxStyle    *style,
+                                                   MxStyleKey *old_key,
+                                                   MxStyleKey *new_key);
+GHashTable * _mx_style_get_properties (MxStyle    *style,
+                                       MxStylable *stylable);
+
+MxComputedStyle * _mx_computed_style_ref   (MxComputedStyle *computed);
+void              _mx_computed_style_unref (MxComputedStyle *computed);
+
+MxComputedStyle * _mx_widget_get_computed_style (MxWidget *widget);
+MxComputedStyle * _mx_widget_get_applied_style  (MxWidget *widget);
+
+gchar * _mx_font_name_from_style (const gchar  *font_family,
+                                  gint          font_size,
+                                  MxFontWeight  font_weight);
 
 const gchar * _mx_enum_to_string (GType type,
                                   gint  value);
@@ -101,13 +189,22 @@ void     _mx_fade_effect_set_freeze_update (MxFadeEffect *effect,
                                             gboolean      freeze);
 gboolean _mx_fade_effect_get_freeze_update (MxFadeEffect *effect);
 
+typedef struct _MxChildIndex MxChildIndex;
+
+MxChildIndex * _mx_child_index_new   (GList                 *children,
+                                      MxOrientation          orientation);
+void           _mx_child_index_free  (MxChildIndex          *child_index);
+void           _mx_child_index_paint (MxChildIndex          *child_index,
+                                      const ClutterActorBox *box);
+
 typedef enum
 {
   MX_DEBUG_LAYOUT      = 1 << 0,
   MX_DEBUG_INSPECTOR   = 1 << 1,
   MX_DEBUG_FOCUS       = 1 << 2,
   MX_DEBUG_CSS         = 1 << 3,
-  MX_DEBUG_STYLE_CACHE = 1 << 4
+  MX_DEBUG_STYLE_CACHE = 1 << 4,
+  MX_DEBUG_TEXTURE_CACHE = 1 << 5
 } MxDebugTopic;
 
 gboolean _mx_debug (gint debug);
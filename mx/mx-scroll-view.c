@@ -206,17 +206,16 @@ mx_scroll_view_paint (ClutterActor *actor)
   gfloat w, h;
   MxAdjustment *vadjustment = NULL, *hadjustment = NULL;
   MxScrollViewPrivate *priv = MX_SCROLL_VIEW (actor)->priv;
-  ClutterColor *color;
+  const ClutterColor *color;
 
   guint8 r, g, b;
   const gint shadow = 15;
 
-  mx_stylable_get (MX_STYLABLE (actor), "background-color", &color, NULL);
+  color = &_mx_widget_get_applied_style (MX_WIDGET (actor))->background_color;
 
   r = color->red;
   g = color->green;
   b = color->blue;
-  clutter_color_free (color);
 
   /* MxBin will paint the child */
   CLUTTER_ACTOR_CLASS (mx_scroll_view_parent_class)->paint (actor);
@@ -64,6 +64,7 @@ static GParamSpecPool *style_property_spec_pool = NULL;
 
 static GQuark quark_real_owner         = 0;
 static GQuark quark_style              = 0;
+static GQuark quark_style_key          = 0;
 
 static guint stylable_signals[LAST_SIGNAL] = { 0, };
 
@@ -119,6 +120,8 @@ mx_stylable_base_init (gpointer g_iface)
   quark_real_owner =
     g_quark_from_static_string ("mx-stylable-real-owner-quark");
   quark_style = g_quark_from_static_string ("mx-stylable-style-quark");
+  quark_style_key =
+    g_quark_from_static_string ("mx-stylable-style-key-quark");
 
   style_property_spec_pool = g_param_spec_pool_new (FALSE);
 
@@ -200,80 +203,190 @@ mx_stylable_get_type (void)
   return our_type;
 }
 
-static void
-_mx_stylable_prepend_style_string (GString    *string,
-                                   MxStylable *stylable)
+static GHashTable *style_keys = NULL;
+
+static guint
+mx_style_key_hash (gconstpointer data)
 {
-  GType type_id;
-  gchar *style_string;
-  const gchar *type, *id, *class, *pseudo_class;
+  const MxStyleKey *key = data;
 
-  type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-  type = g_type_name (type_id);
+  return key->hash;
+}
 
-  id = clutter_actor_get_name ((ClutterActor*) stylable);
+static gboolean
+mx_style_key_equal (gconstpointer a,
+                    gconstpointer b)
+{
+  const MxStyleKey *key_a = a;
+  const MxStyleKey *key_b = b;
+
+  return (key_a->parent == key_b->parent &&
+          key_a->type == key_b->type &&
+          !g_strcmp0 (key_a->id, key_b->id) &&
+          !g_strcmp0 (key_a->class, key_b->class) &&
+          !g_strcmp0 (key_a->pseudo_class, key_b->pseudo_class));
+}
 
-  class = mx_stylable_get_style_class (stylable);
+static MxStyleKey *
+mx_style_key_intern (MxStyleKey  *parent,
+                     GType        type,
+                     const gchar *id,
+                     const gchar *class,
+                     const gchar *pseudo_class)
+{
+  MxStyleKey lookup, *key;
+  guint hash;
+
+  hash = parent ? parent->hash : 0;
+  hash = (hash * 31) + (guint) type;
+  hash = (hash * 31) + (id ? g_str_hash (id) : 0);
+  hash = (hash * 31) + (class ? g_str_hash (class) : 0);
+  hash = (hash * 31) + (pseudo_class ? g_str_hash (pseudo_class) : 0);
+
+  if (G_UNLIKELY (!style_keys))
+    style_keys = g_hash_table_new (mx_style_key_hash, mx_style_key_equal);
+
+  lookup.parent = parent;
+  lookup.type = type;
+  lookup.id = (gchar *) id;
+  lookup.class = (gchar *) class;
+  lookup.pseudo_class = (gchar *) pseudo_class;
+  lookup.hash = hash;
+
+  if ((key = g_hash_table_lookup (style_keys, &lookup)))
+    return _mx_style_key_ref (key);
+
+  key = g_slice_new (MxStyleKey);
+  key->parent = parent ? _mx_style_key_ref (parent) : NULL;
+  key->type = type;
+  key->id = g_strdup (id);
+  key->class = g_strdup (class);
+  key->pseudo_class = g_strdup (pseudo_class);
+  key->hash = hash;
+  key->ref_count = 1;
+  key->style_serial = 0;
+  key->style_age = 0;
+  key->properties = NULL;
+  key->computed = NULL;
+
+  g_hash_table_insert (style_keys, key, key);
+
+  return key;
+}
 
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+MxStyleKey *
+_mx_style_key_ref (MxStyleKey *key)
+{
+  key->ref_count++;
 
-  style_string = g_strconcat (type,
-                              "#", id ? id : "",
-                              ".", class ? class : "",
-                              ":", pseudo_class ? pseudo_class : "",
-                              ">",
-                              NULL);
-  g_string_prepend (string, style_string);
-  g_free (style_string);
+  return key;
 }
 
-gchar *
-_mx_stylable_get_style_string (MxStylable *stylable)
+void
+_mx_style_key_unref (MxStyleKey *key)
 {
-  GType type_id;
-  gchar *cstring;
-  GString *string;
-  const gchar *type, *id, *class, *pseudo_class;
-  ClutterActor *actor;
-  ClutterActor *parent;
+  if (--key->ref_count > 0)
+    return;
 
-  /* Create a string that contains all the properties of a
-   * Stylable that can be matched against in the CSS.
-   */
-  type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-  type = g_type_name (type_id);
+  g_hash_table_remove (style_keys, key);
 
-  actor = CLUTTER_ACTOR (stylable);
+  if (key->parent)
+    _mx_style_key_unref (key->parent);
 
-  id = clutter_actor_get_name (actor);
+  if (key->properties)
+    g_hash_table_unref (key->properties);
 
-  class = mx_stylable_get_style_class (stylable);
+  if (key->computed)
+    _mx_computed_style_unref (key->computed);
 
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+  g_free (key->id);
+  g_free (key->class);
+  g_free (key->pseudo_class);
 
-  string = g_string_sized_new (512);
+  g_slice_free (MxStyleKey, key);
+}
 
-  /* Add the actor hierarchy */
-  parent = clutter_actor_get_parent (actor);
+/* Returns the properties last resolved for @key by the style with the given
+ * serial, if they are still valid for @age. Stylables with the same key are
+ * siblings (or cousins) with the same type, id, class and pseudo-class, so
+ * they match exactly the same rules and can share the result outright.
+ */
+GHashTable *
+_mx_style_key_get_properties (MxStyleKey *key,
+                              guint       style_serial,
+                              gint        style_age)
+{
+  if (key->properties &&
+      key->style_serial == style_serial &&
+      key->style_age == style_age)
+    return key->properties;
+
+  return NULL;
+}
 
-  while (parent)
+void
+_mx_style_key_set_properties (MxStyleKey *key,
+                              guint       style_serial,
+                              gint        style_age,
+                              GHashTable *properties)
+{
+  if (properties)
+    g_hash_table_ref (properties);
+
+  if (key->properties)
+    g_hash_table_unref (key->properties);
+
+  /* the computed values are only valid for the properties they were
+   * computed from */
+  if (key->computed && key->properties != properties)
     {
-      if (MX_IS_STYLABLE (parent))
-        _mx_stylable_prepend_style_string (string, (MxStylable*) parent);
+      _mx_computed_style_unref (key->computed);
+      key->computed = NULL;
+    }
 
-      parent = clutter_actor_get_parent (parent);
+  key->properties = properties;
+  key->style_serial = style_serial;
+  key->style_age = style_age;
+}
+
+/* Returns the style key of @stylable. The key is kept on the stylable and
+ * only re-interned when the stylable's own properties have changed (see
+ * mx_stylable_style_changed()) or the key of its ancestor is no longer the
+ * one it was created with, so looking it up only costs a pointer comparison
+ * per ancestor. The returned key is owned by @stylable.
+ */
+MxStyleKey *
+_mx_stylable_get_style_key (MxStylable *stylable)
+{
+  MxStyleKey *key, *parent_key;
+  ClutterActor *parent;
+
+  parent_key = NULL;
+  for (parent = clutter_actor_get_parent (CLUTTER_ACTOR (stylable));
+       parent;
+       parent = clutter_actor_get_parent (parent))
+    {
+      if (MX_IS_STYLABLE (parent))
+        {
+          parent_key = _mx_stylable_get_style_key ((MxStylable *) parent);
+          break;
+        }
     }
 
-  g_string_append_printf (string, "%s#%s.%s:%s",
-                          type,
-                          id ? id : "",
-                          class ? class : "",
-                          pseudo_class ? pseudo_class : "");
+  key = g_object_get_qdata (G_OBJECT (stylable), quark_style_key);
+  if (key && key->parent == parent_key)
+    return key;
 
-  cstring = string->str;
-  g_string_free (string, FALSE);
+  key = mx_style_key_intern (parent_key,
+                             G_OBJECT_TYPE (stylable),
+                             clutter_actor_get_name (CLUTTER_ACTOR (stylable)),
+                             mx_stylable_get_style_class (stylable),
+                             mx_stylable_get_style_pseudo_class (stylable));
 
-  return cstring;
+  g_object_set_qdata_full (G_OBJECT (stylable), quark_style_key, key,
+                           (GDestroyNotify) _mx_style_key_unref);
+
+  return key;
 }
 
 #if 0
@@ -1008,10 +1121,214 @@ mx_stylable_set_style_class (MxStylable  *stylable,
                g_type_name (G_OBJECT_TYPE (stylable)));
 }
 
+/* Restyle queue
+ *
+ * The style changes caused by a change of the name, style class or style
+ * pseudo-class of a stylable are not emitted straight away, but queued and
+ * emitted once per frame, before the stage is laid out and painted. A
+ * stylable whose state changes several times before the next frame, or
+ * whose ancestor is restyled in the same frame, is then only restyled once.
+ * mx_stylable_ensure_style() flushes the queued change of a stylable for
+ * callers that need its style straight away.
+ *
+ * A stylable that is mapped or gets a new parent is restyled straight away,
+ * since it may be mapped after the queue has been flushed for the frame and
+ * would then be painted without a style.
+ */
+
+typedef struct
+{
+  MxStylable          *stylable;
+  MxStyleChangedFlags  flags;
+
+  /* the key of the stylable before the first change, if only its own state
+   * (name, class or pseudo-class) has changed since it was queued */
+  MxStyleKey          *old_key;
+  gboolean             own_state;
+
+  guint                depth;
+} MxStylableRestyle;
+
+static GHashTable *pending_restyles = NULL;
+static GHashTable *flushing_restyles = NULL;
+static guint restyle_repaint_id = 0;
+
+static void mx_stylable_style_changed_internal (MxStylable          *stylable,
+                                                MxStyleChangedFlags  flags,
+                                                MxStyleKey          *old_key);
+
+static void
+mx_stylable_restyle_free (MxStylableRestyle *restyle)
+{
+  if (restyle->old_key)
+    _mx_style_key_unref (restyle->old_key);
+
+  g_object_unref (restyle->stylable);
+
+  g_slice_free (MxStylableRestyle, restyle);
+}
+
+static void
+mx_stylable_restyle_run (MxStylableRestyle *restyle)
+{
+  mx_stylable_style_changed_internal (restyle->stylable, restyle->flags,
+                                      restyle->own_state
+                                      ? restyle->old_key : NULL);
+}
+
+static gint
+mx_stylable_restyle_compare_depth (gconstpointer a,
+                                   gconstpointer b)
+{
+  const MxStylableRestyle *restyle_a = *((MxStylableRestyle **) a);
+  const MxStylableRestyle *restyle_b = *((MxStylableRestyle **) b);
+
+  return (gint) restyle_a->depth - (gint) restyle_b->depth;
+}
+
+static gboolean
+mx_stylable_flush_restyles (gpointer data)
+{
+  GHashTableIter iter;
+  GPtrArray *restyles;
+  gpointer value;
+  guint i;
+
+  if (!pending_restyles || !g_hash_table_size (pending_restyles))
+    {
+      restyle_repaint_id = 0;
+      return FALSE;
+    }
+
+  /* take the current batch, anything queued while it is flushed is left for
+   * the next frame */
+  restyles = g_ptr_array_sized_new (g_hash_table_size (pending_restyles));
+  g_hash_table_iter_init (&iter, pending_restyles);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      MxStylableRestyle *restyle = value;
+      ClutterActor *actor = CLUTTER_ACTOR (restyle->stylable);
+
+      restyle->depth = 0;
+      while ((actor = clutter_actor_get_parent (actor)))
+        restyle->depth++;
+
+      g_ptr_array_add (restyles, restyle);
+    }
+
+  flushing_restyles = pending_restyles;
+  pending_restyles = NULL;
+
+  /* restyle ancestors first, so that a stylable restyled as part of the
+   * subtree of one of its ancestors is not restyled again */
+  g_ptr_array_sort (restyles, mx_stylable_restyle_compare_depth);
+
+  for (i = 0; i < restyles->len; i++)
+    {
+      MxStylableRestyle *restyle = g_ptr_array_index (restyles, i);
+
+      if (g_hash_table_lookup (flushing_restyles, restyle->stylable) == restyle)
+        {
+          g_hash_table_remove (flushing_restyles, restyle->stylable);
+          mx_stylable_restyle_run (restyle);
+        }
+
+      mx_stylable_restyle_free (restyle);
+    }
+
+  g_ptr_array_free (restyles, TRUE);
+  g_hash_table_destroy (flushing_restyles);
+  flushing_restyles = NULL;
+
+  if (pending_restyles && g_hash_table_size (pending_restyles))
+    return TRUE;
+
+  restyle_repaint_id = 0;
+  return FALSE;
+}
+
+static void
+mx_stylable_queue_style_changed (MxStylable          *stylable,
+                                 MxStyleChangedFlags  flags,
+                                 gboolean             own_state)
+{
+  MxStylableRestyle *restyle;
+
+  if (G_UNLIKELY (!pending_restyles))
+    pending_restyles = g_hash_table_new (NULL, NULL);
+
+  restyle = g_hash_table_lookup (pending_restyles, stylable);
+  if (!restyle)
+    {
+      restyle = g_slice_new0 (MxStylableRestyle);
+      restyle->stylable = g_object_ref (stylable);
+      restyle->own_state = own_state;
+
+      if (own_state)
+        {
+          restyle->old_key = g_object_get_qdata (G_OBJECT (stylable),
+                                                 quark_style_key);
+          if (restyle->old_key)
+            _mx_style_key_ref (restyle->old_key);
+        }
+
+      g_hash_table_insert (pending_restyles, stylable, restyle);
+    }
+  else if (!own_state)
+    restyle->own_state = FALSE;
+
+  restyle->flags |= flags;
+
+  /* drop the key straight away, so that the style is already up to date
+   * when it is read before the queue is flushed */
+  if (flags & MX_STYLE_CHANGED_INVALIDATE_CACHE)
+    g_object_set_qdata (G_OBJECT (stylable), quark_style_key, NULL);
+
+  if (!restyle_repaint_id)
+    restyle_repaint_id =
+      clutter_threads_add_repaint_func (mx_stylable_flush_restyles,
+                                        NULL, NULL);
+
+  /* make sure there is a frame to flush the queue in */
+  if (CLUTTER_ACTOR_IS_MAPPED (CLUTTER_ACTOR (stylable)))
+    clutter_actor_queue_redraw (CLUTTER_ACTOR (stylable));
+}
+
+static void
+mx_stylable_restyle_done (MxStylable *stylable)
+{
+  MxStylableRestyle *restyle;
+
+  /* the stylable is being restyled, so any change still queued for it is
+   * no longer needed */
+  if (pending_restyles &&
+      (restyle = g_hash_table_lookup (pending_restyles, stylable)))
+    {
+      g_hash_table_remove (pending_restyles, stylable);
+      mx_stylable_restyle_free (restyle);
+    }
+
+  /* these are freed by mx_stylable_flush_restyles() */
+  if (flushing_restyles)
+    g_hash_table_remove (flushing_restyles, stylable);
+}
+
 static void
 mx_stylable_property_changed_notify (MxStylable *stylable)
 {
-  mx_stylable_style_changed (stylable, MX_STYLE_CHANGED_INVALIDATE_CACHE);
+  mx_stylable_style_changed_internal (stylable,
+                                      MX_STYLE_CHANGED_INVALIDATE_CACHE,
+                                      NULL);
+}
+
+static void
+mx_stylable_state_changed_notify (MxStylable *stylable)
+{
+  /* only the stylable's own id, class or pseudo-class has changed, so its
+   * descendants only need restyling if a selector tests what changed */
+  mx_stylable_queue_style_changed (stylable,
+                                   MX_STYLE_CHANGED_INVALIDATE_CACHE,
+                                   TRUE);
 }
 
 static void
@@ -1023,13 +1340,18 @@ mx_stylable_parent_set_notify (ClutterActor *actor,
   /* check the actor has a new parent */
   if (new_parent)
     {
-      mx_stylable_style_changed (MX_STYLABLE (actor),
-                                 MX_STYLE_CHANGED_INVALIDATE_CACHE);
+      mx_stylable_style_changed_internal (MX_STYLABLE (actor),
+                                          MX_STYLE_CHANGED_INVALIDATE_CACHE,
+                                          NULL);
     }
 }
 
-static void mx_stylable_style_changed_internal (MxStylable          *stylable,
-                                                MxStyleChangedFlags  flags);
+static void
+mx_stylable_destroy_notify (MxStylable *stylable)
+{
+  /* don't keep a destroyed stylable alive until the next frame */
+  mx_stylable_restyle_done (stylable);
+}
 
 static void
 mx_stylable_child_notify (ClutterActor *actor,
@@ -1037,13 +1359,20 @@ mx_stylable_child_notify (ClutterActor *actor,
 {
   if (MX_IS_STYLABLE (actor))
     mx_stylable_style_changed_internal (MX_STYLABLE (actor),
-                                        GPOINTER_TO_INT (flags));
+                                        GPOINTER_TO_INT (flags), NULL);
 }
 
 static void
 mx_stylable_style_changed_internal (MxStylable          *stylable,
-                                    MxStyleChangedFlags  flags)
+                                    MxStyleChangedFlags  flags,
+                                    MxStyleKey          *old_key)
 {
+  gboolean restyle_children;
+
+  /* drop the style key even if the stylable is not mapped, so that the key
+   * of any descendant that is styled is created from an up-to-date key */
+  if (flags & MX_STYLE_CHANGED_INVALIDATE_CACHE)
+    g_object_set_qdata (G_OBJECT (stylable), quark_style_key, NULL);
 
   /* don't update stylables until they are mapped (unless ensure is set) */
   if (G_LIKELY (CLUTTER_IS_ACTOR (stylable)) &&
@@ -1051,9 +1380,6 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
       !(flags & MX_STYLE_CHANGED_FORCE))
     return;
 
-  if (flags & MX_STYLE_CHANGED_INVALIDATE_CACHE)
-    _mx_style_invalidate_cache (stylable);
-
   /* If the parent style has changed, child cache needs to be
    * invalidated. This needs to happen for internal children as
    * well, which is why it's here and not in the container block
@@ -1061,12 +1387,26 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
    */
   flags |= MX_STYLE_CHANGED_INVALIDATE_CACHE;
 
+  mx_stylable_restyle_done (stylable);
+
   g_signal_emit (stylable, stylable_signals[STYLE_CHANGED], 0, flags);
 
   /* propagate the style-changed signal to children, since their style may
-   * depend on one or more properties of the parent */
+   * depend on one or more properties of the parent. When only the state of
+   * this stylable changed, that is only the case if the style sheet has a
+   * parent or ancestor selector that tests the part of it that changed */
+  restyle_children = TRUE;
+  if (old_key)
+    {
+      MxStyle *style = mx_stylable_get_style (stylable);
+      MxStyleKey *new_key = _mx_stylable_get_style_key (stylable);
 
-  if (CLUTTER_IS_CONTAINER (stylable))
+      if (style)
+        restyle_children =
+          _mx_style_change_affects_descendants (style, old_key, new_key);
+    }
+
+  if (restyle_children && CLUTTER_IS_CONTAINER (stylable))
     {
       /* notify our children that their parent stylable has changed */
       clutter_container_foreach ((ClutterContainer *) stylable,
@@ -1091,7 +1431,59 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
 void
 mx_stylable_style_changed (MxStylable *stylable, MxStyleChangedFlags flags)
 {
-  mx_stylable_style_changed_internal (stylable, flags);
+  mx_stylable_style_changed_internal (stylable, flags, NULL);
+}
+
+/**
+ * mx_stylable_ensure_style:
+ * @stylable: an MxStylable
+ *
+ * Style changes caused by changes to the name, style class or style
+ * pseudo-class of @stylable are applied once per frame, before the stage
+ * is laid out and painted. This applies any style change still pending for
+ * @stylable or its ancestors straight away, for callers that need the style
+ * of @stylable to be up to date before the next frame.
+ *
+ * Since: 1.6
+ */
+void
+mx_stylable_ensure_style (MxStylable *stylable)
+{
+  GList *ancestors, *l;
+  ClutterActor *actor;
+
+  g_return_if_fail (MX_IS_STYLABLE (stylable));
+
+  if (!pending_restyles || !g_hash_table_size (pending_restyles))
+    return;
+
+  /* apply the changes from the top down, restyling an ancestor may restyle
+   * the stylables below it */
+  ancestors = NULL;
+  for (actor = CLUTTER_ACTOR (stylable);
+       actor;
+       actor = clutter_actor_get_parent (actor))
+    {
+      if (g_hash_table_lookup (pending_restyles, actor))
+        ancestors = g_list_prepend (ancestors, g_object_ref (actor));
+    }
+
+  for (l = ancestors; l; l = l->next)
+    {
+      MxStylableRestyle *restyle;
+
+      restyle = g_hash_table_lookup (pending_restyles, l->data);
+      if (restyle)
+        {
+          g_hash_table_remove (pending_restyles, l->data);
+          mx_stylable_restyle_run (restyle);
+          mx_stylable_restyle_free (restyle);
+        }
+
+      g_object_unref (l->data);
+    }
+
+  g_list_free (ancestors);
 }
 
 void
@@ -1103,9 +1495,11 @@ mx_stylable_connect_change_notifiers (MxStylable *stylable)
 
   /* ClutterActor signals */
   g_signal_connect (stylable, "notify::name",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_state_changed_notify), NULL);
   g_signal_connect (stylable, "parent-set",
                     G_CALLBACK (mx_stylable_parent_set_notify), NULL);
+  g_signal_connect (stylable, "destroy",
+                    G_CALLBACK (mx_stylable_destroy_notify), NULL);
 
   /* style-changed is blocked until the actor is mapped, so style-changed
    * needs to be sent as soon as the actor is mapped */
@@ -1114,40 +1508,30 @@ mx_stylable_connect_change_notifiers (MxStylable *stylable)
 
   /* MxStylable notifiers */
   g_signal_connect (stylable, "notify::style-class",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_state_changed_notify), NULL);
   g_signal_connect (stylable, "notify::style-pseudo-class",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_state_changed_notify), NULL);
 
 }
 
-void
-mx_stylable_apply_clutter_text_attributes (MxStylable  *stylable,
-                                           ClutterText *text)
+/* Returns the Pango font description string for a font family, size in
+ * pixels and weight, as used by clutter_text_set_font_name() */
+gchar *
+_mx_font_name_from_style (const gchar  *font_family,
+                          gint          font_size,
+                          MxFontWeight  font_weight)
 {
-  ClutterColor *real_color = NULL;
-  gchar *font_name = NULL;
-  gint font_size = 0;
-  MxFontWeight font_weight;
-  PangoWeight weight;
   PangoFontDescription *descr;
+  PangoWeight weight;
   gchar *descr_string;
 
-  mx_stylable_get (stylable,
-                   "color", &real_color,
-                   "font-family", &font_name,
-                   "font-size", &font_size,
-                   "font-weight", &font_weight,
-                   NULL);
-
-
   /* Create a description, we will convert to a string and set on the
    * ClutterText. When Clutter gets API to set the description directly this
    * won't be necessary. */
   descr = pango_font_description_new ();
 
   /* font name */
-  pango_font_description_set_family (descr, font_name);
-  g_free (font_name);
+  pango_font_description_set_family (descr, font_family);
 
   /* font size */
   pango_font_description_set_absolute_size (descr, font_size * PANGO_SCALE);
@@ -1171,9 +1555,46 @@ mx_stylable_apply_clutter_text_attributes (MxStylable  *stylable,
   pango_font_description_set_weight (descr, weight);
 
   descr_string = pango_font_description_to_string (descr);
+  pango_font_description_free (descr);
+
+  return descr_string;
+}
+
+void
+mx_stylable_apply_clutter_text_attributes (MxStylable  *stylable,
+                                           ClutterText *text)
+{
+  ClutterColor *real_color = NULL;
+  gchar *font_name = NULL;
+  gint font_size = 0;
+  MxFontWeight font_weight;
+  gchar *descr_string;
+
+  /* widgets share the font and color computed for their style */
+  if (MX_IS_WIDGET (stylable))
+    {
+      MxComputedStyle *computed;
+
+      computed = _mx_widget_get_computed_style (MX_WIDGET (stylable));
+
+      clutter_text_set_font_name (text, computed->font_name);
+      if (computed->has_color)
+        clutter_text_set_color (text, &computed->color);
+
+      return;
+    }
+
+  mx_stylable_get (stylable,
+                   "color", &real_color,
+                   "font-family", &font_name,
+                   "font-size", &font_size,
+                   "font-weight", &font_weight,
+                   NULL);
+
+  descr_string = _mx_font_name_from_style (font_name, font_size, font_weight);
   clutter_text_set_font_name (text, descr_string);
   g_free (descr_string);
-  pango_font_description_free (descr);
+  g_free (font_name);
 
   /* font color */
   if (real_color)
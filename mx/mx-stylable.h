@@ -130,6 +130,7 @@ void         mx_stylable_set_style_pseudo_class (MxStylable  *stylable,
                                                  const gchar *pseudo_class);
 
 void mx_stylable_style_changed (MxStylable *stylable, MxStyleChangedFlags flags);
+void mx_stylable_ensure_style  (MxStylable *stylable);
 void mx_stylable_connect_change_notifiers (MxStylable *stylable);
 
 /* utilities */
@@ -42,6 +42,8 @@
 #include "mx-style.h"
 #include "mx-enum-types.h"
 #include "mx-types.h"
+#include "mx-texture-cache.h"
+#include "mx-image-cache.h"
 #include "mx-private.h"
 
 enum
@@ -56,40 +58,23 @@ enum
 
 #define MX_STYLE_ERROR g_style_error_quark ()
 
-#define MX_STYLE_CACHE g_style_cache_quark ()
-
-/* This is the amount of entries that will be allowed per
- * stylable object.
- *
- * In the usual case, objects share rules and
- * so we don't really need to allocate more than one space in
- * the cache per object, but in case of the pathological case
- * of every stylable object having a unique style rule that
- * applies only to itself, we allow 6 per object.
- *
- * e.g. normal, hover, active, checked, focus + 1 extra
+/* The default amount of memory the style cache is allowed to use. Objects
+ * usually share rules, so in the usual case this holds the matched
+ * properties of every state of every kind of widget in an application.
  */
-#define MX_STYLE_CACHE_SIZE 6
+#define MX_STYLE_CACHE_DEFAULT_BUDGET (256 * 1024)
 
-/* A style cache entry is the unique string representing all the properties
+/* A style cache entry is the unique key representing all the properties
  * that can be matched against in CSS, and the matched properties themselves.
  */
 typedef struct
 {
-  gchar      *style_string;
+  MxStyleKey *key;
   gint        age;
   GHashTable *properties;
+  gsize       size;
 } MxStyleCacheEntry;
 
-/* This is the per-stylable cache store. We need a reference back to the
- * parent style so that we can maintain the count of alive stylables.
- */
-typedef struct
-{
-  GList   *styles;
-  gchar   *string;
-} MxStylableCache;
-
 typedef struct {
   GType value_type;
   gchar *value_name;
@@ -103,13 +88,22 @@ struct _MxStylePrivate
   GHashTable *style_hash;
   GHashTable *node_hash;
 
-  gint        alive_stylables;
   GQueue     *cached_matches;
   GHashTable *cache_hash;
   gint        age;
+
+  gsize       cache_budget;
+  gsize       cache_bytes;
+  guint       cache_hits;
+  guint       cache_misses;
+  guint       cache_evictions;
+
+  /* identifies this style to the properties shared on style keys */
+  guint       serial;
 };
 
 static guint style_signals[LAST_SIGNAL] = { 0, };
+static guint style_serial = 0;
 
 static MxStyle *default_style = NULL;
 
@@ -121,10 +115,108 @@ g_style_error_quark (void)
   return g_quark_from_static_string ("mx-style-error-quark");
 }
 
-static GQuark
-g_style_cache_quark (void)
+static MxStyleCacheEntry *
+mx_style_cache_entry_new (MxStyleKey *key,
+                          GHashTable *properties,
+                          gint        age)
 {
-  return g_quark_from_static_string ("mx-style-cache-quark");
+  MxStyleCacheEntry *entry = g_slice_new (MxStyleCacheEntry);
+
+  entry->key = _mx_style_key_ref (key);
+  entry->properties = properties;
+  entry->age = age;
+
+  /* An estimate of the memory used by the entry, its queue link, its slot in
+   * the cache hash table and its property table. The property values
+   * themselves belong to the style sheet. */
+  entry->size = sizeof (MxStyleCacheEntry) + sizeof (GList) +
+    3 * sizeof (gpointer) +
+    g_hash_table_size (properties) * (2 * sizeof (gpointer) + sizeof (guint));
+
+  return entry;
+}
+
+static void
+mx_style_cache_entry_free (MxStyleCacheEntry *entry,
+                           gboolean           free_struct)
+{
+  _mx_style_key_unref (entry->key);
+  g_hash_table_unref (entry->properties);
+  if (free_struct)
+    g_slice_free (MxStyleCacheEntry, entry);
+}
+
+static void
+mx_style_cache_remove (MxStyle *style,
+                       GList   *entry_link)
+{
+  MxStylePrivate *priv = style->priv;
+  MxStyleCacheEntry *entry = entry_link->data;
+
+  /* stop sharing the properties through the key as well, so that they
+   * don't outlive their entry */
+  if (entry->key->style_serial == priv->serial &&
+      entry->key->properties == entry->properties)
+    _mx_style_key_set_properties (entry->key, priv->serial, entry->age, NULL);
+
+  g_hash_table_remove (priv->cache_hash, entry->key);
+  g_queue_delete_link (priv->cached_matches, entry_link);
+  priv->cache_bytes -= entry->size;
+
+  mx_style_cache_entry_free (entry, TRUE);
+}
+
+static void
+mx_style_cache_shrink (MxStyle *style)
+{
+  MxStylePrivate *priv = style->priv;
+
+  /* Evict the least recently used entries until the cache fits in its
+   * budget, but always keep the most recent entry */
+  while (priv->cache_bytes > priv->cache_budget &&
+         g_queue_get_length (priv->cached_matches) > 1)
+    {
+      mx_style_cache_remove (style, priv->cached_matches->tail);
+      priv->cache_evictions ++;
+    }
+}
+
+static void
+mx_style_cache_revalidate (MxStyle *style,
+                           guint    first_selector)
+{
+  MxStylePrivate *priv = style->priv;
+  GList *l, *next;
+
+  /* The style sheet has gained the selectors from @first_selector onwards.
+   * Only the entries that one of those could apply to are out of date, the
+   * others are moved to the current age.
+   */
+  for (l = priv->cached_matches->head; l; l = next)
+    {
+      MxStyleCacheEntry *entry = l->data;
+
+      next = l->next;
+
+      if (mx_style_sheet_may_match_key (priv->stylesheet, first_selector,
+                                        entry->key))
+        {
+          mx_style_cache_remove (style, l);
+          continue;
+        }
+
+      /* keep the properties shared on the key valid as well */
+      if (_mx_style_key_get_properties (entry->key, priv->serial,
+                                        entry->age) == entry->properties)
+        _mx_style_key_set_properties (entry->key, priv->serial, priv->age,
+                                      entry->properties);
+
+      entry->age = priv->age;
+    }
+
+  MX_NOTE (STYLE_CACHE, "(%p) Cache size after revalidation: %d (%"
+           G_GSIZE_FORMAT " bytes)", style,
+           g_queue_get_length (priv->cached_matches), priv->cache_bytes);
 }
 
 static gboolean
@@ -135,6 +227,8 @@ mx_style_real_load_from_file (MxStyle    *style,
 {
   MxStylePrivate *priv;
   GError *internal_error;
+  guint first_selector;
+  gchar *dirname, *cache;
 
   g_return_val_if_fail (MX_IS_STYLE (style), FALSE);
   g_return_val_if_fail (filename != NULL, FALSE);
@@ -153,10 +247,22 @@ mx_style_real_load_from_file (MxStyle    *style,
   if (!priv->stylesheet)
     priv->stylesheet = mx_style_sheet_new ();
 
+  first_selector = mx_style_sheet_get_n_selectors (priv->stylesheet);
+
   mx_style_sheet_add_from_file (priv->stylesheet, filename, NULL);
 
-  /* Increment the age so we know if a style cache entry is valid */
+  /* Pick up the theme images packed at install time, if there are any */
+  dirname = g_path_get_dirname (filename);
+  cache = g_build_filename (dirname, MX_IMAGE_CACHE_NAME, NULL);
+  if (g_file_test (cache, G_FILE_TEST_IS_REGULAR))
+    mx_texture_cache_load_cache (mx_texture_cache_get_default (), cache);
+  g_free (cache);
+  g_free (dirname);
+
+  /* Increment the age so we know if a style cache entry is valid, and
+   * carry over the entries the new selectors cannot apply to */
   priv->age ++;
+  mx_style_cache_revalidate (style, first_selector);
 
   g_signal_emit (style, style_signals[CHANGED], 0, NULL);
 
@@ -217,41 +323,18 @@ mx_style_load (MxStyle *style)
   g_free (rc_file);
 }
 
-static MxStyleCacheEntry *
-mx_style_cache_entry_new (const gchar *style_string,
-                          GHashTable  *properties,
-                          gint         age)
-{
-  MxStyleCacheEntry *entry = g_slice_new (MxStyleCacheEntry);
-
-  entry->style_string = g_strdup (style_string);
-  entry->properties = properties;
-  entry->age = age;
-
-  return entry;
-}
-
-static void
-mx_style_cache_entry_free (MxStyleCacheEntry *entry,
-                           gboolean           free_struct)
-{
-  g_free (entry->style_string);
-  g_hash_table_unref (entry->properties);
-  if (free_struct)
-    g_slice_free (MxStyleCacheEntry, entry);
-}
-
 static void
 mx_style_finalize (GObject *gobject)
 {
-  MxStylePrivate *priv = MX_STYLE (gobject)->priv;
-
-  g_hash_table_unref (priv->cache_hash);
+  MxStyle *style = MX_STYLE (gobject);
+  MxStylePrivate *priv = style->priv;
 
-  while (g_queue_get_length (priv->cached_matches))
-    mx_style_cache_entry_free (g_queue_pop_head (priv->cached_matches), TRUE);
+  while (priv->cached_matches->head)
+    mx_style_cache_remove (style, priv->cached_matches->head);
   g_queue_free (priv->cached_matches);
 
+  g_hash_table_unref (priv->cache_hash);
+
   G_OBJECT_CLASS (mx_style_parent_class)->finalize (gobject);
 }
 
@@ -290,7 +373,9 @@ mx_style_init (MxStyle *style)
   style->priv = priv = MX_STYLE_GET_PRIVATE (style);
 
   priv->cached_matches = g_queue_new ();
-  priv->cache_hash = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->cache_hash = g_hash_table_new (NULL, NULL);
+  priv->cache_budget = MX_STYLE_CACHE_DEFAULT_BUDGET;
+  priv->serial = ++style_serial;
 
   mx_style_load (style);
 }
@@ -461,6 +546,40 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
 }
 
 
+/* Returns the value of @css_value transformed to the type of @pspec. The
+ * transformed value is cached on the style sheet value, so each declaration
+ * only needs to be parsed once for each type it is requested as.
+ */
+static const GValue *
+mx_style_get_css_value (MxStyleSheetValue *css_value,
+                        MxStylable        *stylable,
+                        GParamSpec        *pspec)
+{
+  GValue value = { 0, };
+  guint i;
+
+  if (css_value->values)
+    {
+      for (i = 0; i < css_value->values->len; i++)
+        {
+          GValue *cached = &g_array_index (css_value->values, GValue, i);
+
+          if (G_VALUE_TYPE (cached) == pspec->value_type)
+            return cached;
+        }
+    }
+  else
+    css_value->values = g_array_sized_new (FALSE, FALSE, sizeof (GValue), 1);
+
+  mx_style_transform_css_value (css_value, stylable, pspec, &value);
+
+  /* the array takes over the contents of the value */
+  g_array_append_val (css_value->values, value);
+
+  return &g_array_index (css_value->values, GValue,
+                         css_value->values->len - 1);
+}
+
 static const gchar*
 mx_style_normalize_property_name (const gchar *name)
 {
@@ -478,170 +597,208 @@ mx_style_normalize_property_name (const gchar *name)
     return name;
 }
 
-static void
-mx_style_cache_weak_ref_cb (gpointer  data,
-                            GObject  *old_object)
-{
-  MxStylableCache *cache = data;
-  GList *style_link = g_list_find (cache->styles, old_object);
-
-  if (style_link)
-    cache->styles = g_list_delete_link (cache->styles, style_link);
-  else
-    g_warning (G_STRLOC ": Weak unref on a stylable with no style reference");
-}
-
-static void
-mx_style_stylable_cache_free (MxStylableCache *cache)
-{
-  /* If there are still styles referencing this stylable, decrement their
-   * count of alive stylables and remove the weak reference.
-   */
-  while (cache->styles)
-    {
-      MxStyle *style = cache->styles->data;
-      MxStylePrivate *priv = style->priv;
-
-      g_object_weak_unref (G_OBJECT (style),
-                           mx_style_cache_weak_ref_cb,
-                           cache);
-      priv->alive_stylables --;
-
-      MX_NOTE (STYLE_CACHE, "(%p) Alive stylables: %d",
-               style, priv->alive_stylables);
-
-      cache->styles = g_list_delete_link (cache->styles, cache->styles);
-    }
-
-  g_free (cache->string);
-  g_slice_free (MxStylableCache, cache);
-}
-
-void
-_mx_style_invalidate_cache (MxStylable *stylable)
-{
-  GObject *object = G_OBJECT (stylable);
-  MxStylableCache *cache = g_object_get_qdata (object, MX_STYLE_CACHE);
-
-  /* Reset the cache string */
-  if (cache)
-    {
-      g_free (cache->string);
-      cache->string = NULL;
-    }
-}
-
 static GHashTable *
 mx_style_get_style_sheet_properties (MxStyle    *style,
                                      MxStylable *stylable)
 {
   GList *entry_link;
-  MxStylableCache *cache;
+  MxStyleKey *key;
+  GHashTable *properties;
 
   MxStyleCacheEntry *entry = NULL;
   MxStylePrivate *priv = style->priv;
 
-  /* see if we have a cached style and return that if possible */
-  cache = g_object_get_qdata (G_OBJECT (stylable), MX_STYLE_CACHE);
-
-  if (cache)
+  /* Style sharing: if a stylable with the same key (i.e. a sibling with the
+   * same type, id, class and pseudo-class, under an identical ancestry) has
+   * already been styled, reuse its properties outright.
+   */
+  key = _mx_stylable_get_style_key (stylable);
+  properties = _mx_style_key_get_properties (key, priv->serial, priv->age);
+  if (properties)
     {
-      /* Make sure that the style string is up-to-date. We set this
-       * to NULL when invalidating the stylable's cache.
-       */
-      if (!cache->string)
-        cache->string = _mx_stylable_get_style_string (stylable);
-
-      /* Check that the stylable has a reference to us. If the stylable
-       * cache struct was created by another style, we need to add ourselves
-       * to the list.
-       */
-      if (!g_list_find (cache->styles, style))
+      /* the properties shared on the key are those of its cache entry,
+       * which is now the most recently used */
+      if ((entry_link = g_hash_table_lookup (priv->cache_hash, key)))
         {
-          cache->styles = g_list_prepend (cache->styles, style);
-          g_object_weak_ref (G_OBJECT (style), mx_style_cache_weak_ref_cb,
-                             cache);
-          priv->alive_stylables ++;
+          g_queue_unlink (priv->cached_matches, entry_link);
+          g_queue_push_head_link (priv->cached_matches, entry_link);
         }
-    }
-  else
-    {
-      /* This is the first time this stylable has tried to get style
-       * properties, initialise a cache.
-       */
-      cache = g_slice_new0 (MxStylableCache);
-      cache->string = _mx_stylable_get_style_string (stylable);
-      cache->styles = g_list_prepend (NULL, style);
-
-      /* Increase the alive-stylables count and add a weak reference so we
-       * can remove it.
-       */
-      priv->alive_stylables ++;
-      g_object_weak_ref (G_OBJECT (style), mx_style_cache_weak_ref_cb, cache);
-
-      MX_NOTE (STYLE_CACHE, "(%p) Alive stylables: %d",
-               style, priv->alive_stylables);
-
-      /* Use qdata to associate the cache entry with the stylable object */
-      g_object_set_qdata_full (G_OBJECT (stylable), MX_STYLE_CACHE, cache,
-                               (GDestroyNotify)mx_style_stylable_cache_free);
+
+      priv->cache_hits ++;
+      return g_hash_table_ref (properties);
     }
 
-  if ((entry_link = g_hash_table_lookup (priv->cache_hash, cache->string)))
+  /* see if we have a cached style and return that if possible */
+  if ((entry_link = g_hash_table_lookup (priv->cache_hash, key)))
     {
       entry = entry_link->data;
 
       /* If the entry is old, remove it from the cache */
       if (entry->age != priv->age)
         {
-          g_hash_table_remove (priv->cache_hash, entry->style_string);
-          g_queue_delete_link (priv->cached_matches, entry_link);
-          mx_style_cache_entry_free (entry, TRUE);
+          mx_style_cache_remove (style, entry_link);
           entry = NULL;
         }
+      else
+        {
+          /* move the entry to the front of the queue, so that the least
+           * recently used entries are the ones evicted */
+          g_queue_unlink (priv->cached_matches, entry_link);
+          g_queue_push_head_link (priv->cached_matches, entry_link);
 
-      /* As the cache is rarely emptied, FIFO is good enough for the
-       * eviction strategy (preferring speedy retrieval to efficient
-       * eviction)
-       *
-       * If we did want LRU though, for example, here would be the place
-       * to do it. You could remove the link from the queue using
-       * g_queue_unlink() and reinsert it with g_queue_push_head_link()
-       */
+          priv->cache_hits ++;
+        }
     }
 
   /* No cached style properties were found, or the entry found is out of date,
    * so look them up from the style-sheet and (re-)add them to the cache.
    */
-  if (!entry || (entry->age != priv->age))
+  if (!entry)
     {
+      priv->cache_misses ++;
+
       /* Look up style properties */
-      GHashTable *properties = mx_style_sheet_get_properties (priv->stylesheet,
-                                                              stylable);
+      properties = mx_style_sheet_get_properties (priv->stylesheet, stylable);
 
       /* Append this to the style cache */
-      entry = mx_style_cache_entry_new (cache->string, properties, priv->age);
+      entry = mx_style_cache_entry_new (key, properties, priv->age);
       g_queue_push_head (priv->cached_matches, entry);
-      g_hash_table_insert (priv->cache_hash, entry->style_string,
+      g_hash_table_insert (priv->cache_hash, entry->key,
                            priv->cached_matches->head);
+      priv->cache_bytes += entry->size;
 
       /* Shrink the cache if its grown too large */
-      while (g_queue_get_length (priv->cached_matches) >
-             (priv->alive_stylables * MX_STYLE_CACHE_SIZE))
-        {
-          MxStyleCacheEntry *old_entry =
-            g_queue_pop_tail (priv->cached_matches);
-
-          g_hash_table_remove (priv->cache_hash, old_entry->style_string);
-          mx_style_cache_entry_free (old_entry, TRUE);
-        }
+      mx_style_cache_shrink (style);
 
-      MX_NOTE (STYLE_CACHE, "(%p) Cache size: %d, (Max-size: %d)",
+      MX_NOTE (STYLE_CACHE, "(%p) Cache size: %d, %" G_GSIZE_FORMAT
+               " bytes (Budget: %" G_GSIZE_FORMAT " bytes)",
                style, g_queue_get_length (priv->cached_matches),
-               priv->alive_stylables * MX_STYLE_CACHE_SIZE);
+               priv->cache_bytes, priv->cache_budget);
+    }
+
+  /* make the result available to stylables sharing this key */
+  _mx_style_key_set_properties (key, priv->serial, priv->age,
+                                entry->properties);
+
+  return g_hash_table_ref (entry->properties);
+}
+
+/* Returns the style sheet properties that apply to @stylable, or %NULL if
+ * @style has no style sheet. The returned table is shared by all the
+ * stylables with the same style key, and should be unreferenced with
+ * g_hash_table_unref().
+ */
+GHashTable *
+_mx_style_get_properties (MxStyle    *style,
+                          MxStylable *stylable)
+{
+  if (!style->priv->stylesheet)
+    return NULL;
+
+  return mx_style_get_style_sheet_properties (style, stylable);
+}
+
+/* Returns whether the change of @stylable's own state (its id, class or
+ * pseudo-class) from @old_key to @new_key could change the style of any of
+ * its descendants, so that they only need restyling if it does.
+ */
+gboolean
+_mx_style_change_affects_descendants (MxStyle    *style,
+                                      MxStyleKey *old_key,
+                                      MxStyleKey *new_key)
+{
+  MxStylePrivate *priv = style->priv;
+
+  if (!priv->stylesheet)
+    return FALSE;
+
+  return mx_style_sheet_change_affects_descendants (priv->stylesheet,
+                                                    old_key, new_key);
+}
+
+/**
+ * mx_style_set_cache_budget:
+ * @style: a #MxStyle
+ * @bytes: the maximum amount of memory used by the style cache, in bytes
+ *
+ * Sets the amount of memory @style may use to cache the style properties
+ * matched for each kind of stylable. When the cache grows beyond @bytes, the
+ * least recently used entries are evicted.
+ *
+ * Since: 1.6
+ */
+void
+mx_style_set_cache_budget (MxStyle *style,
+                           gsize    bytes)
+{
+  MxStylePrivate *priv;
+
+  g_return_if_fail (MX_IS_STYLE (style));
+
+  priv = style->priv;
+
+  if (priv->cache_budget != bytes)
+    {
+      priv->cache_budget = bytes;
+      mx_style_cache_shrink (style);
     }
+}
+
+/**
+ * mx_style_get_cache_budget:
+ * @style: a #MxStyle
+ *
+ * Gets the amount of memory @style may use to cache style properties. See
+ * mx_style_set_cache_budget().
+ *
+ * Returns: the style cache budget, in bytes
+ *
+ * Since: 1.6
+ */
+gsize
+mx_style_get_cache_budget (MxStyle *style)
+{
+  g_return_val_if_fail (MX_IS_STYLE (style), 0);
 
-  return entry->properties ? g_hash_table_ref (entry->properties) : NULL;
+  return style->priv->cache_budget;
+}
+
+/**
+ * mx_style_get_cache_stats:
+ * @style: a #MxStyle
+ * @hits: (out) (allow-none): return location for the number of cache hits
+ * @misses: (out) (allow-none): return location for the number of cache misses
+ * @evictions: (out) (allow-none): return location for the number of entries
+ *   evicted to keep the cache within its budget
+ * @bytes: (out) (allow-none): return location for the amount of memory
+ *   currently used by the cache, in bytes
+ *
+ * Retrieves statistics about the style property cache of @style, to help
+ * tune its budget with mx_style_set_cache_budget().
+ *
+ * Since: 1.6
+ */
+void
+mx_style_get_cache_stats (MxStyle *style,
+                          guint   *hits,
+                          guint   *misses,
+                          guint   *evictions,
+                          gsize   *bytes)
+{
+  MxStylePrivate *priv;
+
+  g_return_if_fail (MX_IS_STYLE (style));
+
+  priv = style->priv;
+
+  if (hits)
+    *hits = priv->cache_hits;
+  if (misses)
+    *misses = priv->cache_misses;
+  if (evictions)
+    *evictions = priv->cache_evictions;
+  if (bytes)
+    *bytes = priv->cache_bytes;
 }
 
 /**
@@ -685,7 +842,11 @@ mx_style_get_property (MxStyle    *style,
           mx_stylable_get_default_value (stylable, pspec->name, value);
         }
       else
-        mx_style_transform_css_value (css_value, stylable, pspec, value);
+        {
+          g_value_init (value, pspec->value_type);
+          g_value_copy (mx_style_get_css_value (css_value, stylable, pspec),
+                        value);
+        }
 
       g_hash_table_unref (properties);
     }
@@ -750,7 +911,12 @@ mx_style_get_valist (MxStyle     *style,
               mx_stylable_get_default_value (stylable, pspec->name, &value);
             }
           else
-            mx_style_transform_css_value (css_value, stylable, pspec, &value);
+            {
+              g_value_init (&value, pspec->value_type);
+              g_value_copy (mx_style_get_css_value (css_value, stylable,
+                                                    pspec),
+                            &value);
+            }
 
           G_VALUE_LCOPY (&value, va_args, 0, &error);
 
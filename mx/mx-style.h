@@ -101,6 +101,15 @@ void     mx_style_get_valist     (MxStyle      *style,
                                   const gchar  *first_property_name,
                                   va_list       va_args);
 
+void     mx_style_set_cache_budget (MxStyle *style,
+                                    gsize    bytes);
+gsize    mx_style_get_cache_budget (MxStyle *style);
+void     mx_style_get_cache_stats  (MxStyle *style,
+                                    guint   *hits,
+                                    guint   *misses,
+                                    guint   *evictions,
+                                    gsize   *bytes);
+
 G_END_DECLS
 
 #endif /* __MX_STYLE_H__ */
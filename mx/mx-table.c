@@ -112,6 +112,9 @@ struct _MxTablePrivate
   GArray *rows;
 
   MxFocusable *last_focus;
+
+  /* the children by position, built when painting */
+  MxChildIndex *child_index;
 };
 
 static void mx_container_iface_init (ClutterContainerIface *iface);
@@ -414,6 +417,18 @@ mx_focusable_iface_init (MxFocusableIface *iface)
   iface->accept_focus = mx_table_accept_focus;
 }
 
+static void
+mx_table_clear_child_index (MxTable *table)
+{
+  MxTablePrivate *priv = table->priv;
+
+  if (priv->child_index)
+    {
+      _mx_child_index_free (priv->child_index);
+      priv->child_index = NULL;
+    }
+}
+
 /*
  * ClutterContainer Implementation
  */
@@ -426,6 +441,7 @@ mx_container_add_actor (ClutterContainer *container,
   clutter_actor_set_parent (actor, CLUTTER_ACTOR (container));
 
   priv->children = g_list_append (priv->children, actor);
+  mx_table_clear_child_index (MX_TABLE (container));
 
   /* default position of the actor is 0, 0 */
   _mx_table_update_row_col (MX_TABLE (container), 0, 0);
@@ -462,6 +478,7 @@ mx_container_remove_actor (ClutterContainer *container,
     priv->last_focus = NULL;
 
   priv->children = g_list_delete_link (priv->children, item);
+  mx_table_clear_child_index (MX_TABLE (container));
   clutter_actor_unparent (actor);
 
   /* update row/column count */
@@ -528,6 +545,7 @@ mx_container_lower (ClutterContainer *container,
 
   priv->children = g_list_delete_link (priv->children, actor_link);
   priv->children = g_list_insert_before (priv->children, position, actor);
+  mx_table_clear_child_index (MX_TABLE (container));
 
   clutter_actor_queue_redraw (CLUTTER_ACTOR (container));
 }
@@ -565,6 +583,7 @@ mx_container_raise (ClutterContainer *container,
 
   priv->children = g_list_delete_link (priv->children, actor_link);
   priv->children = g_list_insert (priv->children, actor, position);
+  mx_table_clear_child_index (MX_TABLE (container));
 
   clutter_actor_queue_redraw (CLUTTER_ACTOR (container));
 }
@@ -590,6 +609,7 @@ mx_container_sort_depth_order (ClutterContainer *container)
   MxTablePrivate *priv = MX_TABLE (container)->priv;
 
   priv->children = g_list_sort (priv->children, mx_table_depth_sort_cb);
+  mx_table_clear_child_index (MX_TABLE (container));
 
   clutter_actor_queue_redraw (CLUTTER_ACTOR (container));
 }
@@ -699,6 +719,7 @@ mx_table_finalize (GObject *gobject)
 
   g_array_free (priv->columns, TRUE);
   g_array_free (priv->rows, TRUE);
+  mx_table_clear_child_index (MX_TABLE (gobject));
 
   G_OBJECT_CLASS (mx_table_parent_class)->finalize (gobject);
 }
@@ -1454,6 +1475,8 @@ mx_table_allocate (ClutterActor          *self,
 
   CLUTTER_ACTOR_CLASS (mx_table_parent_class)->allocate (self, box, flags);
 
+  mx_table_clear_child_index (MX_TABLE (self));
+
   if (priv->n_cols < 1 || priv->n_rows < 1)
     {
       return;
@@ -1549,21 +1572,61 @@ mx_table_get_preferred_height (ClutterActor *self,
     *natural_height_p = total_pref_height;
 }
 
+/* Paints the children that aren't clipped away. MxTable doesn't scroll by
+ * itself, so only a clip can hide some of its children; the index of the
+ * children by position then finds the rows inside the clip. */
+static void
+mx_table_paint_children (MxTable *table)
+{
+  MxTablePrivate *priv = table->priv;
+  ClutterActor *self = CLUTTER_ACTOR (table);
+  ClutterActorBox clip_b;
+  GList *list;
+
+  if (clutter_actor_has_clip (self))
+    {
+      gfloat x, y, width, height;
+
+      clutter_actor_get_clip (self, &x, &y, &width, &height);
+      clip_b.x1 = x;
+      clip_b.y1 = y;
+      clip_b.x2 = x + width;
+      clip_b.y2 = y + height;
+    }
+  else if (clutter_actor_get_clip_to_allocation (self))
+    {
+      clip_b.x1 = 0;
+      clip_b.y1 = 0;
+      clutter_actor_get_size (self, &clip_b.x2, &clip_b.y2);
+    }
+  else
+    {
+      for (list = priv->children; list; list = g_list_next (list))
+        {
+          ClutterActor *child = CLUTTER_ACTOR (list->data);
+          if (CLUTTER_ACTOR_IS_VISIBLE (child))
+            clutter_actor_paint (child);
+        }
+
+      return;
+    }
+
+  if (!priv->child_index)
+    priv->child_index = _mx_child_index_new (priv->children,
+                                             MX_ORIENTATION_VERTICAL);
+
+  _mx_child_index_paint (priv->child_index, &clip_b);
+}
+
 static void
 mx_table_paint (ClutterActor *self)
 {
   MxTablePrivate *priv = MX_TABLE (self)->priv;
-  GList *list;
 
   /* make sure the background gets painted first */
   CLUTTER_ACTOR_CLASS (mx_table_parent_class)->paint (self);
 
-  for (list = priv->children; list; list = g_list_next (list))
-    {
-      ClutterActor *child = CLUTTER_ACTOR (list->data);
-      if (CLUTTER_ACTOR_IS_VISIBLE (child))
-        clutter_actor_paint (child);
-    }
+  mx_table_paint_children (MX_TABLE (self));
 
   if (_mx_debug (MX_DEBUG_LAYOUT))
     {
@@ -1605,17 +1668,10 @@ static void
 mx_table_pick (ClutterActor       *self,
                const ClutterColor *color)
 {
-  MxTablePrivate *priv = MX_TABLE (self)->priv;
-  GList *list;
-
   /* Chain up so we get a bounding box painted (if we are reactive) */
   CLUTTER_ACTOR_CLASS (mx_table_parent_class)->pick (self, color);
 
-  for (list = priv->children; list; list = g_list_next (list))
-    {
-      if (CLUTTER_ACTOR_IS_VISIBLE (list->data))
-        clutter_actor_paint (CLUTTER_ACTOR (list->data));
-    }
+  mx_table_paint_children (MX_TABLE (self));
 }
 
 static void
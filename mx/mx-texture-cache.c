@@ -37,8 +37,12 @@
 #include <glib-object.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 
 #include "mx-texture-cache.h"
+#include "mx-image-cache.h"
 #include "mx-marshal.h"
 #include "mx-private.h"
 
@@ -47,12 +51,37 @@ G_DEFINE_TYPE (MxTextureCache, mx_texture_cache, G_TYPE_OBJECT)
 #define TEXTURE_CACHE_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), MX_TYPE_TEXTURE_CACHE, MxTextureCachePrivate))
 
+/* Milliseconds of texture uploading allowed per main loop iteration, and
+ * the number of bytes uploaded in one go */
+#define MX_TEXTURE_CACHE_UPLOAD_SLICE 5
+#define MX_TEXTURE_CACHE_UPLOAD_CHUNK (256 * 1024)
+
+/* The default amount of texel data the cache keeps alive on its own */
+#define MX_TEXTURE_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+/* The number of absolute paths whose URI is remembered */
+#define MX_TEXTURE_CACHE_MAX_KEYS 256
+
 typedef struct _MxTextureCachePrivate MxTextureCachePrivate;
 
 struct _MxTextureCachePrivate
 {
-  GHashTable *cache;
-  GRegex     *is_uri;
+  GHashTable  *cache;
+  GHashTable  *keys;
+
+  GThreadPool *decode_pool;
+  GHashTable  *loads;
+  guint        last_load_id;
+  gpointer     finishing_load;
+  GQueue       uploads;
+  GTimer      *upload_timer;
+  guint        upload_id;
+
+  GQueue       lru;
+  gsize        budget;
+  gsize        usage;
+
+  GHashTable  *image_caches;
 };
 
 typedef struct FinalizedClosure
@@ -68,15 +97,53 @@ enum
 
 static MxTextureCache* __cache_singleton = NULL;
 
-/*
- * Convention: posX with a value of -1 indicates whole texture
+/* An asynchronous load of one URI. The decoding thread only touches
+ * @pixbuf and @error, everything else belongs to the main thread. Further
+ * requests for the same URI while it is in flight are added to @closures.
+ */
+typedef struct
+{
+  MxTextureCache *cache;
+  gchar          *uri;
+  gchar          *filename;
+  GSList         *closures;
+
+  GdkPixbuf      *pixbuf;
+  GError         *error;
+
+  CoglHandle      texture;
+  gint            row;
+} MxTextureCacheLoad;
+
+/* @callback is cleared when the request is cancelled */
+typedef struct
+{
+  MxTextureCacheLoadCallback callback;
+  gpointer                   user_data;
+  guint                      id;
+} MxTextureCacheLoadClosure;
+
+/* The cache owns a reference on @ptr and on the textures in @meta, which
+ * are accounted for in @size. Items owning anything are kept in the LRU
+ * queue through @lru, most recently used first.
+ *
+ * When an item is evicted its meta textures are dropped, but @ptr is only
+ * weakly held (@weak is set) until the last reference to it goes away, so a
+ * texture that is still being used by an actor is found again rather than
+ * loaded twice.
  */
 typedef struct MxTextureCacheItem {
-  char          filename[256];
-  int           width, height;
-  int           posX, posY;
-  CoglHandle    ptr;
-  GHashTable   *meta;
+  MxTextureCache  *cache;
+  const gchar     *uri;
+
+  CoglHandle       ptr;
+  GHashTable      *meta;
+
+  gsize            size;
+  guint            pinned;
+  guint            weak : 1;
+  GList            lru;
+  CoglUserDataKey  weak_key;
 } MxTextureCacheItem;
 
 typedef struct
@@ -86,16 +153,46 @@ typedef struct
   GDestroyNotify  destroy_func;
 } MxTextureCacheMetaEntry;
 
+/*
+ * The layout of the entries written by mx-create-image-cache before
+ * mx-image-cache.h. The first entry names the atlas image and the others
+ * give the absolute path of each image and its place in the atlas.
+ */
+typedef struct {
+  char          filename[256];
+  int           width, height;
+  int           posX, posY;
+  void         *ptr;
+} MxTextureCacheFileItem;
+
 static MxTextureCacheItem *
-mx_texture_cache_item_new (void)
+mx_texture_cache_item_new (MxTextureCache *self)
 {
-  return g_slice_new0 (MxTextureCacheItem);
+  MxTextureCacheItem *item = g_slice_new0 (MxTextureCacheItem);
+
+  item->cache = self;
+  item->lru.data = item;
+
+  return item;
 }
 
 static void
 mx_texture_cache_item_free (MxTextureCacheItem *item)
 {
-  if (item->ptr)
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (item->cache);
+
+  if (item->lru.prev || priv->lru.head == &item->lru)
+    g_queue_unlink (&priv->lru, &item->lru);
+  priv->usage -= item->size;
+
+  if (item->weak)
+    {
+      /* Replacing the user data calls mx_texture_cache_texture_destroyed(),
+       * which ignores items that aren't weak. */
+      item->weak = FALSE;
+      cogl_object_set_user_data (item->ptr, &item->weak_key, NULL, NULL);
+    }
+  else if (item->ptr)
     cogl_handle_unref (item->ptr);
 
   if (item->meta)
@@ -104,6 +201,149 @@ mx_texture_cache_item_free (MxTextureCacheItem *item)
   g_slice_free (MxTextureCacheItem, item);
 }
 
+static gsize
+mx_texture_cache_texture_size (CoglHandle texture)
+{
+  /* Drivers store nearly everything at four bytes per texel */
+  return (gsize) cogl_texture_get_width (texture) *
+    cogl_texture_get_height (texture) * 4;
+}
+
+/* Recomputes the memory owned by @item and whether it belongs in the LRU
+ * queue. */
+static void
+mx_texture_cache_item_update (MxTextureCacheItem *item)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (item->cache);
+  gboolean in_lru;
+  gsize size = 0;
+
+  if (item->ptr && !item->weak)
+    size += mx_texture_cache_texture_size (item->ptr);
+
+  if (item->meta)
+    {
+      MxTextureCacheMetaEntry *entry;
+      GHashTableIter iter;
+
+      g_hash_table_iter_init (&iter, item->meta);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+        size += mx_texture_cache_texture_size (entry->texture);
+    }
+
+  priv->usage = priv->usage - item->size + size;
+  item->size = size;
+
+  in_lru = (item->lru.prev || priv->lru.head == &item->lru);
+  if (in_lru && !item->meta && (!item->ptr || item->weak))
+    g_queue_unlink (&priv->lru, &item->lru);
+  else if (!in_lru && (item->meta || (item->ptr && !item->weak)))
+    g_queue_push_head_link (&priv->lru, &item->lru);
+}
+
+static void
+mx_texture_cache_texture_destroyed (void *user_data)
+{
+  MxTextureCacheItem *item = user_data;
+  MxTextureCachePrivate *priv;
+
+  if (!item->weak)
+    return;
+
+  item->weak = FALSE;
+  item->ptr = NULL;
+
+  if (!item->meta && !item->pinned)
+    {
+      priv = TEXTURE_CACHE_PRIVATE (item->cache);
+      g_hash_table_remove (priv->cache, item->uri);
+    }
+}
+
+/* Drops everything the cache owns in @item. @item may be freed. */
+static void
+mx_texture_cache_evict (MxTextureCacheItem *item)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (item->cache);
+  CoglHandle texture = NULL;
+
+  MX_NOTE (TEXTURE_CACHE, "Evicting '%s' (%" G_GSIZE_FORMAT " bytes)",
+           item->uri, item->size);
+
+  if (item->meta)
+    {
+      g_hash_table_unref (item->meta);
+      item->meta = NULL;
+    }
+
+  /* Watch for the texture going away rather than forgetting it */
+  if (item->ptr && !item->weak)
+    {
+      texture = item->ptr;
+      item->weak = TRUE;
+      cogl_object_set_user_data (texture, &item->weak_key, item,
+                                 mx_texture_cache_texture_destroyed);
+    }
+
+  mx_texture_cache_item_update (item);
+
+  /* The cache's reference may be the last one, which frees the item */
+  if (texture)
+    cogl_handle_unref (texture);
+  else if (!item->ptr && !item->pinned)
+    g_hash_table_remove (priv->cache, item->uri);
+}
+
+/* Evicts the least recently used items that aren't pinned until the cache
+ * fits in @budget, keeping the most recently used item if @keep_head */
+static void
+mx_texture_cache_shrink (MxTextureCache *self,
+                         gsize           budget,
+                         gboolean        keep_head)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  GList *l, *prev;
+
+  for (l = priv->lru.tail; l && priv->usage > budget; l = prev)
+    {
+      MxTextureCacheItem *item = l->data;
+
+      prev = l->prev;
+
+      if (keep_head && !prev)
+        break;
+
+      if (!item->pinned)
+        mx_texture_cache_evict (item);
+    }
+}
+
+/* Takes back a reference on an evicted texture that is still alive */
+static void
+mx_texture_cache_item_take (MxTextureCacheItem *item)
+{
+  if (!item->weak)
+    return;
+
+  item->weak = FALSE;
+  cogl_handle_ref (item->ptr);
+  cogl_object_set_user_data (item->ptr, &item->weak_key, NULL, NULL);
+}
+
+/* Marks @item as the most recently used and evicts whatever no longer
+ * fits in the budget */
+static void
+mx_texture_cache_item_touch (MxTextureCacheItem *item)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (item->cache);
+
+  if (item->lru.prev || priv->lru.head == &item->lru)
+    g_queue_unlink (&priv->lru, &item->lru);
+  mx_texture_cache_item_update (item);
+
+  mx_texture_cache_shrink (item->cache, priv->budget, TRUE);
+}
+
 static void
 mx_texture_cache_set_property (GObject      *object,
                                guint         prop_id,
@@ -147,8 +387,16 @@ mx_texture_cache_finalize (GObject *object)
   if (priv->cache)
     g_hash_table_unref (priv->cache);
 
-  if (priv->is_uri)
-    g_regex_unref (priv->is_uri);
+  g_hash_table_unref (priv->keys);
+
+  /* Loads hold a reference on the cache, so nothing is in flight here */
+  if (priv->decode_pool)
+    g_thread_pool_free (priv->decode_pool, FALSE, TRUE);
+
+  g_hash_table_unref (priv->loads);
+  g_timer_destroy (priv->upload_timer);
+
+  g_hash_table_unref (priv->image_caches);
 
   G_OBJECT_CLASS (mx_texture_cache_parent_class)->finalize (object);
 }
@@ -170,17 +418,24 @@ mx_texture_cache_class_init (MxTextureCacheClass *klass)
 static void
 mx_texture_cache_init (MxTextureCache *self)
 {
-  GError *error = NULL;
   MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE(self);
 
   priv->cache =
     g_hash_table_new_full (g_str_hash, g_str_equal,
                            g_free, (GDestroyNotify)mx_texture_cache_item_free);
 
-  priv->is_uri = g_regex_new ("^([a-zA-Z0-9+.-]+)://.*",
-                              G_REGEX_OPTIMIZE, 0, &error);
-  if (!priv->is_uri)
-    g_error (G_STRLOC ": Unable to compile regex: %s", error->message);
+  priv->keys = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                      g_free, g_free);
+
+  priv->loads = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&priv->uploads);
+  priv->upload_timer = g_timer_new ();
+
+  g_queue_init (&priv->lru);
+  priv->budget = MX_TEXTURE_CACHE_DEFAULT_BUDGET;
+
+  priv->image_caches = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
 }
 
 /**
@@ -231,6 +486,97 @@ mx_texture_cache_get_size (MxTextureCache *self)
   return g_hash_table_size (priv->cache);
 }
 
+/**
+ * mx_texture_cache_set_memory_budget:
+ * @self: A #MxTextureCache
+ * @bytes: The amount of texture data the cache may keep, in bytes
+ *
+ * Sets the amount of texture memory the cache may hold on to. When it
+ * holds more than @bytes, the least recently used images that aren't
+ * pinned are released. An image that is still in use elsewhere stays
+ * in the cache until the last reference to it is dropped.
+ *
+ * The default budget is 64MiB.
+ *
+ * Since: 1.6
+ */
+void
+mx_texture_cache_set_memory_budget (MxTextureCache *self,
+                                    gsize           bytes)
+{
+  MxTextureCachePrivate *priv;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  if (priv->budget != bytes)
+    {
+      priv->budget = bytes;
+      mx_texture_cache_shrink (self, bytes, TRUE);
+    }
+}
+
+/**
+ * mx_texture_cache_get_memory_budget:
+ * @self: A #MxTextureCache
+ *
+ * Gets the amount of texture memory the cache may hold on to. See
+ * mx_texture_cache_set_memory_budget().
+ *
+ * Returns: the memory budget, in bytes
+ *
+ * Since: 1.6
+ */
+gsize
+mx_texture_cache_get_memory_budget (MxTextureCache *self)
+{
+  g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), 0);
+
+  return TEXTURE_CACHE_PRIVATE (self)->budget;
+}
+
+/**
+ * mx_texture_cache_get_memory_usage:
+ * @self: A #MxTextureCache
+ *
+ * Gets the amount of texture memory currently held by the cache. This is
+ * estimated as four bytes per texel.
+ *
+ * Returns: the memory used by the cache, in bytes
+ *
+ * Since: 1.6
+ */
+gsize
+mx_texture_cache_get_memory_usage (MxTextureCache *self)
+{
+  g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), 0);
+
+  return TEXTURE_CACHE_PRIVATE (self)->usage;
+}
+
+/**
+ * mx_texture_cache_release_unused:
+ * @self: A #MxTextureCache
+ *
+ * Releases every image held by the cache that isn't pinned, regardless
+ * of the memory budget. Images still in use elsewhere are kept until they
+ * are no longer needed. This is meant to be called when the system is low
+ * on memory.
+ *
+ * Since: 1.6
+ */
+void
+mx_texture_cache_release_unused (MxTextureCache *self)
+{
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+
+  mx_texture_cache_shrink (self, 0, FALSE);
+
+  MX_NOTE (TEXTURE_CACHE, "%" G_GSIZE_FORMAT " bytes left after release",
+           TEXTURE_CACHE_PRIVATE (self)->usage);
+}
+
 static void
 add_texture_to_cache (MxTextureCache     *self,
                       const gchar        *uri,
@@ -238,8 +584,12 @@ add_texture_to_cache (MxTextureCache     *self,
 {
   /*  FinalizedClosure        *closure; */
   MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE(self);
+  gchar *key = g_strdup (uri);
 
-  g_hash_table_insert (priv->cache, g_strdup (uri), item);
+  /* Replace rather than insert, so the key is the item's own URI */
+  item->uri = key;
+  g_hash_table_replace (priv->cache, key, item);
+  mx_texture_cache_item_touch (item);
 
 #if 0
   /* Make sure we can remove from hash */
@@ -295,6 +645,59 @@ mx_texture_cache_filename_to_uri (const gchar *file)
   return uri;
 }
 
+/* Whether @str starts with a URI scheme followed by "://" */
+static gboolean
+mx_texture_cache_is_uri (const gchar *str)
+{
+  const gchar *p;
+
+  p = str;
+  while (g_ascii_isalnum (*p) || *p == '+' || *p == '.' || *p == '-')
+    p++;
+
+  return (p != str) && p[0] == ':' && p[1] == '/' && p[2] == '/';
+}
+
+/* Returns the key @uri is cached under, where @uri can also be a path.
+ * The URIs of absolute paths are remembered so that looking them up again
+ * doesn't allocate. A key that isn't remembered is returned in @new_uri
+ * and has to be freed. */
+static const gchar *
+mx_texture_cache_get_key (MxTextureCache  *self,
+                          const gchar     *uri,
+                          gchar          **new_uri)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  gchar *key;
+
+  *new_uri = NULL;
+
+  if (mx_texture_cache_is_uri (uri))
+    return uri;
+
+  key = g_hash_table_lookup (priv->keys, uri);
+  if (key)
+    return key;
+
+  key = mx_texture_cache_filename_to_uri (uri);
+  if (!key)
+    return NULL;
+
+  /* Relative paths depend on the current directory */
+  if (!g_path_is_absolute (uri))
+    {
+      *new_uri = key;
+      return key;
+    }
+
+  if (g_hash_table_size (priv->keys) >= MX_TEXTURE_CACHE_MAX_KEYS)
+    g_hash_table_remove_all (priv->keys);
+
+  g_hash_table_insert (priv->keys, g_strdup (uri), key);
+
+  return key;
+}
+
 static gchar *
 mx_texture_cache_uri_to_filename (const gchar *uri)
 {
@@ -316,48 +719,42 @@ mx_texture_cache_get_item (MxTextureCache *self,
   MxTextureCachePrivate *priv;
   MxTextureCacheItem *item;
   gchar *new_file, *new_uri;
-  const gchar *file = NULL;
+  const gchar *key, *file;
 
   priv = TEXTURE_CACHE_PRIVATE (self);
 
-  /* Make sure we have the URI (and the path if we're loading) */
-  new_file = new_uri = NULL;
+  key = mx_texture_cache_get_key (self, uri, &new_uri);
+  if (!key)
+    return NULL;
+
+  new_file = NULL;
+  item = g_hash_table_lookup (priv->cache, key);
 
-  if (g_regex_match (priv->is_uri, uri, 0, NULL))
+  if ((!item || !item->ptr) && create_if_not_exists)
     {
-      if (create_if_not_exists)
+      gboolean created;
+      GError *err = NULL;
+
+      /* Only work out the path when there's something to load */
+      if (key == uri)
         {
           file = new_file = mx_texture_cache_uri_to_filename (uri);
           if (!new_file)
             return NULL;
         }
-    }
-  else
-    {
-      file = uri;
-      uri = new_uri = mx_texture_cache_filename_to_uri (file);
-      if (!new_uri)
-        return NULL;
-    }
-
-  item = g_hash_table_lookup (priv->cache, uri);
-
-  if ((!item || !item->ptr) && create_if_not_exists)
-    {
-      gboolean created;
-      GError *err = NULL;
+      else
+        file = uri;
 
       if (!item)
         {
-          item = mx_texture_cache_item_new ();
+          item = mx_texture_cache_item_new (self);
           created = TRUE;
         }
       else
         created = FALSE;
 
       item->ptr = cogl_texture_new_from_file (file, COGL_TEXTURE_NONE,
-                                              COGL_PIXEL_FORMAT_ANY,
-                                              &err);
+                                              COGL_PIXEL_FORMAT_ANY, &err);
 
       if (!item->ptr)
         {
@@ -377,7 +774,14 @@ mx_texture_cache_get_item (MxTextureCache *self,
         }
 
       if (created)
-        add_texture_to_cache (self, uri, item);
+        add_texture_to_cache (self, key, item);
+      else
+        mx_texture_cache_item_touch (item);
+    }
+  else if (item && create_if_not_exists)
+    {
+      mx_texture_cache_item_take (item);
+      mx_texture_cache_item_touch (item);
     }
 
   g_free (new_file);
@@ -501,17 +905,18 @@ mx_texture_cache_get_meta_texture (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  item = mx_texture_cache_get_item (self, uri, FALSE);
 
   if (item && item->meta)
     {
       MxTextureCacheMetaEntry *entry = g_hash_table_lookup (item->meta, ident);
 
-      if (entry->texture)
+      if (entry && entry->texture)
         {
           ClutterActor *texture = clutter_texture_new ();
           clutter_texture_set_cogl_texture ((ClutterTexture*) texture,
                                             entry->texture);
+          mx_texture_cache_item_touch (item);
           return (ClutterTexture *)texture;
         }
     }
@@ -545,14 +950,19 @@ mx_texture_cache_get_meta_cogl_texture (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  item = mx_texture_cache_get_item (self, uri, FALSE);
 
   if (item && item->meta)
     {
       MxTextureCacheMetaEntry *entry = g_hash_table_lookup (item->meta, ident);
 
-      if (entry->texture)
-        return cogl_handle_ref (entry->texture);
+      if (entry && entry->texture)
+        {
+          CoglHandle texture = cogl_handle_ref (entry->texture);
+
+          mx_texture_cache_item_touch (item);
+          return texture;
+        }
     }
 
   return NULL;
@@ -574,10 +984,14 @@ gboolean
 mx_texture_cache_contains (MxTextureCache *self,
                            const gchar    *uri)
 {
+  MxTextureCacheItem *item;
+
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), FALSE);
   g_return_val_if_fail (uri != NULL, FALSE);
 
-  return mx_texture_cache_get_item (self, uri, FALSE) ? TRUE : FALSE;
+  item = mx_texture_cache_get_item (self, uri, FALSE);
+
+  return (item && (item->ptr || item->meta));
 }
 
 /**
@@ -643,14 +1057,11 @@ mx_texture_cache_insert (MxTextureCache *self,
   priv = TEXTURE_CACHE_PRIVATE (self);
 
   /* Transform path to URI, if necessary */
-  if (!g_regex_match (priv->is_uri, uri, 0, NULL))
-    {
-      uri = new_uri = mx_texture_cache_filename_to_uri (uri);
-      if (!new_uri)
-        return;
-    }
+  uri = mx_texture_cache_get_key (self, uri, &new_uri);
+  if (!uri)
+    return;
 
-  item = mx_texture_cache_item_new ();
+  item = mx_texture_cache_item_new (self);
   item->ptr = cogl_handle_ref (texture);
   add_texture_to_cache (self, uri, item);
 
@@ -706,17 +1117,14 @@ mx_texture_cache_insert_meta (MxTextureCache *self,
   priv = TEXTURE_CACHE_PRIVATE (self);
 
   /* Transform path to URI, if necessary */
-  if (!g_regex_match (priv->is_uri, uri, 0, NULL))
-    {
-      uri = new_uri = mx_texture_cache_filename_to_uri (uri);
-      if (!new_uri)
-        return;
-    }
+  uri = mx_texture_cache_get_key (self, uri, &new_uri);
+  if (!uri)
+    return;
 
   item = mx_texture_cache_get_item (self, uri, FALSE);
   if (!item)
     {
-      item = mx_texture_cache_item_new ();
+      item = mx_texture_cache_item_new (self);
       add_texture_to_cache (self, uri, item);
     }
 
@@ -732,33 +1140,493 @@ mx_texture_cache_insert_meta (MxTextureCache *self,
   entry->destroy_func = destroy_func;
 
   g_hash_table_insert (item->meta, ident, entry);
+
+  mx_texture_cache_item_touch (item);
 }
 
+/**
+ * mx_texture_cache_pin:
+ * @self: A #MxTextureCache
+ * @uri: A URI or local file path
+ *
+ * Keeps the image at @uri, and any textures associated with it, in the
+ * cache regardless of the memory budget, until a matching call to
+ * mx_texture_cache_unpin(). The image doesn't need to have been loaded
+ * yet. This is useful for images that are used throughout an application,
+ * such as those of its theme.
+ *
+ * Since: 1.6
+ */
 void
-mx_texture_cache_load_cache (MxTextureCache *self,
-                             const gchar    *filename)
+mx_texture_cache_pin (MxTextureCache *self,
+                      const gchar    *uri)
+{
+  MxTextureCacheItem *item;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+  g_return_if_fail (uri != NULL);
+
+  item = mx_texture_cache_get_item (self, uri, FALSE);
+  if (!item)
+    {
+      gchar *new_uri = NULL;
+
+      /* Transform path to URI, if necessary */
+      uri = mx_texture_cache_get_key (self, uri, &new_uri);
+      if (!uri)
+        return;
+
+      item = mx_texture_cache_item_new (self);
+      add_texture_to_cache (self, uri, item);
+
+      g_free (new_uri);
+    }
+
+  item->pinned ++;
+}
+
+/**
+ * mx_texture_cache_unpin:
+ * @self: A #MxTextureCache
+ * @uri: A URI or local file path
+ *
+ * Reverses the effect of a previous call to mx_texture_cache_pin().
+ *
+ * Since: 1.6
+ */
+void
+mx_texture_cache_unpin (MxTextureCache *self,
+                        const gchar    *uri)
+{
+  MxTextureCachePrivate *priv;
+  MxTextureCacheItem *item;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+  g_return_if_fail (uri != NULL);
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  item = mx_texture_cache_get_item (self, uri, FALSE);
+  if (!item || !item->pinned)
+    {
+      g_warning (G_STRLOC ": '%s' is not pinned", uri);
+      return;
+    }
+
+  if (--item->pinned)
+    return;
+
+  if (!item->ptr && !item->meta)
+    g_hash_table_remove (priv->cache, item->uri);
+  else
+    mx_texture_cache_shrink (self, priv->budget, TRUE);
+}
+
+static void
+mx_texture_cache_load_free (MxTextureCacheLoad *load)
+{
+  GSList *c;
+
+  for (c = load->closures; c; c = c->next)
+    g_slice_free (MxTextureCacheLoadClosure, c->data);
+  g_slist_free (load->closures);
+
+  if (load->pixbuf)
+    g_object_unref (load->pixbuf);
+
+  if (load->error)
+    g_error_free (load->error);
+
+  if (load->texture)
+    cogl_handle_unref (load->texture);
+
+  g_free (load->uri);
+  g_free (load->filename);
+  g_object_unref (load->cache);
+
+  g_slice_free (MxTextureCacheLoad, load);
+}
+
+static void
+mx_texture_cache_load_finish (MxTextureCacheLoad *load)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (load->cache);
+  CoglHandle texture = NULL;
+  GSList *c;
+
+  g_hash_table_remove (priv->loads, load->uri);
+
+  /* callbacks may cancel the requests that are still to be called back */
+  priv->finishing_load = load;
+
+  if (load->texture)
+    {
+      MxTextureCacheItem *item = g_hash_table_lookup (priv->cache, load->uri);
+
+      /* A synchronous load may have beaten us to it, in which case its
+       * texture is the one everyone else is already using.
+       */
+      if (!item)
+        {
+          item = mx_texture_cache_item_new (load->cache);
+          item->ptr = cogl_handle_ref (load->texture);
+          add_texture_to_cache (load->cache, load->uri, item);
+        }
+      else
+        {
+          if (!item->ptr)
+            item->ptr = cogl_handle_ref (load->texture);
+          else
+            mx_texture_cache_item_take (item);
+          mx_texture_cache_item_touch (item);
+        }
+
+      texture = cogl_handle_ref (item->ptr);
+    }
+
+  MX_NOTE (TEXTURE_CACHE, "Finished loading '%s' for %d request(s)",
+           load->uri, g_slist_length (load->closures));
+
+  /* Call back in the order the requests were made */
+  load->closures = g_slist_reverse (load->closures);
+  for (c = load->closures; c; c = c->next)
+    {
+      MxTextureCacheLoadClosure *closure = c->data;
+
+      if (closure->callback)
+        closure->callback (load->cache, load->uri, texture, load->error,
+                           closure->user_data);
+    }
+
+  priv->finishing_load = NULL;
+
+  if (texture)
+    cogl_handle_unref (texture);
+
+  mx_texture_cache_load_free (load);
+}
+
+/* Uploads the next band of rows of a decoded image, returning %TRUE when
+ * there is nothing left to upload.
+ */
+static gboolean
+mx_texture_cache_upload_chunk (MxTextureCacheLoad *load)
+{
+  gint width, height, rowstride, rows;
+  CoglPixelFormat format;
+  gboolean has_alpha;
+
+  width = gdk_pixbuf_get_width (load->pixbuf);
+  height = gdk_pixbuf_get_height (load->pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (load->pixbuf);
+  has_alpha = gdk_pixbuf_get_has_alpha (load->pixbuf);
+
+  format = has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888;
+
+  if (!load->texture)
+    {
+      /* Small images are uploaded in one go, which lets Cogl pack them
+       * into its shared atlas */
+      if (height * rowstride <= MX_TEXTURE_CACHE_UPLOAD_CHUNK)
+        {
+          load->texture =
+            cogl_texture_new_from_data (width, height, COGL_TEXTURE_NONE,
+                                        format, COGL_PIXEL_FORMAT_ANY,
+                                        rowstride,
+                                        gdk_pixbuf_get_pixels (load->pixbuf));
+          if (load->texture)
+            return TRUE;
+        }
+
+      load->texture =
+        cogl_texture_new_with_size (width, height, COGL_TEXTURE_NONE,
+                                    has_alpha ?
+                                    COGL_PIXEL_FORMAT_RGBA_8888_PRE :
+                                    COGL_PIXEL_FORMAT_RGB_888);
+
+      if (!load->texture)
+        {
+          g_set_error (&load->error, GDK_PIXBUF_ERROR,
+                       GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                       "Unable to create a %dx%d texture for '%s'",
+                       width, height, load->uri);
+          return TRUE;
+        }
+    }
+
+  rows = MAX (1, MX_TEXTURE_CACHE_UPLOAD_CHUNK / rowstride);
+  rows = MIN (rows, height - load->row);
+
+  cogl_texture_set_region (load->texture, 0, 0, 0, load->row,
+                           width, rows, width, rows, format, rowstride,
+                           gdk_pixbuf_get_pixels (load->pixbuf) +
+                           load->row * rowstride);
+
+  load->row += rows;
+
+  return (load->row >= height);
+}
+
+static gboolean
+mx_texture_cache_upload_cb (MxTextureCache *self)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  MxTextureCacheLoad *load;
+
+  g_timer_start (priv->upload_timer);
+
+  while ((load = g_queue_peek_head (&priv->uploads)))
+    {
+      if (mx_texture_cache_upload_chunk (load))
+        {
+          g_queue_pop_head (&priv->uploads);
+          mx_texture_cache_load_finish (load);
+        }
+
+      if (g_timer_elapsed (priv->upload_timer, NULL) * 1000 >=
+          MX_TEXTURE_CACHE_UPLOAD_SLICE)
+        break;
+    }
+
+  g_timer_stop (priv->upload_timer);
+
+  if (g_queue_is_empty (&priv->uploads))
+    {
+      priv->upload_id = 0;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+mx_texture_cache_decoded_cb (gpointer data)
+{
+  MxTextureCacheLoad *load = data;
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (load->cache);
+
+  if (!load->pixbuf)
+    {
+      mx_texture_cache_load_finish (load);
+      return FALSE;
+    }
+
+  /* Uploads run after the redraw, a slice at a time, so a large image is
+   * spread over several frames rather than stalling one.
+   */
+  g_queue_push_tail (&priv->uploads, load);
+
+  if (!priv->upload_id)
+    priv->upload_id =
+      clutter_threads_add_idle_full (G_PRIORITY_DEFAULT_IDLE,
+                                     (GSourceFunc)mx_texture_cache_upload_cb,
+                                     g_object_ref (load->cache),
+                                     g_object_unref);
+
+  return FALSE;
+}
+
+static void
+mx_texture_cache_decode_cb (gpointer task_data,
+                            gpointer user_data)
+{
+  MxTextureCacheLoad *load = task_data;
+
+  load->pixbuf = gdk_pixbuf_new_from_file (load->filename, &load->error);
+
+  clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
+                                 mx_texture_cache_decoded_cb, load, NULL);
+}
+
+/**
+ * mx_texture_cache_load_async:
+ * @self: A #MxTextureCache
+ * @uri: A URI or path to an image file
+ * @callback: (scope async): The function to call when the texture is ready
+ * @user_data: Data to pass to @callback
+ *
+ * Loads an image into the cache without blocking the main loop. The image
+ * is decoded in a worker thread and uploaded a little at a time between
+ * frames, after which @callback is called with the cached texture. Any
+ * other requests for the same image made while it is loading share the
+ * same decode.
+ *
+ * If the image is already in the cache, or can't be loaded, @callback is
+ * called before this function returns.
+ *
+ * Returns: an identifier to pass to mx_texture_cache_cancel_load(), or 0
+ *   if @callback has already been called
+ *
+ * Since: 1.6
+ */
+guint
+mx_texture_cache_load_async (MxTextureCache             *self,
+                             const gchar                *uri,
+                             MxTextureCacheLoadCallback  callback,
+                             gpointer                    user_data)
+{
+  MxTextureCacheLoadClosure *closure;
+  MxTextureCachePrivate *priv;
+  MxTextureCacheLoad *load;
+  MxTextureCacheItem *item;
+  gchar *new_uri, *filename;
+  GError *error = NULL;
+
+  g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), 0);
+  g_return_val_if_fail (uri != NULL, 0);
+  g_return_val_if_fail (callback != NULL, 0);
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  /* Transform path to URI, if necessary */
+  uri = mx_texture_cache_get_key (self, uri, &new_uri);
+  if (!uri)
+    return 0;
+
+  item = g_hash_table_lookup (priv->cache, uri);
+  if (item && item->ptr)
+    {
+      mx_texture_cache_item_take (item);
+      mx_texture_cache_item_touch (item);
+      callback (self, uri, item->ptr, NULL, user_data);
+      g_free (new_uri);
+      return 0;
+    }
+
+  closure = g_slice_new (MxTextureCacheLoadClosure);
+  closure->callback = callback;
+  closure->user_data = user_data;
+  closure->id = ++priv->last_load_id;
+  if (!closure->id)
+    closure->id = ++priv->last_load_id;
+
+  load = g_hash_table_lookup (priv->loads, uri);
+  if (load)
+    {
+      MX_NOTE (TEXTURE_CACHE, "Sharing in-flight load of '%s'", uri);
+      load->closures = g_slist_prepend (load->closures, closure);
+      g_free (new_uri);
+      return closure->id;
+    }
+
+  filename = g_filename_from_uri (uri, NULL, &error);
+
+  if (filename && !priv->decode_pool)
+    priv->decode_pool = g_thread_pool_new (mx_texture_cache_decode_cb, NULL,
+#ifdef _SC_NPROCESSORS_ONLN
+                                           sysconf (_SC_NPROCESSORS_ONLN),
+#else
+                                           1,
+#endif
+                                           FALSE, &error);
+
+  if (!filename || !priv->decode_pool)
+    {
+      callback (self, uri, NULL, error, user_data);
+      g_slice_free (MxTextureCacheLoadClosure, closure);
+      g_error_free (error);
+      g_free (filename);
+      g_free (new_uri);
+      return 0;
+    }
+
+  load = g_slice_new0 (MxTextureCacheLoad);
+  load->cache = g_object_ref (self);
+  load->uri = new_uri ? new_uri : g_strdup (uri);
+  load->filename = filename;
+  load->closures = g_slist_prepend (NULL, closure);
+
+  g_hash_table_insert (priv->loads, load->uri, load);
+  g_thread_pool_push (priv->decode_pool, load, NULL);
+
+  return closure->id;
+}
+
+static gboolean
+mx_texture_cache_load_cancel_closure (MxTextureCacheLoad *load,
+                                      guint               id)
+{
+  GSList *c;
+
+  for (c = load->closures; c; c = c->next)
+    {
+      MxTextureCacheLoadClosure *closure = c->data;
+
+      if (closure->id == id)
+        {
+          closure->callback = NULL;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * mx_texture_cache_cancel_load:
+ * @self: A #MxTextureCache
+ * @id: the identifier returned by mx_texture_cache_load_async()
+ *
+ * Cancels a request made with mx_texture_cache_load_async(), so that its
+ * callback is not called. Call this before the data passed to the callback
+ * is freed. The image itself is still loaded into the cache if other
+ * requests are waiting for it or its decoding has already started.
+ *
+ * Since: 1.6
+ */
+void
+mx_texture_cache_cancel_load (MxTextureCache *self,
+                              guint           id)
+{
+  MxTextureCachePrivate *priv;
+  GHashTableIter iter;
+  gpointer load;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  if (!id)
+    return;
+
+  if (priv->finishing_load &&
+      mx_texture_cache_load_cancel_closure (priv->finishing_load, id))
+    return;
+
+  g_hash_table_iter_init (&iter, priv->loads);
+  while (g_hash_table_iter_next (&iter, NULL, &load))
+    {
+      if (mx_texture_cache_load_cancel_closure (load, id))
+        return;
+    }
+}
+
+/* Reads an image cache in the format written by earlier versions of
+ * mx-create-image-cache */
+static void
+mx_texture_cache_load_legacy_cache (MxTextureCache *self,
+                                    const gchar    *filename)
 {
   FILE *file;
-  MxTextureCacheItem *element, head;
+  MxTextureCacheFileItem element, head;
+  MxTextureCacheItem *item;
   int ret;
   CoglHandle full_texture;
   MxTextureCachePrivate *priv;
 
-  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
-  g_return_if_fail (filename != NULL);
-
   priv = TEXTURE_CACHE_PRIVATE (self);
 
-  file = fopen(filename, "rm");
+  file = fopen (filename, "rm");
   if (!file)
     return;
 
-  ret = fread (&head, sizeof(MxTextureCacheItem), 1, file);
-  if (ret < 0)
+  ret = fread (&head, sizeof (MxTextureCacheFileItem), 1, file);
+  if (ret < 1)
     {
       fclose (file);
       return;
     }
+  head.filename[sizeof (head.filename) - 1] = '\0';
 
   /* check if we already if this texture in the cache */
   if (g_hash_table_lookup (priv->cache, head.filename))
@@ -777,44 +1645,218 @@ mx_texture_cache_load_cache (MxTextureCache *self,
       return;
     }
 
+  g_hash_table_insert (priv->image_caches, g_strdup (filename),
+                       GINT_TO_POINTER (TRUE));
+
   while (!feof (file))
     {
       gchar *uri;
 
-      element = mx_texture_cache_item_new ();
-      ret = fread (element, sizeof (MxTextureCacheItem), 1, file);
+      ret = fread (&element, sizeof (MxTextureCacheFileItem), 1, file);
 
       if (ret < 1)
         {
           /* end of file */
-          mx_texture_cache_item_free (element);
           break;
         }
+      element.filename[sizeof (element.filename) - 1] = '\0';
 
-      uri = mx_texture_cache_filename_to_uri (element->filename);
+      uri = mx_texture_cache_filename_to_uri (element.filename);
       if (!uri)
         {
           /* Couldn't resolve path */
-          mx_texture_cache_item_free (element);
           continue;
         }
 
-      if (g_hash_table_lookup (priv->cache, uri))
+      if (!g_hash_table_lookup (priv->cache, uri))
         {
-          /* URI is already in the cache.... */
-          mx_texture_cache_item_free (element);
-          g_free (uri);
+          item = mx_texture_cache_item_new (self);
+          item->ptr = cogl_texture_new_from_sub_texture (full_texture,
+                                                         element.posX,
+                                                         element.posY,
+                                                         element.width,
+                                                         element.height);
+
+          /* Evicting part of the atlas wouldn't free any memory */
+          item->pinned = 1;
+
+          add_texture_to_cache (self, uri, item);
         }
-      else
+
+      g_free (uri);
+    }
+
+  cogl_handle_unref (full_texture);
+
+  fclose (file);
+}
+
+/**
+ * mx_texture_cache_load_cache:
+ * @self: A #MxTextureCache
+ * @filename: the image cache file written by mx-create-image-cache
+ *
+ * Maps the prebuilt image cache at @filename and adds every image it
+ * contains to @self, as parts of a single texture. Images are looked up
+ * relative to the directory containing @filename and are skipped if the
+ * file on disk has changed since the cache was generated. Images already in
+ * @self are left as they are.
+ *
+ * Files written by earlier versions of mx-create-image-cache, which list
+ * the absolute path of each image and name a separate atlas image in their
+ * first entry, are still accepted. Their images are added without checking
+ * whether they changed.
+ */
+void
+mx_texture_cache_load_cache (MxTextureCache *self,
+                             const gchar    *filename)
+{
+  const MxImageCacheHeader *header;
+  const MxImageCacheEntry *entries;
+  const gchar *contents, *strings;
+  MxTextureCachePrivate *priv;
+  GMappedFile *mapped;
+  CoglHandle atlas;
+  gchar *dirname;
+  GError *error = NULL;
+  gsize length;
+  guint i, n_loaded = 0;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+  g_return_if_fail (filename != NULL);
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  if (g_hash_table_lookup (priv->image_caches, filename))
+    return;
+
+  mapped = g_mapped_file_new (filename, FALSE, &error);
+  if (!mapped)
+    {
+      g_warning (G_STRLOC ": Unable to open image cache: %s", error->message);
+      g_error_free (error);
+      return;
+    }
+
+  contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+  header = (const MxImageCacheHeader *) contents;
+  entries = (const MxImageCacheEntry *) (header + 1);
+
+  if (length < sizeof (header->magic) ||
+      memcmp (header->magic, MX_IMAGE_CACHE_MAGIC, sizeof (header->magic)))
+    {
+      g_mapped_file_unref (mapped);
+      mx_texture_cache_load_legacy_cache (self, filename);
+      return;
+    }
+
+  if (length < sizeof (MxImageCacheHeader) ||
+      header->version != MX_IMAGE_CACHE_VERSION ||
+      header->byte_order != MX_IMAGE_CACHE_BYTE_ORDER ||
+      header->n_images > (length - sizeof (MxImageCacheHeader)) /
+                         sizeof (MxImageCacheEntry) ||
+      header->strings_offset < sizeof (MxImageCacheHeader) +
+                               header->n_images * sizeof (MxImageCacheEntry) ||
+      header->strings_size == 0 ||
+      header->strings_offset > length ||
+      header->strings_size > length - header->strings_offset ||
+      header->pixels_offset % 4 ||
+      header->pixels_offset > length ||
+      header->width == 0 || header->height == 0 ||
+      header->width > G_MAXUINT32 / 4 / header->height ||
+      (gsize) header->width * header->height * 4 >
+        length - header->pixels_offset)
+    {
+      g_warning (G_STRLOC ": '%s' is not a valid image cache", filename);
+      g_mapped_file_unref (mapped);
+      return;
+    }
+
+  strings = contents + header->strings_offset;
+  if (strings[header->strings_size - 1] != '\0')
+    {
+      g_warning (G_STRLOC ": '%s' is not a valid image cache", filename);
+      g_mapped_file_unref (mapped);
+      return;
+    }
+
+  /* The pixels are premultiplied already, so the upload is a plain copy */
+  atlas = cogl_texture_new_from_data (header->width, header->height,
+                                      COGL_TEXTURE_NO_ATLAS,
+                                      COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                      COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                      header->width * 4,
+                                      (const guint8 *) contents +
+                                      header->pixels_offset);
+  if (atlas == COGL_INVALID_HANDLE)
+    {
+      g_critical (G_STRLOC ": Error creating texture for image cache '%s'",
+                  filename);
+      g_mapped_file_unref (mapped);
+      return;
+    }
+
+  g_hash_table_insert (priv->image_caches, g_strdup (filename),
+                       GINT_TO_POINTER (TRUE));
+
+  dirname = g_path_get_dirname (filename);
+
+  for (i = 0; i < header->n_images; i++)
+    {
+      const MxImageCacheEntry *entry = &entries[i];
+      MxTextureCacheItem *item;
+      gchar *path, *uri;
+      struct stat info;
+
+      if (entry->name >= header->strings_size ||
+          entry->width == 0 || entry->height == 0 ||
+          entry->x > header->width || entry->y > header->height ||
+          entry->width > header->width - entry->x ||
+          entry->height > header->height - entry->y)
+        continue;
+
+      path = g_build_filename (dirname, strings + entry->name, NULL);
+
+      /* Skip images that changed after the cache was generated */
+      if (g_stat (path, &info) ||
+          (guint64) info.st_mtime != entry->mtime ||
+          (guint64) info.st_size != entry->size)
         {
-          element->ptr = cogl_texture_new_from_sub_texture (full_texture,
-                                                            element->posX,
-                                                            element->posY,
-                                                            element->width,
-                                                            element->height);
-          g_hash_table_insert (priv->cache, uri, element);
+          MX_NOTE (TEXTURE_CACHE, "Image cache entry '%s' is stale", path);
+          g_free (path);
+          continue;
         }
+
+      uri = mx_texture_cache_filename_to_uri (path);
+      g_free (path);
+
+      if (!uri)
+        continue;
+
+      if (!g_hash_table_lookup (priv->cache, uri))
+        {
+          item = mx_texture_cache_item_new (self);
+          item->ptr = cogl_texture_new_from_sub_texture (atlas,
+                                                         entry->x,
+                                                         entry->y,
+                                                         entry->width,
+                                                         entry->height);
+
+          /* Evicting part of the atlas wouldn't free any memory */
+          item->pinned = 1;
+
+          add_texture_to_cache (self, uri, item);
+          n_loaded ++;
+        }
+
+      g_free (uri);
     }
 
-  fclose (file);
+  MX_NOTE (TEXTURE_CACHE, "Loaded %u of %u images from '%s'",
+           n_loaded, header->n_images, filename);
+
+  g_free (dirname);
+  cogl_handle_unref (atlas);
+  g_mapped_file_unref (mapped);
 }
@@ -85,6 +85,27 @@ typedef struct {
   void (*_padding_4) (void);
 } MxTextureCacheClass;
 
+/**
+ * MxTextureCacheLoadCallback:
+ * @cache: A #MxTextureCache
+ * @uri: The URI that was requested
+ * @texture: (allow-none): A #CoglHandle to the cached texture, or %NULL
+ *   on failure
+ * @error: (allow-none): A #GError describing the failure, or %NULL
+ * @user_data: The data passed to mx_texture_cache_load_async()
+ *
+ * The function called when an asynchronous texture load completes. The
+ * cache keeps its own reference on @texture; take another if it needs to
+ * outlive the callback.
+ *
+ * Since: 1.6
+ */
+typedef void (* MxTextureCacheLoadCallback) (MxTextureCache *cache,
+                                             const gchar    *uri,
+                                             CoglHandle      texture,
+                                             const GError   *error,
+                                             gpointer        user_data);
+
 GType mx_texture_cache_get_type (void);
 
 MxTextureCache* mx_texture_cache_get_default (void);
@@ -125,6 +146,24 @@ void            mx_texture_cache_insert_meta (MxTextureCache *self,
 void mx_texture_cache_load_cache (MxTextureCache *self,
                                   const char     *filename);
 
+guint mx_texture_cache_load_async  (MxTextureCache             *self,
+                                    const gchar                *uri,
+                                    MxTextureCacheLoadCallback  callback,
+                                    gpointer                    user_data);
+void  mx_texture_cache_cancel_load (MxTextureCache             *self,
+                                    guint                       id);
+
+void  mx_texture_cache_set_memory_budget (MxTextureCache *self,
+                                          gsize           bytes);
+gsize mx_texture_cache_get_memory_budget (MxTextureCache *self);
+gsize mx_texture_cache_get_memory_usage  (MxTextureCache *self);
+void  mx_texture_cache_release_unused    (MxTextureCache *self);
+
+void  mx_texture_cache_pin               (MxTextureCache *self,
+                                          const gchar    *uri);
+void  mx_texture_cache_unpin             (MxTextureCache *self,
+                                          const gchar    *uri);
+
 G_END_DECLS
 
 #endif /* _MX_TEXTURE_CACHE */
@@ -0,0 +1,1198 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-view-items.c: the items of a view driven by a model
+ *
+ * Copyright 2010 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "mx-view-items.h"
+#include "mx-scrollable.h"
+#include "mx-widget.h"
+
+typedef struct
+{
+  gchar *name;
+  gint   col;
+} AttributeData;
+
+typedef struct
+{
+  ClutterActor *item;
+  gboolean      dirty;
+} PendingRow;
+
+static void mx_view_items_update_items    (MxViewItems  *view_items,
+                                           gboolean      rebind);
+static void mx_view_items_populate        (MxViewItems  *view_items);
+static void mx_view_items_stop_populating (MxViewItems  *view_items);
+static void model_changed_cb              (ClutterModel *model,
+                                           MxViewItems  *view_items);
+
+static ClutterActor *
+mx_view_items_create_item (MxViewItems *view_items)
+{
+  if (view_items->item_type)
+    return g_object_new (view_items->item_type, NULL);
+  else
+    return mx_item_factory_create (view_items->factory);
+}
+
+static void
+mx_view_items_bind_item (MxViewItems      *view_items,
+                         ClutterActor     *child,
+                         ClutterModelIter *iter)
+{
+  GSList *p;
+
+  g_object_freeze_notify (G_OBJECT (child));
+  for (p = view_items->attributes; p; p = p->next)
+    {
+      GValue value = { 0, };
+      AttributeData *attr = p->data;
+
+      clutter_model_iter_get_value (iter, attr->col, &value);
+
+      g_object_set_property (G_OBJECT (child), attr->name, &value);
+
+      g_value_unset (&value);
+    }
+  g_object_thaw_notify (G_OBJECT (child));
+}
+
+static void
+free_attribute (AttributeData *data)
+{
+  g_free (data->name);
+  g_free (data);
+}
+
+/* virtual mode */
+
+/* Works out which rows are in or near the viewport, from the scroll
+ * position and the size of the lines measured by the view */
+static void
+mx_view_items_get_window (MxViewItems *view_items,
+                          gint         n_rows,
+                          gint        *first_p,
+                          gint        *n_p)
+{
+  MxPadding padding = { 0, };
+  ClutterActorBox box = { 0, };
+  gdouble value = 0, page_size = 0;
+  gfloat line_height, spacing, stride;
+  gint columns, first, last;
+
+  view_items->funcs->get_lines (view_items->view, &line_height, &spacing,
+                                &columns);
+
+  if (line_height <= 0)
+    {
+      /* nothing has been measured yet, start with a single item */
+      *first_p = 0;
+      *n_p = MIN (n_rows, 1);
+      return;
+    }
+
+  mx_widget_get_padding (MX_WIDGET (view_items->view), &padding);
+
+  if (view_items->vadjustment)
+    mx_adjustment_get_values (view_items->vadjustment, &value, NULL, NULL,
+                              NULL, NULL, &page_size);
+
+  /* before the first allocation, the page size isn't known yet */
+  if (page_size <= 0)
+    {
+      clutter_actor_get_allocation_box (view_items->view, &box);
+      page_size = box.y2 - box.y1 - padding.top - padding.bottom;
+    }
+
+  stride = line_height + spacing;
+
+  first = (gint) ((value - padding.top) / stride) - view_items->margin;
+  last = (gint) ceil ((value + page_size - padding.top) / stride) +
+    view_items->margin;
+
+  first = CLAMP (first * columns, 0, n_rows);
+  last = CLAMP (last * columns, first, n_rows);
+
+  *first_p = first;
+  *n_p = last - first;
+}
+
+static gboolean
+mx_view_items_update_cb (MxViewItems *view_items)
+{
+  view_items->update_id = 0;
+
+  if (view_items->is_virtual &&
+      (view_items->item_type || view_items->factory) &&
+      !view_items->is_frozen)
+    mx_view_items_update_items (view_items, FALSE);
+
+  return FALSE;
+}
+
+/* Items can't be added or removed while allocating, so changes to the
+ * viewport are handled before the next frame instead */
+static void
+mx_view_items_queue_update (MxViewItems *view_items)
+{
+  if (!view_items->update_id)
+    view_items->update_id =
+      clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
+                                     (GSourceFunc) mx_view_items_update_cb,
+                                     view_items, NULL);
+}
+
+static void
+mx_view_items_vadjustment_value_cb (MxAdjustment *adjustment,
+                                    GParamSpec   *pspec,
+                                    MxViewItems  *view_items)
+{
+  mx_view_items_queue_update (view_items);
+}
+
+static void
+mx_view_items_vadjustment_notify_cb (ClutterActor *view,
+                                     GParamSpec   *pspec,
+                                     MxViewItems  *view_items)
+{
+  MxAdjustment *vadjustment;
+
+  if (view_items->vadjustment)
+    {
+      g_signal_handlers_disconnect_by_func (view_items->vadjustment,
+                                            mx_view_items_vadjustment_value_cb,
+                                            view_items);
+      g_object_unref (view_items->vadjustment);
+      view_items->vadjustment = NULL;
+    }
+
+  if (!view_items->is_virtual)
+    return;
+
+  /* a virtual view always scrolls, so this creates an adjustment if there
+   * isn't one, which notifies and gets back here */
+  mx_scrollable_get_adjustments (MX_SCROLLABLE (view), NULL, &vadjustment);
+
+  if (!vadjustment || vadjustment == view_items->vadjustment)
+    return;
+
+  view_items->vadjustment = g_object_ref (vadjustment);
+  g_signal_connect (vadjustment, "notify::value",
+                    G_CALLBACK (mx_view_items_vadjustment_value_cb),
+                    view_items);
+
+  mx_view_items_queue_update (view_items);
+}
+
+/* Makes the items show the rows from first to first + n - 1. Items already
+ * showing one of those rows are kept as they are, unless rebind is set, and
+ * the others are reused for the rows that don't have an item yet. */
+static void
+mx_view_items_sync_items (MxViewItems *view_items,
+                          gint         first,
+                          gint         n,
+                          gboolean     rebind)
+{
+  ClutterContainer *container = CLUTTER_CONTAINER (view_items->view);
+  ClutterModelIter *iter = NULL;
+  GPtrArray *old_items = view_items->items;
+  gint old_first = view_items->first_row;
+  gboolean moved = FALSE;
+  GSList *spare = NULL;
+  gint i;
+
+  if (!rebind && first == old_first && n == (gint) old_items->len)
+    return;
+
+  for (i = 0; i < (gint) old_items->len; i++)
+    if (old_first + i < first || old_first + i >= first + n)
+      spare = g_slist_prepend (spare, g_ptr_array_index (old_items, i));
+
+  view_items->items = g_ptr_array_sized_new (n);
+
+  if (n > 0)
+    iter = clutter_model_get_iter_at_row (view_items->model, first);
+
+  for (i = 0; i < n && iter; i++)
+    {
+      gint row = first + i;
+      ClutterActor *child;
+      gboolean bind = TRUE;
+
+      if (row >= old_first && row < old_first + (gint) old_items->len)
+        {
+          child = g_ptr_array_index (old_items, row - old_first);
+          bind = rebind;
+        }
+      else if (spare)
+        {
+          child = spare->data;
+          spare = g_slist_delete_link (spare, spare);
+          moved = TRUE;
+        }
+      else
+        {
+          child = mx_view_items_create_item (view_items);
+          clutter_container_add_actor (container, child);
+          moved = TRUE;
+        }
+
+      if (bind)
+        mx_view_items_bind_item (view_items, child, iter);
+
+      g_ptr_array_add (view_items->items, child);
+      clutter_model_iter_next (iter);
+    }
+
+  if (iter)
+    g_object_unref (iter);
+
+  while (spare)
+    {
+      clutter_container_remove_actor (container,
+                                      (ClutterActor *) spare->data);
+      spare = g_slist_delete_link (spare, spare);
+    }
+
+  /* keep the children in row order, for keyboard focus */
+  if (moved)
+    for (i = 0; i < (gint) view_items->items->len; i++)
+      clutter_container_raise_child (container,
+                                     g_ptr_array_index (view_items->items, i),
+                                     NULL);
+
+  g_ptr_array_free (old_items, TRUE);
+  view_items->first_row = first;
+
+  clutter_actor_queue_relayout (view_items->view);
+}
+
+static void
+mx_view_items_update_items (MxViewItems *view_items,
+                            gboolean     rebind)
+{
+  gfloat line_height, spacing;
+  gint n_rows, first, n, columns;
+
+  n_rows = view_items->model ?
+    clutter_model_get_n_rows (view_items->model) : 0;
+
+  mx_view_items_get_window (view_items, n_rows, &first, &n);
+  mx_view_items_sync_items (view_items, first, n, rebind);
+
+  /* measure the first item to find out how many fit in the view */
+  view_items->funcs->get_lines (view_items->view, &line_height, &spacing,
+                                &columns);
+  if (line_height <= 0 && view_items->items->len)
+    {
+      view_items->funcs->measure (view_items->view,
+                                  g_ptr_array_index (view_items->items, 0));
+
+      mx_view_items_get_window (view_items, n_rows, &first, &n);
+      mx_view_items_sync_items (view_items, first, n, FALSE);
+    }
+}
+
+/* population through the actor manager */
+
+static ClutterActor *
+mx_view_items_create_cb (MxActorManager *manager,
+                         MxViewItems    *view_items)
+{
+  return mx_view_items_create_item (view_items);
+}
+
+static void
+mx_view_items_actor_created_cb (MxActorManager *manager,
+                                gulong          id,
+                                ClutterActor   *actor,
+                                MxViewItems    *view_items)
+{
+  if (id != view_items->populate_op)
+    return;
+
+  view_items->populate_op =
+    mx_actor_manager_add_actor (manager,
+                                CLUTTER_CONTAINER (view_items->view), actor);
+}
+
+static void
+mx_view_items_actor_added_cb (MxActorManager   *manager,
+                              gulong            id,
+                              ClutterContainer *container,
+                              ClutterActor     *actor,
+                              MxViewItems      *view_items)
+{
+  ClutterModelIter *iter;
+  gint n_rows;
+
+  if (id != view_items->populate_op)
+    return;
+
+  view_items->populate_op = 0;
+
+  n_rows = view_items->model ?
+    clutter_model_get_n_rows (view_items->model) : 0;
+
+  /* the model may have shrunk since the item was asked for */
+  if ((gint) view_items->items->len >= n_rows)
+    {
+      clutter_container_remove_actor (container, actor);
+      mx_view_items_stop_populating (view_items);
+      g_signal_emit_by_name (view_items->view, "populated");
+      return;
+    }
+
+  /* the new item is the last child, like its row */
+  g_ptr_array_add (view_items->items, actor);
+
+  iter = clutter_model_get_iter_at_row (view_items->model,
+                                        view_items->items->len - 1);
+  mx_view_items_bind_item (view_items, actor, iter);
+  g_object_unref (iter);
+
+  if ((gint) view_items->items->len < n_rows)
+    mx_view_items_populate (view_items);
+  else
+    {
+      mx_view_items_stop_populating (view_items);
+      g_signal_emit_by_name (view_items->view, "populated");
+    }
+}
+
+static void
+mx_view_items_operation_stopped_cb (MxActorManager *manager,
+                                    gulong          id,
+                                    MxViewItems    *view_items)
+{
+  if (id != view_items->populate_op)
+    return;
+
+  /* create the remaining items straight away rather than retrying */
+  mx_view_items_stop_populating (view_items);
+
+  view_items->use_actor_manager = FALSE;
+  model_changed_cb (view_items->model, view_items);
+  view_items->use_actor_manager = TRUE;
+
+  if (!view_items->is_frozen)
+    g_signal_emit_by_name (view_items->view, "populated");
+}
+
+static void
+mx_view_items_operation_failed_cb (MxActorManager *manager,
+                                   gulong          id,
+                                   const GError   *error,
+                                   MxViewItems    *view_items)
+{
+  mx_view_items_operation_stopped_cb (manager, id, view_items);
+}
+
+/* Asks the actor manager for an item for the first row after the last
+ * item. Only one item is asked for at a time, so that each item is added
+ * before the next is created and the view fills up progressively. */
+static void
+mx_view_items_populate (MxViewItems *view_items)
+{
+  ClutterActor *stage;
+
+  view_items->is_populating = TRUE;
+
+  if (view_items->populate_op)
+    return;
+
+  /* started again once the view is on a stage */
+  stage = clutter_actor_get_stage (view_items->view);
+  if (!stage)
+    return;
+
+  if (!view_items->manager)
+    {
+      view_items->manager =
+        g_object_ref (mx_actor_manager_get_for_stage (CLUTTER_STAGE (stage)));
+
+      g_signal_connect (view_items->manager, "actor-created",
+                        G_CALLBACK (mx_view_items_actor_created_cb),
+                        view_items);
+      g_signal_connect (view_items->manager, "actor-added",
+                        G_CALLBACK (mx_view_items_actor_added_cb),
+                        view_items);
+      g_signal_connect (view_items->manager, "operation-cancelled",
+                        G_CALLBACK (mx_view_items_operation_stopped_cb),
+                        view_items);
+      g_signal_connect (view_items->manager, "operation-failed",
+                        G_CALLBACK (mx_view_items_operation_failed_cb),
+                        view_items);
+    }
+
+  view_items->populate_op =
+    mx_actor_manager_create_actor (view_items->manager,
+                                   (MxActorManagerCreateFunc)
+                                   mx_view_items_create_cb,
+                                   view_items, NULL);
+}
+
+static void
+mx_view_items_stop_populating (MxViewItems *view_items)
+{
+  gulong populate_op = view_items->populate_op;
+
+  view_items->is_populating = FALSE;
+  view_items->populate_op = 0;
+
+  if (!view_items->manager)
+    return;
+
+  if (populate_op)
+    mx_actor_manager_cancel_operation (view_items->manager, populate_op);
+
+  g_signal_handlers_disconnect_matched (view_items->manager,
+                                        G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, view_items);
+  g_object_unref (view_items->manager);
+  view_items->manager = NULL;
+}
+
+static void
+mx_view_items_mapped_notify_cb (ClutterActor *view,
+                                GParamSpec   *pspec,
+                                MxViewItems  *view_items)
+{
+  if (view_items->is_populating && !view_items->populate_op &&
+      CLUTTER_ACTOR_IS_MAPPED (view))
+    mx_view_items_populate (view_items);
+}
+
+/* changes made while frozen */
+
+static void
+mx_view_items_drop_pending (MxViewItems *view_items)
+{
+  if (view_items->pending)
+    {
+      g_array_free (view_items->pending, TRUE);
+      view_items->pending = NULL;
+    }
+
+  g_slist_free (view_items->removed);
+  view_items->removed = NULL;
+}
+
+/* While frozen, rows added, changed or removed are recorded against a copy
+ * of the items, so that thawing can keep the items of the rows that are
+ * still there. Returns %NULL if the whole view will be re-synchronised
+ * anyway, as the rows of a virtual view aren't all known. */
+static GArray *
+mx_view_items_get_pending (MxViewItems *view_items)
+{
+  guint i;
+
+  /* rows that are still to be populated don't have an entry either */
+  if (view_items->is_virtual || view_items->is_populating)
+    view_items->needs_resync = TRUE;
+
+  if (view_items->needs_resync)
+    {
+      mx_view_items_drop_pending (view_items);
+      return NULL;
+    }
+
+  if (!view_items->pending)
+    {
+      view_items->pending =
+        g_array_sized_new (FALSE, FALSE, sizeof (PendingRow),
+                           view_items->items->len);
+
+      for (i = 0; i < view_items->items->len; i++)
+        {
+          PendingRow pending_row = { g_ptr_array_index (view_items->items,
+                                                        i),
+                                     FALSE };
+
+          g_array_append_val (view_items->pending, pending_row);
+        }
+    }
+
+  return view_items->pending;
+}
+
+static void
+mx_view_items_pending_insert (MxViewItems *view_items,
+                              gint         row)
+{
+  GArray *pending = mx_view_items_get_pending (view_items);
+  PendingRow pending_row = { NULL, FALSE };
+
+  if (!pending)
+    return;
+
+  if (row > (gint) pending->len)
+    view_items->needs_resync = TRUE;
+  else
+    g_array_insert_val (pending, row, pending_row);
+}
+
+static void
+mx_view_items_pending_remove (MxViewItems *view_items,
+                              gint         row)
+{
+  GArray *pending = mx_view_items_get_pending (view_items);
+  ClutterActor *item;
+
+  if (!pending)
+    return;
+
+  if (row >= (gint) pending->len)
+    {
+      view_items->needs_resync = TRUE;
+      return;
+    }
+
+  /* the item can show one of the rows added later on */
+  item = g_array_index (pending, PendingRow, row).item;
+  if (item)
+    view_items->removed = g_slist_prepend (view_items->removed, item);
+
+  g_array_remove_index (pending, row);
+}
+
+static void
+mx_view_items_pending_change (MxViewItems *view_items,
+                              gint         row)
+{
+  GArray *pending = mx_view_items_get_pending (view_items);
+
+  if (!pending)
+    return;
+
+  if (row >= (gint) pending->len)
+    view_items->needs_resync = TRUE;
+  else
+    g_array_index (pending, PendingRow, row).dirty = TRUE;
+}
+
+/* Applies the changes recorded while frozen. Items of rows that are still
+ * in the model are kept, items of removed rows are reused for new rows,
+ * and items are only created for the new rows that are left. */
+static void
+mx_view_items_apply_pending (MxViewItems *view_items)
+{
+  ClutterContainer *container = CLUTTER_CONTAINER (view_items->view);
+  GArray *pending = view_items->pending;
+  ClutterModelIter *iter;
+  GPtrArray *items;
+  gint i, last_kept, next_kept;
+
+  if (!view_items->model ||
+      clutter_model_get_n_rows (view_items->model) != pending->len)
+    {
+      mx_view_items_drop_pending (view_items);
+      model_changed_cb (view_items->model, view_items);
+      return;
+    }
+
+  view_items->pending = NULL;
+  items = g_ptr_array_sized_new (pending->len);
+
+  /* new items for the rows after the last kept item are added at the end,
+   * in order, the others have to be moved in front of the next kept item */
+  for (last_kept = pending->len - 1; last_kept >= 0; last_kept--)
+    if (g_array_index (pending, PendingRow, last_kept).item)
+      break;
+
+  next_kept = 0;
+  iter = clutter_model_get_first_iter (view_items->model);
+  for (i = 0; i < (gint) pending->len; i++)
+    {
+      PendingRow *pending_row = &g_array_index (pending, PendingRow, i);
+      ClutterActor *child = pending_row->item;
+      gboolean bind = pending_row->dirty;
+
+      if (!child)
+        {
+          gboolean place = TRUE;
+
+          if (view_items->removed)
+            {
+              child = view_items->removed->data;
+              view_items->removed = g_slist_delete_link (view_items->removed,
+                                                         view_items->removed);
+            }
+          else if (view_items->use_actor_manager && i > last_kept)
+            {
+              /* only new rows are left */
+              break;
+            }
+          else
+            {
+              child = mx_view_items_create_item (view_items);
+              clutter_container_add_actor (container, child);
+              place = (i < last_kept);
+            }
+
+          if (place && i < last_kept)
+            {
+              while (next_kept <= i ||
+                     !g_array_index (pending, PendingRow, next_kept).item)
+                next_kept++;
+
+              clutter_container_lower_child (container, child,
+                                             g_array_index (pending,
+                                                            PendingRow,
+                                                            next_kept).item);
+            }
+          else if (place)
+            clutter_container_raise_child (container, child, NULL);
+
+          bind = TRUE;
+        }
+
+      if (bind)
+        mx_view_items_bind_item (view_items, child, iter);
+
+      g_ptr_array_add (items, child);
+      clutter_model_iter_next (iter);
+    }
+
+  if (iter)
+    g_object_unref (iter);
+
+  /* removed rows that weren't replaced */
+  while (view_items->removed)
+    {
+      clutter_container_remove_actor (container,
+                                      (ClutterActor *)
+                                      view_items->removed->data);
+      view_items->removed = g_slist_delete_link (view_items->removed,
+                                                 view_items->removed);
+    }
+
+  g_ptr_array_free (view_items->items, TRUE);
+  view_items->items = items;
+
+  if (items->len < pending->len)
+    mx_view_items_populate (view_items);
+
+  g_array_free (pending, TRUE);
+}
+
+/* rows */
+
+static void
+mx_view_items_insert_item (MxViewItems  *view_items,
+                           gint          index_,
+                           ClutterActor *child)
+{
+  GPtrArray *items = view_items->items;
+
+  g_ptr_array_add (items, NULL);
+  memmove (items->pdata + index_ + 1, items->pdata + index_,
+           (items->len - index_ - 1) * sizeof (gpointer));
+  items->pdata[index_] = child;
+}
+
+/* A row was inserted into the model. The rows after it have moved down,
+ * so an item is only created if the new row lies among the rows the
+ * items show. */
+static void
+mx_view_items_insert_row (MxViewItems      *view_items,
+                          gint              row,
+                          ClutterModelIter *iter)
+{
+  ClutterContainer *container = CLUTTER_CONTAINER (view_items->view);
+  gint index_ = row - view_items->first_row;
+  ClutterActor *child;
+
+  if (view_items->is_frozen)
+    {
+      mx_view_items_pending_insert (view_items, row);
+      return;
+    }
+
+  if (index_ < 0)
+    view_items->first_row++;
+  else if (index_ < (gint) view_items->items->len ||
+           (index_ == (gint) view_items->items->len &&
+            !view_items->is_virtual && !view_items->use_actor_manager))
+    {
+      child = mx_view_items_create_item (view_items);
+      clutter_container_add_actor (container, child);
+      mx_view_items_bind_item (view_items, child, iter);
+
+      /* keep the children in row order */
+      if (index_ < (gint) view_items->items->len)
+        clutter_container_lower_child (container, child,
+                                       g_ptr_array_index (view_items->items,
+                                                          index_));
+
+      mx_view_items_insert_item (view_items, index_, child);
+    }
+  else if (index_ == (gint) view_items->items->len && !view_items->is_virtual)
+    mx_view_items_populate (view_items);
+
+  /* the viewport may need more or fewer items now */
+  if (view_items->is_virtual)
+    {
+      clutter_actor_queue_relayout (view_items->view);
+      mx_view_items_queue_update (view_items);
+    }
+}
+
+/* A row was removed from the model, the rows after it have moved up */
+static void
+mx_view_items_remove_row (MxViewItems *view_items,
+                          gint         row)
+{
+  gint index_ = row - view_items->first_row;
+  ClutterActor *child;
+
+  if (view_items->is_frozen)
+    {
+      mx_view_items_pending_remove (view_items, row);
+      return;
+    }
+
+  if (index_ < 0)
+    view_items->first_row--;
+  else if (index_ < (gint) view_items->items->len)
+    {
+      child = g_ptr_array_index (view_items->items, index_);
+      g_ptr_array_remove_index (view_items->items, index_);
+      clutter_container_remove_actor (CLUTTER_CONTAINER (view_items->view),
+                                      child);
+    }
+
+  if (view_items->is_virtual)
+    {
+      clutter_actor_queue_relayout (view_items->view);
+      mx_view_items_queue_update (view_items);
+    }
+}
+
+static void
+mx_view_items_change_row (MxViewItems      *view_items,
+                          gint              row,
+                          ClutterModelIter *iter)
+{
+  gint index_ = row - view_items->first_row;
+
+  if (view_items->is_frozen)
+    {
+      mx_view_items_pending_change (view_items, row);
+      return;
+    }
+
+  if (index_ >= 0 && index_ < (gint) view_items->items->len)
+    mx_view_items_bind_item (view_items,
+                             g_ptr_array_index (view_items->items, index_),
+                             iter);
+}
+
+/* model monitors */
+static void
+model_changed_cb (ClutterModel *model,
+                  MxViewItems  *view_items)
+{
+  ClutterContainer *container = CLUTTER_CONTAINER (view_items->view);
+  ClutterModelIter *iter = NULL;
+  gint model_n = 0, i;
+
+  /* bail out if we don't yet have an item type or a factory */
+  if (!view_items->item_type && !view_items->factory)
+    return;
+
+  if (view_items->is_frozen)
+    {
+      view_items->needs_resync = TRUE;
+      return;
+    }
+
+  if (view_items->item_type)
+    {
+      /* check the item-type is an descendant of ClutterActor */
+      if (!g_type_is_a (view_items->item_type, CLUTTER_TYPE_ACTOR))
+        {
+          g_warning ("%s is not a subclass of ClutterActor and therefore"
+                     " cannot be used as items in an %s",
+                     g_type_name (view_items->item_type),
+                     G_OBJECT_TYPE_NAME (view_items->view));
+          return;
+        }
+    }
+
+  if (view_items->is_virtual)
+    {
+      mx_view_items_update_items (view_items, TRUE);
+      return;
+    }
+
+  if (model)
+    model_n = clutter_model_get_n_rows (view_items->model);
+  else
+    model_n = 0;
+
+  /* add children as needed */
+  if (view_items->use_actor_manager)
+    {
+      if (model_n > (gint) view_items->items->len)
+        mx_view_items_populate (view_items);
+    }
+  else
+    {
+      while (model_n > (gint) view_items->items->len)
+        {
+          ClutterActor *new_child;
+
+          new_child = mx_view_items_create_item (view_items);
+
+          clutter_container_add_actor (container, new_child);
+          g_ptr_array_add (view_items->items, new_child);
+        }
+    }
+
+  /* remove children as needed */
+  while ((gint) view_items->items->len > model_n)
+    {
+      ClutterActor *child;
+
+      child = g_ptr_array_index (view_items->items,
+                                 view_items->items->len - 1);
+      g_ptr_array_remove_index (view_items->items,
+                                view_items->items->len - 1);
+      clutter_container_remove_actor (container, child);
+    }
+
+  if (!view_items->model)
+    return;
+
+  /* set the properties on the children */
+  iter = clutter_model_get_first_iter (view_items->model);
+  i = 0;
+  while (iter && !clutter_model_iter_is_last (iter) &&
+         i < (gint) view_items->items->len)
+    {
+      mx_view_items_bind_item (view_items,
+                               g_ptr_array_index (view_items->items, i++),
+                               iter);
+
+      clutter_model_iter_next (iter);
+    }
+
+  if (iter)
+    g_object_unref (iter);
+}
+
+/* Whether a row passes the filter can change when any row is added or
+ * changed, so the view is only updated one row at a time when the model
+ * isn't filtered */
+static void
+row_added_cb (ClutterModel     *model,
+              ClutterModelIter *iter,
+              MxViewItems      *view_items)
+{
+  if (!view_items->item_type && !view_items->factory)
+    return;
+
+  if (clutter_model_get_filter_set (model))
+    model_changed_cb (model, view_items);
+  else
+    mx_view_items_insert_row (view_items, clutter_model_iter_get_row (iter),
+                              iter);
+}
+
+static void
+row_changed_cb (ClutterModel     *model,
+                ClutterModelIter *iter,
+                MxViewItems      *view_items)
+{
+  if (!view_items->item_type && !view_items->factory)
+    return;
+
+  if (clutter_model_get_filter_set (model))
+    model_changed_cb (model, view_items);
+  else
+    mx_view_items_change_row (view_items, clutter_model_iter_get_row (iter),
+                              iter);
+}
+
+static void
+row_removed_cb (ClutterModel     *model,
+                ClutterModelIter *iter,
+                MxViewItems      *view_items)
+{
+  if (!view_items->item_type && !view_items->factory)
+    return;
+
+  /* The row has already left the model, so only the row number the iter
+   * was created with can be used. That counts the rows the filter hides,
+   * which have no item, so a filtered view is synchronised in full. */
+  if (clutter_model_get_filter_set (model))
+    model_changed_cb (model, view_items);
+  else
+    mx_view_items_remove_row (view_items, clutter_model_iter_get_row (iter));
+}
+
+/* private api */
+
+MxViewItems *
+_mx_view_items_new (ClutterActor           *view,
+                    const MxViewItemsFuncs *funcs,
+                    gint                    margin)
+{
+  MxViewItems *view_items;
+
+  view_items = g_slice_new0 (MxViewItems);
+  view_items->view = view;
+  view_items->funcs = funcs;
+  view_items->margin = margin;
+  view_items->items = g_ptr_array_new ();
+
+  g_signal_connect (view, "notify::vertical-adjustment",
+                    G_CALLBACK (mx_view_items_vadjustment_notify_cb),
+                    view_items);
+  g_signal_connect (view, "notify::mapped",
+                    G_CALLBACK (mx_view_items_mapped_notify_cb), view_items);
+
+  return view_items;
+}
+
+/* Lets go of the model, the factory and the actor manager, and of the
+ * adjustment of the view */
+void
+_mx_view_items_dispose (MxViewItems *view_items)
+{
+  /* This will cause the unref of the model and also disconnect the signals */
+  _mx_view_items_set_model (view_items, NULL);
+
+  mx_view_items_stop_populating (view_items);
+
+  if (view_items->update_id)
+    {
+      g_source_remove (view_items->update_id);
+      view_items->update_id = 0;
+    }
+
+  if (view_items->vadjustment)
+    {
+      g_signal_handlers_disconnect_by_func (view_items->vadjustment,
+                                            mx_view_items_vadjustment_value_cb,
+                                            view_items);
+      g_object_unref (view_items->vadjustment);
+      view_items->vadjustment = NULL;
+    }
+
+  if (view_items->factory)
+    {
+      g_object_unref (view_items->factory);
+      view_items->factory = NULL;
+    }
+}
+
+void
+_mx_view_items_free (MxViewItems *view_items)
+{
+  g_signal_handlers_disconnect_matched (view_items->view,
+                                        G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, view_items);
+
+  g_slist_foreach (view_items->attributes, (GFunc) free_attribute, NULL);
+  g_slist_free (view_items->attributes);
+
+  g_ptr_array_free (view_items->items, TRUE);
+
+  g_slice_free (MxViewItems, view_items);
+}
+
+void
+_mx_view_items_set_model (MxViewItems  *view_items,
+                          ClutterModel *model)
+{
+  if (view_items->model)
+    {
+      g_signal_handlers_disconnect_by_func (view_items->model,
+                                            (GCallback) model_changed_cb,
+                                            view_items);
+      g_signal_handlers_disconnect_by_func (view_items->model,
+                                            (GCallback) row_added_cb,
+                                            view_items);
+      g_signal_handlers_disconnect_by_func (view_items->model,
+                                            (GCallback) row_changed_cb,
+                                            view_items);
+      g_signal_handlers_disconnect_by_func (view_items->model,
+                                            (GCallback) row_removed_cb,
+                                            view_items);
+      g_object_unref (view_items->model);
+
+      /* the recorded changes were made to the old model */
+      mx_view_items_drop_pending (view_items);
+
+      view_items->model = NULL;
+    }
+
+  if (model)
+    {
+      view_items->model = g_object_ref (model);
+
+      g_signal_connect (view_items->model, "filter-changed",
+                        G_CALLBACK (model_changed_cb), view_items);
+
+      g_signal_connect (view_items->model, "row-added",
+                        G_CALLBACK (row_added_cb), view_items);
+
+      g_signal_connect (view_items->model, "row-changed",
+                        G_CALLBACK (row_changed_cb), view_items);
+
+      /*
+       * model_changed_cb (called from row_removed_cb) expects the row to
+       * already have been removed, thus we need to use _after
+       */
+      g_signal_connect_after (view_items->model, "row-removed",
+                              G_CALLBACK (row_removed_cb), view_items);
+
+      g_signal_connect (view_items->model, "sort-changed",
+                        G_CALLBACK (model_changed_cb), view_items);
+
+      /*
+       * Only do this inside this block, setting the model to NULL should have
+       * the effect of preserving the view; just disconnect the handlers
+       */
+      model_changed_cb (view_items->model, view_items);
+    }
+}
+
+void
+_mx_view_items_set_item_type (MxViewItems *view_items,
+                              GType        item_type)
+{
+  view_items->item_type = item_type;
+
+  /* update the view */
+  model_changed_cb (view_items->model, view_items);
+}
+
+void
+_mx_view_items_set_factory (MxViewItems   *view_items,
+                            MxItemFactory *factory)
+{
+  if (view_items->factory)
+    {
+      g_object_unref (view_items->factory);
+      view_items->factory = NULL;
+    }
+
+  if (factory)
+    view_items->factory = g_object_ref (factory);
+}
+
+void
+_mx_view_items_add_attribute (MxViewItems *view_items,
+                              const gchar *attribute,
+                              gint         column)
+{
+  AttributeData *prop;
+
+  prop = g_new (AttributeData, 1);
+  prop->name = g_strdup (attribute);
+  prop->col = column;
+
+  view_items->attributes = g_slist_prepend (view_items->attributes, prop);
+  model_changed_cb (view_items->model, view_items);
+}
+
+void
+_mx_view_items_freeze (MxViewItems *view_items)
+{
+  view_items->is_frozen = TRUE;
+}
+
+void
+_mx_view_items_thaw (MxViewItems *view_items)
+{
+  view_items->is_frozen = FALSE;
+
+  if (view_items->needs_resync)
+    {
+      /* Repopulate */
+      view_items->needs_resync = FALSE;
+      mx_view_items_drop_pending (view_items);
+      model_changed_cb (view_items->model, view_items);
+    }
+  else if (view_items->pending)
+    mx_view_items_apply_pending (view_items);
+}
+
+/* The view resets its measurements before switching, as the children are
+ * laid out differently in each mode */
+void
+_mx_view_items_set_virtual (MxViewItems *view_items,
+                            gboolean     is_virtual)
+{
+  GList *children, *l;
+
+  view_items->is_virtual = is_virtual;
+
+  /* start over */
+  children = clutter_container_get_children (CLUTTER_CONTAINER
+                                             (view_items->view));
+  for (l = children; l; l = l->next)
+    clutter_container_remove_actor (CLUTTER_CONTAINER (view_items->view),
+                                    (ClutterActor *) l->data);
+  g_list_free (children);
+
+  g_ptr_array_set_size (view_items->items, 0);
+  mx_view_items_drop_pending (view_items);
+  mx_view_items_stop_populating (view_items);
+  view_items->first_row = 0;
+
+  mx_view_items_vadjustment_notify_cb (view_items->view, NULL, view_items);
+
+  model_changed_cb (view_items->model, view_items);
+}
+
+void
+_mx_view_items_set_use_actor_manager (MxViewItems *view_items,
+                                      gboolean     use_actor_manager)
+{
+  view_items->use_actor_manager = use_actor_manager;
+
+  /* create the items that are still missing straight away */
+  if (!use_actor_manager && view_items->is_populating)
+    {
+      mx_view_items_stop_populating (view_items);
+      model_changed_cb (view_items->model, view_items);
+    }
+}
+
+/* Called by the view after allocating in virtual mode: the viewport may
+ * have grown, or the measurements changed */
+void
+_mx_view_items_check_window (MxViewItems *view_items)
+{
+  gint n_rows, first, n;
+
+  n_rows = view_items->model ?
+    clutter_model_get_n_rows (view_items->model) : 0;
+
+  mx_view_items_get_window (view_items, n_rows, &first, &n);
+  if (first != view_items->first_row || n != (gint) view_items->items->len)
+    mx_view_items_queue_update (view_items);
+}
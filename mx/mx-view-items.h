@@ -0,0 +1,119 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-view-items.h: the items of a view driven by a model
+ *
+ * Copyright 2010 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __MX_VIEW_ITEMS_H__
+#define __MX_VIEW_ITEMS_H__
+
+#include <clutter/clutter.h>
+#include "mx-actor-manager.h"
+#include "mx-adjustment.h"
+#include "mx-item-factory.h"
+
+G_BEGIN_DECLS
+
+/* MxListView and MxItemView keep an item for each row of their model, or
+ * for the rows in or near the viewport in virtual mode. MxViewItems does
+ * that for both of them: it follows the model, creates, binds, reuses and
+ * removes the items, records the changes made while frozen and populates
+ * through the actor manager. The view only lays the items out.
+ *
+ * The view emits its own "populated" signal once the actor manager has
+ * added an item for every row.
+ */
+typedef struct _MxViewItems MxViewItems;
+
+typedef struct
+{
+  /* The height of a line of items, or 0 if no item has been measured
+   * yet, the spacing between lines and the number of items on a line */
+  void (*get_lines) (ClutterActor *view,
+                     gfloat       *line_height,
+                     gfloat       *spacing,
+                     gint         *columns);
+
+  /* Measures the first item, which is the only one a virtual view has
+   * until it knows how many items fit in the viewport */
+  void (*measure)   (ClutterActor *view,
+                     ClutterActor *item);
+} MxViewItemsFuncs;
+
+struct _MxViewItems
+{
+  ClutterActor           *view;
+  const MxViewItemsFuncs *funcs;
+
+  /* lines kept either side of the viewport in virtual mode */
+  gint            margin;
+
+  ClutterModel   *model;
+  GSList         *attributes;
+  GType           item_type;
+  MxItemFactory  *factory;
+
+  /* items[i] shows row first_row + i, first_row is only ever non-zero
+   * in virtual mode */
+  GPtrArray      *items;
+  gint            first_row;
+  MxAdjustment   *vadjustment;
+  guint           update_id;
+
+  /* changes made to the model while frozen, applied when thawed */
+  GArray         *pending;
+  GSList         *removed;
+
+  /* creating the items for the rows after the last item */
+  MxActorManager *manager;
+  gulong          populate_op;
+
+  guint           is_frozen : 1;
+  guint           needs_resync : 1;
+  guint           is_virtual : 1;
+  guint           use_actor_manager : 1;
+  guint           is_populating : 1;
+};
+
+MxViewItems * _mx_view_items_new     (ClutterActor           *view,
+                                      const MxViewItemsFuncs *funcs,
+                                      gint                    margin);
+void          _mx_view_items_dispose (MxViewItems            *view_items);
+void          _mx_view_items_free    (MxViewItems            *view_items);
+
+void _mx_view_items_set_model         (MxViewItems   *view_items,
+                                       ClutterModel  *model);
+void _mx_view_items_set_item_type     (MxViewItems   *view_items,
+                                       GType          item_type);
+void _mx_view_items_set_factory       (MxViewItems   *view_items,
+                                       MxItemFactory *factory);
+void _mx_view_items_add_attribute     (MxViewItems   *view_items,
+                                       const gchar   *attribute,
+                                       gint           column);
+void _mx_view_items_freeze            (MxViewItems   *view_items);
+void _mx_view_items_thaw              (MxViewItems   *view_items);
+void _mx_view_items_set_virtual       (MxViewItems   *view_items,
+                                       gboolean       is_virtual);
+void _mx_view_items_set_use_actor_manager (MxViewItems *view_items,
+                                           gboolean     use_actor_manager);
+
+void _mx_view_items_check_window      (MxViewItems   *view_items);
+
+G_END_DECLS
+
+#endif /* __MX_VIEW_ITEMS_H__ */
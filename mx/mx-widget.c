@@ -56,12 +56,13 @@ struct _MxWidgetPrivate
   MxStyle       *style;
   gchar         *pseudo_class;
   gchar         *style_class;
-  MxBorderImage *mx_border_image;
+
+  /* the style values currently applied to the widget */
+  MxComputedStyle *computed;
 
   ClutterActor *border_image;
   ClutterActor *old_border_image;
   ClutterActor *background_image;
-  ClutterColor *bg_color;
 
   guint         is_hovered : 1;
   guint         is_disabled : 1;
@@ -318,14 +319,12 @@ mx_widget_finalize (GObject *gobject)
   g_free (priv->style_class);
   g_free (priv->pseudo_class);
 
-  if (priv->mx_border_image)
+  if (priv->computed)
     {
-      g_boxed_free (MX_TYPE_BORDER_IMAGE, priv->mx_border_image);
-      priv->mx_border_image = NULL;
+      _mx_computed_style_unref (priv->computed);
+      priv->computed = NULL;
     }
 
-  clutter_color_free (priv->bg_color);
-
   G_OBJECT_CLASS (mx_widget_parent_class)->finalize (gobject);
 }
 
@@ -446,6 +445,17 @@ mx_widget_allocate (ClutterActor          *actor,
                                            flags);
 }
 
+static const ClutterColor *
+mx_widget_get_background_color (MxWidget *widget)
+{
+  MxComputedStyle *computed = widget->priv->computed;
+
+  if (computed && computed->has_background_color)
+    return &computed->background_color;
+
+  return NULL;
+}
+
 static void
 mx_widget_real_paint_background (MxWidget           *self,
                                  ClutterActor       *background,
@@ -487,12 +497,13 @@ mx_widget_real_paint_background (MxWidget           *self,
 static void
 mx_widget_paint (ClutterActor *self)
 {
-  MxWidgetPrivate *priv = MX_WIDGET (self)->priv;
+  MxWidget *widget = MX_WIDGET (self);
+  MxWidgetPrivate *priv = widget->priv;
   MxWidgetClass *klass = MX_WIDGET_GET_CLASS (self);
 
-  klass->paint_background (MX_WIDGET (self),
+  klass->paint_background (widget,
                            priv->border_image,
-                           priv->bg_color);
+                           mx_widget_get_background_color (widget));
 
   if (priv->background_image != NULL)
     clutter_actor_paint (priv->background_image);
@@ -599,76 +610,217 @@ mx_border_image_equal (MxBorderImage *v1,
   return FALSE;
 }
 
+/* incremented whenever the default font changes, since the default values
+ * of the font properties come from the settings */
+static guint computed_style_settings_serial = 0;
+
 static void
-mx_widget_style_changed (MxStylable *self, MxStyleChangedFlags flags)
+mx_computed_style_settings_changed (void)
 {
-  MxWidgetPrivate *priv = MX_WIDGET (self)->priv;
-  MxBorderImage *border_image = NULL, *background_image = NULL;
-  MxTextureCache *texture_cache;
-  ClutterTexture *texture;
-  gchar *bg_file;
+  computed_style_settings_serial++;
+}
+
+MxComputedStyle *
+_mx_computed_style_ref (MxComputedStyle *computed)
+{
+  computed->ref_count++;
+
+  return computed;
+}
+
+void
+_mx_computed_style_unref (MxComputedStyle *computed)
+{
+  if (--computed->ref_count > 0)
+    return;
+
+  if (computed->background_image)
+    g_boxed_free (MX_TYPE_BORDER_IMAGE, computed->background_image);
+
+  if (computed->border_image)
+    g_boxed_free (MX_TYPE_BORDER_IMAGE, computed->border_image);
+
+  g_free (computed->font_family);
+  g_free (computed->font_name);
+
+  if (computed->properties)
+    g_hash_table_unref (computed->properties);
+
+  g_slice_free (MxComputedStyle, computed);
+}
+
+static MxComputedStyle *
+mx_computed_style_new (MxStylable *stylable,
+                       GHashTable *properties)
+{
+  ClutterColor *background_color = NULL, *color = NULL;
+  MxComputedStyle *computed;
   MxPadding *padding = NULL;
-  gboolean relayout_needed = FALSE;
-  gboolean has_changed = FALSE;
-  ClutterColor *color;
-  guint duration;
-  gboolean border_image_changed = FALSE;
 
-  /* cache these values for use in the paint function */
-  mx_stylable_get (self,
-                   "background-color", &color,
-                   "background-image", &background_image,
-                   "border-image", &border_image,
+  computed = g_slice_new0 (MxComputedStyle);
+  computed->ref_count = 1;
+  computed->properties = properties ? g_hash_table_ref (properties) : NULL;
+  computed->settings_serial = computed_style_settings_serial;
+
+  mx_stylable_get (stylable,
+                   "background-color", &background_color,
+                   "color", &color,
+                   "background-image", &computed->background_image,
+                   "border-image", &computed->border_image,
                    "padding", &padding,
-                   "x-mx-border-image-transition-duration", &duration,
+                   "x-mx-border-image-transition-duration",
+                   &computed->border_image_transition_duration,
+                   "font-family", &computed->font_family,
+                   "font-size", &computed->font_size,
+                   "font-weight", &computed->font_weight,
                    NULL);
 
+  if (background_color)
+    {
+      computed->background_color = *background_color;
+      computed->has_background_color = TRUE;
+      clutter_color_free (background_color);
+    }
+
   if (color)
     {
-      if (priv->bg_color && clutter_color_equal (color, priv->bg_color))
-        {
-          /* color is the same ... */
-          clutter_color_free (color);
-        }
-      else
-        {
-          clutter_color_free (priv->bg_color);
-          priv->bg_color = color;
-          has_changed = TRUE;
-        }
+      computed->color = *color;
+      computed->has_color = TRUE;
+      clutter_color_free (color);
     }
-  else
-  if (priv->bg_color)
+
+  if (padding)
     {
-      clutter_color_free (priv->bg_color);
-      priv->bg_color = NULL;
-      has_changed = TRUE;
+      computed->padding = *padding;
+      g_boxed_free (MX_TYPE_PADDING, padding);
     }
 
+  computed->font_name = _mx_font_name_from_style (computed->font_family,
+                                                  computed->font_size,
+                                                  computed->font_weight);
 
+  return computed;
+}
 
-  if (padding)
+/* Returns the values of the MxWidget style properties for @widget. The
+ * values are computed once for each set of matched properties and kept on
+ * the style key, so all the widgets with the same key share them. The
+ * result is owned by the style key and is only valid until the style of
+ * @widget changes.
+ */
+MxComputedStyle *
+_mx_widget_get_computed_style (MxWidget *widget)
+{
+  MxStylable *stylable = MX_STYLABLE (widget);
+  MxComputedStyle *computed;
+  GHashTable *properties;
+  MxStyleKey *key;
+  MxStyle *style;
+
+  style = mx_stylable_get_style (stylable);
+  properties = style ? _mx_style_get_properties (style, stylable) : NULL;
+  key = _mx_stylable_get_style_key (stylable);
+
+  computed = key->computed;
+  if (!computed ||
+      computed->properties != properties ||
+      computed->settings_serial != computed_style_settings_serial)
     {
-      if (priv->padding.top != padding->top ||
-          priv->padding.left != padding->left ||
-          priv->padding.right != padding->right ||
-          priv->padding.bottom != padding->bottom)
+      static gboolean connected = FALSE;
+
+      if (G_UNLIKELY (!connected))
         {
-          /* Padding changed. Need to relayout. */
-          has_changed = TRUE;
-          relayout_needed = TRUE;
+          g_signal_connect (mx_settings_get_default (), "notify::font-name",
+                            G_CALLBACK (mx_computed_style_settings_changed),
+                            NULL);
+          connected = TRUE;
         }
 
-      priv->padding = *padding;
-      g_boxed_free (MX_TYPE_PADDING, padding);
+      if (key->computed)
+        _mx_computed_style_unref (key->computed);
+
+      computed = key->computed = mx_computed_style_new (stylable, properties);
     }
 
+  if (properties)
+    g_hash_table_unref (properties);
+
+  return computed;
+}
+
+/* Returns the style values applied to @widget the last time its style
+ * changed, without looking up its style again, so it is cheap enough to
+ * call when painting. The result is only valid until the style of @widget
+ * changes.
+ */
+MxComputedStyle *
+_mx_widget_get_applied_style (MxWidget *widget)
+{
+  MxWidgetPrivate *priv = widget->priv;
+
+  if (G_LIKELY (priv->computed))
+    return priv->computed;
+
+  /* the widget hasn't been styled yet */
+  return _mx_widget_get_computed_style (widget);
+}
+
+static void
+mx_widget_style_changed (MxStylable *self, MxStyleChangedFlags flags)
+{
+  MxWidgetPrivate *priv = MX_WIDGET (self)->priv;
+  MxComputedStyle *style, *old_style;
+  MxBorderImage *border_image, *background_image;
+  MxTextureCache *texture_cache;
+  ClutterTexture *texture;
+  gchar *bg_file;
+  gboolean relayout_needed = FALSE;
+  gboolean has_changed = FALSE;
+  guint duration;
+  gboolean border_image_changed = FALSE;
+  gboolean background_image_changed = FALSE;
+
+  /* widgets that match the same rules share the same computed style, so if
+   * it is the one already applied there is nothing to do */
+  style = _mx_widget_get_computed_style (MX_WIDGET (self));
+  old_style = priv->computed;
+  if (style == old_style)
+    return;
+
+  priv->computed = _mx_computed_style_ref (style);
+
+  border_image = style->border_image;
+  background_image = style->background_image;
+  duration = style->border_image_transition_duration;
+
+  /* background-color property */
+  if (!old_style ||
+      old_style->has_background_color != style->has_background_color ||
+      (style->has_background_color &&
+       !clutter_color_equal (&old_style->background_color,
+                             &style->background_color)))
+    has_changed = TRUE;
+
+  /* padding property */
+  if (priv->padding.top != style->padding.top ||
+      priv->padding.left != style->padding.left ||
+      priv->padding.right != style->padding.right ||
+      priv->padding.bottom != style->padding.bottom)
+    {
+      /* Padding changed. Need to relayout. */
+      has_changed = TRUE;
+      relayout_needed = TRUE;
+    }
+
+  priv->padding = style->padding;
+
 
   /* border-image property */
 
   /* check whether the border-image has changed */
-  border_image_changed = mx_border_image_equal (priv->mx_border_image,
-                                                border_image);
+  border_image_changed =
+    mx_border_image_equal (old_style ? old_style->border_image : NULL,
+                           border_image);
 
   /* remove the old border-image if it has changed */
   if (border_image_changed && priv->border_image)
@@ -731,29 +883,20 @@ mx_widget_style_changed (MxStylable *self, MxStyleChangedFlags flags)
       relayout_needed = TRUE;
     }
 
-  /* if the border-image has changed, free the old one and store the new one */
-  if (border_image_changed)
-    {
-      if (priv->mx_border_image)
-        g_boxed_free (MX_TYPE_BORDER_IMAGE, priv->mx_border_image);
-
-      priv->mx_border_image = border_image;
-    }
-  else
-    {
-      /* If it's not changed just free the one we've requested */
-      if (border_image)
-        g_boxed_free (MX_TYPE_BORDER_IMAGE, border_image);
-    }
-
   /* background-image property */
-  if (priv->background_image)
+  background_image_changed =
+    mx_border_image_equal (old_style ? old_style->background_image : NULL,
+                           background_image);
+
+  if (background_image_changed && priv->background_image)
     {
       clutter_actor_unparent (priv->background_image);
       priv->background_image = NULL;
+
+      has_changed = TRUE;
     }
 
-  if (background_image)
+  if (background_image_changed && background_image)
     {
       bg_file = background_image->uri;
       if (bg_file != NULL &&
@@ -773,9 +916,11 @@ mx_widget_style_changed (MxStylable *self, MxStyleChangedFlags flags)
           has_changed = TRUE;
           relayout_needed = TRUE;
         }
-      g_boxed_free (MX_TYPE_BORDER_IMAGE, background_image);
     }
 
+  if (old_style)
+    _mx_computed_style_unref (old_style);
+
   /* If there are any properties above that need to cause a relayout thay
    * should set this flag.
    */
@@ -1631,7 +1776,7 @@ mx_widget_paint_background (MxWidget *self)
   klass = MX_WIDGET_GET_CLASS (self);
   klass->paint_background (MX_WIDGET (self),
                           priv->border_image,
-                          priv->bg_color);
+                          mx_widget_get_background_color (self));
 
 }
 
@@ -0,0 +1,685 @@
+/*
+ * Copyright 2011 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Parses style sheets with the style sheet parser in libmx and with the
+ * GScanner based parser it replaced, and checks that both produce the same
+ * selectors and declarations. The style sheets given on the command line
+ * are checked, or the default theme if there are none, followed by a set of
+ * edge cases.
+ *
+ * Each style sheet is copied into a temporary directory first, so that the
+ * files given on the command line and the edge cases are parsed the same
+ * way.
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <mx/mx.h>
+#include <mx/mx-css.h>
+
+static const gchar *edge_cases[] =
+{
+  /* comments everywhere, including inside and across values */
+  "/* leading */ MxButton /* a */ { /* b */ color: /* c */ red /* d */; }\n"
+  "MxLabel { font-family: Sans /* multi\nline */ Bold; }\n",
+
+  /* values over several lines, and surrounding whitespace */
+  "MxEntry {\n  border-image:\n    url(\"entry.png\")\n    5;\n"
+  "  padding:\t 4px  8px \t;\n}\n",
+
+  /* vendor prefixes, digits and dashes in names */
+  "MxFrame { -mx-spacing: 2px; -x-mx-border-image-2: none; x-y: 1; }\n",
+
+  /* ids, classes, multiple pseudo-classes and the universal selector */
+  "* { color: #000; }\n"
+  "MxButton#ok.primary:hover:active { color: #ff0000; }\n"
+  ".toolbar:checked, #close, :focus { opacity: 0.5; }\n",
+
+  /* descendant and child combinators, and selector lists of them */
+  "MxWindow MxToolbar > MxButton.close { width: 16px; }\n"
+  "MxTable > MxLabel, MxBox MxLabel > .title:hover { font-weight: bold; }\n",
+
+  /* later declarations of the same property replace earlier ones */
+  "MxButton { color: red; color: blue; background-color: white; }\n",
+
+  /* no whitespace at all, and an empty block */
+  "MxSlider>MxButton{width:10px;height:20px;}MxTooltip{}\n",
+
+  /* hex colours, quotes and punctuation in values */
+  "MxLabel { color: #a0b1c2; font-family: \"DejaVu Sans\", 'Liberation';"
+  " background-image: url(file:///tmp/a,b.png); }\n",
+
+  NULL
+};
+
+
+/* The GScanner based parser libmx used before */
+
+typedef struct _OldSelector OldSelector;
+struct _OldSelector
+{
+  gchar *type;
+  gchar *id;
+  gchar *class;
+  gchar *pseudo_class;
+  OldSelector *parent;
+  OldSelector *ancestor;
+  GHashTable *style;
+};
+
+typedef struct
+{
+  GList *selectors;
+  GList *styles;
+} OldStyleSheet;
+
+static gchar*
+append (gchar *str1, const gchar *str2)
+{
+  gchar *tmp;
+
+  if (!str1)
+      return g_strdup (str2);
+
+  if (!str2)
+      return str1;
+
+  tmp = g_strconcat (str1, str2, NULL);
+  g_free (str1);
+  return tmp;
+}
+
+static gchar*
+appendc (gchar *str, gchar c)
+{
+  gchar *tmp;
+  gint len;
+
+  if (str == NULL)
+    {
+      tmp = g_malloc (2);
+      len = 0;
+    }
+  else
+    {
+      len = strlen (str);
+      tmp = g_realloc (str, len + 2);
+    }
+
+  tmp[len] = c;
+  tmp[len + 1] = '\0';
+
+  return tmp;
+}
+
+static GTokenType
+old_parse_key_value (GScanner *scanner, gchar **key, gchar **value)
+{
+  GTokenType token;
+  gboolean start_with_dash = FALSE;
+  gchar *id_first = scanner->config->cset_identifier_first;
+  gchar *id_nth = scanner->config->cset_identifier_nth;
+  guint scan_identifier_1char = scanner->config->scan_identifier_1char;
+
+  /* parse property name */
+  token = g_scanner_get_next_token (scanner);
+
+  /* allow property names to start with '-' */
+  if (token == '-')
+    {
+      token = g_scanner_get_next_token (scanner);
+      start_with_dash = TRUE;
+    }
+
+  if (token != G_TOKEN_IDENTIFIER)
+    return G_TOKEN_IDENTIFIER;
+
+  if (start_with_dash)
+    *key = g_strconcat ("-", scanner->value.v_identifier, NULL);
+  else
+    *key = g_strdup (scanner->value.v_identifier);
+
+  token = g_scanner_get_next_token (scanner);
+  if (token != ':')
+    return ':';
+
+  /* value parsing options */
+  scanner->config->cset_identifier_first = G_CSET_a_2_z "#_-0123456789"
+    G_CSET_A_2_Z G_CSET_LATINS G_CSET_LATINC;
+  scanner->config->cset_identifier_nth = scanner->config->cset_identifier_first;
+  scanner->config->scan_identifier_1char = 1;
+  scanner->config->char_2_token = FALSE;
+  scanner->config->cset_skip_characters = "\n";
+
+  /* parse value */
+  while (scanner->next_value.v_char != ';')
+    {
+      token = g_scanner_get_next_token (scanner);
+      switch (token)
+        {
+        case G_TOKEN_IDENTIFIER:
+          *value = append (*value, scanner->value.v_identifier);
+          break;
+        case G_TOKEN_CHAR:
+          *value = appendc (*value, scanner->value.v_char);
+          break;
+
+        default:
+          return ';';
+        }
+
+      g_scanner_peek_next_token (scanner);
+    }
+
+  /* semi colon */
+  g_scanner_get_next_token (scanner);
+  if (scanner->value.v_char != ';')
+    return ';';
+
+  /* we've come to the end of the value, so reset the options */
+  scanner->config->cset_identifier_nth = id_nth;
+  scanner->config->cset_identifier_first = id_first;
+  scanner->config->scan_identifier_1char = scan_identifier_1char;
+  scanner->config->char_2_token = TRUE;
+  scanner->config->cset_skip_characters = " \t\n";
+
+  /* strip the leading and trailing whitespace */
+  g_strstrip (*value);
+
+  return G_TOKEN_NONE;
+}
+
+static GTokenType
+old_parse_style (GScanner *scanner, GHashTable *table)
+{
+  GTokenType token;
+
+  /* { */
+  token = g_scanner_get_next_token (scanner);
+  if (token != G_TOKEN_LEFT_CURLY)
+    return G_TOKEN_LEFT_CURLY;
+
+  /* keep going until we find '}' */
+  token = g_scanner_peek_next_token (scanner);
+  while (token != G_TOKEN_RIGHT_CURLY)
+    {
+      gchar *key = NULL, *value = NULL;
+
+      token = old_parse_key_value (scanner, &key, &value);
+      if (token != G_TOKEN_NONE)
+        {
+          g_free (key);
+          g_free (value);
+          return token;
+        }
+
+      g_hash_table_insert (table, key, value);
+
+      token = g_scanner_peek_next_token (scanner);
+    }
+
+  /* } */
+  token = g_scanner_get_next_token (scanner);
+  if (token != G_TOKEN_RIGHT_CURLY)
+    return G_TOKEN_RIGHT_CURLY;
+
+  return G_TOKEN_NONE;
+}
+
+static GTokenType
+old_parse_simple_selector (GScanner    *scanner,
+                           OldSelector *selector)
+{
+  guint token;
+  gchar *tmp;
+
+  /* parse optional type (either '*' or an identifier) */
+  token = g_scanner_peek_next_token (scanner);
+  switch (token)
+    {
+    case '*':
+      g_scanner_get_next_token (scanner);
+      selector->type = g_strdup ("*");
+      break;
+    case G_TOKEN_IDENTIFIER:
+      g_scanner_get_next_token (scanner);
+      selector->type = g_strdup (scanner->value.v_identifier);
+      break;
+    default:
+      break;
+    }
+
+  /* Here we look for '#', '.' or ':' and return if we find anything else */
+  token = g_scanner_peek_next_token (scanner);
+  while (token != G_TOKEN_NONE)
+    {
+      switch (token)
+        {
+          /* id */
+        case '#':
+          g_scanner_get_next_token (scanner);
+          token = g_scanner_get_next_token (scanner);
+          if (token != G_TOKEN_IDENTIFIER)
+            return G_TOKEN_IDENTIFIER;
+          selector->id = g_strdup (scanner->value.v_identifier);
+          break;
+          /* class */
+        case '.':
+          g_scanner_get_next_token (scanner);
+          token = g_scanner_get_next_token (scanner);
+          if (token != G_TOKEN_IDENTIFIER)
+            return G_TOKEN_IDENTIFIER;
+          selector->class = g_strdup (scanner->value.v_identifier);
+          break;
+          /* pseudo-class */
+        case ':':
+          g_scanner_get_next_token (scanner);
+          token = g_scanner_get_next_token (scanner);
+          if (token != G_TOKEN_IDENTIFIER)
+            return G_TOKEN_IDENTIFIER;
+
+          tmp = selector->pseudo_class;
+
+          if (selector->pseudo_class)
+            selector->pseudo_class = g_strconcat (selector->pseudo_class, ":",
+                                                  scanner->value.v_identifier,
+                                                  NULL);
+          else
+            selector->pseudo_class = g_strdup (scanner->value.v_identifier);
+
+          g_free (tmp);
+
+          break;
+
+          /* unhandled */
+        default:
+          return G_TOKEN_NONE;
+          break;
+        }
+      token = g_scanner_peek_next_token (scanner);
+    }
+  return G_TOKEN_NONE;
+}
+
+static void
+old_selector_free (OldSelector *selector)
+{
+  if (!selector)
+    return;
+
+  g_free (selector->type);
+  g_free (selector->id);
+  g_free (selector->class);
+  g_free (selector->pseudo_class);
+
+  old_selector_free (selector->parent);
+  old_selector_free (selector->ancestor);
+
+  g_slice_free (OldSelector, selector);
+}
+
+static GTokenType
+old_parse_ruleset (GScanner *scanner, GList **selectors)
+{
+  guint token;
+  OldSelector *selector, *parent;
+
+  /* parse the first selector, then keep going until we find left curly */
+  token = g_scanner_peek_next_token (scanner);
+
+  parent = NULL;
+  selector = NULL;
+  while (token != G_TOKEN_LEFT_CURLY)
+    {
+      switch (token)
+        {
+        case G_TOKEN_IDENTIFIER:
+        case '*':
+        case '#':
+        case '.':
+        case ':':
+
+          if (selector)
+            parent = selector;
+          else
+            parent = NULL;
+
+          /* check if there was a previous selector and if so, the new one
+           * should use the previous selector to match an ancestor */
+
+          selector = g_slice_new0 (OldSelector);
+          *selectors = g_list_prepend (*selectors, selector);
+
+          if (parent)
+            {
+              *selectors = g_list_remove (*selectors, parent);
+              selector->ancestor = parent;
+            }
+
+          token = old_parse_simple_selector (scanner, selector);
+          if (token != G_TOKEN_NONE)
+            return token;
+
+          break;
+
+        case '>':
+          g_scanner_get_next_token (scanner);
+
+          parent = selector;
+
+          selector = g_slice_new0 (OldSelector);
+          *selectors = g_list_prepend (*selectors, selector);
+
+          /* remove parent from list of selectors and link it to the new
+           * selector */
+          selector->parent = parent;
+          *selectors = g_list_remove (*selectors, parent);
+
+          token = old_parse_simple_selector (scanner, selector);
+          if (token != G_TOKEN_NONE)
+            return token;
+
+          break;
+
+        case ',':
+          g_scanner_get_next_token (scanner);
+
+          selector = g_slice_new0 (OldSelector);
+          *selectors = g_list_prepend (*selectors, selector);
+
+          token = old_parse_simple_selector (scanner, selector);
+
+          if (token != G_TOKEN_NONE)
+            return token;
+
+          break;
+
+        default:
+          g_scanner_get_next_token (scanner);
+          g_scanner_unexp_token (scanner, G_TOKEN_ERROR, NULL, NULL, NULL,
+                                 "Unhandled selector", 1);
+          return '{';
+        }
+      token = g_scanner_peek_next_token (scanner);
+    }
+
+  return G_TOKEN_NONE;
+}
+
+static GTokenType
+old_parse_block (GScanner      *scanner,
+                 OldStyleSheet *sheet)
+{
+  GTokenType token;
+  GHashTable *table;
+  GList *l, *list = NULL;
+
+  token = old_parse_ruleset (scanner, &list);
+  if (token != G_TOKEN_NONE)
+    {
+      g_list_foreach (list, (GFunc) old_selector_free, NULL);
+      g_list_free (list);
+      return token;
+    }
+
+  /* libmx compares the names by pointer; here they are compared by value
+   * so that repeated declarations replace each other in the same way */
+  table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  token = old_parse_style (scanner, table);
+
+  for (l = list; l; l = l->next)
+    ((OldSelector *) l->data)->style = table;
+
+  sheet->styles = g_list_append (sheet->styles, table);
+  sheet->selectors = g_list_concat (sheet->selectors, list);
+
+  return token;
+}
+
+static gboolean
+old_parse_file (OldStyleSheet *sheet,
+                const gchar   *filename)
+{
+  GScanner *scanner;
+  GTokenType token;
+  gchar *contents;
+  gsize length;
+
+  if (!g_file_get_contents (filename, &contents, &length, NULL))
+    return FALSE;
+
+  scanner = g_scanner_new (NULL);
+  scanner->input_name = filename;
+
+  /* turn off single line comments, we need to parse '#' */
+  scanner->config->cpair_comment_single = "\1\n";
+  scanner->config->cset_identifier_nth = G_CSET_a_2_z "-_0123456789"
+    G_CSET_A_2_Z G_CSET_LATINS G_CSET_LATINC;
+  scanner->config->scan_float = FALSE; /* allows scanning '.' */
+  scanner->config->scan_hex = FALSE;
+  scanner->config->scan_string_sq = FALSE;
+  scanner->config->scan_string_dq = FALSE;
+
+  g_scanner_input_text (scanner, contents, length);
+
+  token = g_scanner_peek_next_token (scanner);
+  while (token != G_TOKEN_EOF)
+    {
+      token = old_parse_block (scanner, sheet);
+      if (token != G_TOKEN_NONE)
+        break;
+
+      token = g_scanner_peek_next_token (scanner);
+    }
+
+  if (token != G_TOKEN_EOF)
+    g_scanner_unexp_token (scanner, token, NULL, NULL, NULL, "Error",
+                           TRUE);
+
+  g_scanner_destroy (scanner);
+  g_free (contents);
+
+  return (token == G_TOKEN_EOF);
+}
+
+static void
+old_style_sheet_free (OldStyleSheet *sheet)
+{
+  g_list_foreach (sheet->selectors, (GFunc) old_selector_free, NULL);
+  g_list_free (sheet->selectors);
+
+  g_list_foreach (sheet->styles, (GFunc) g_hash_table_destroy, NULL);
+  g_list_free (sheet->styles);
+}
+
+/* Must write the same format as mx_style_sheet_to_string() */
+static gchar *
+old_selector_to_string (OldSelector *selector)
+{
+  gchar *ancestor, *string, *tmp, *parent, *ret;
+
+  if (!selector)
+    return NULL;
+
+  tmp = old_selector_to_string (selector->ancestor);
+  ancestor = tmp ? g_strconcat (tmp, " ", NULL) : NULL;
+  g_free (tmp);
+
+  tmp = old_selector_to_string (selector->parent);
+  parent = tmp ? g_strconcat (tmp, " > ", NULL) : NULL;
+  g_free (tmp);
+
+  string = g_strdup_printf ("%s%s%s%s%s%s%s",
+                            (selector->type) ?  selector->type : "",
+                            (selector->class) ? "." : "",
+                            (selector->class) ? selector->class : "",
+                            (selector->id) ? "#" : "",
+                            (selector->id) ? selector->id : "",
+                            (selector->pseudo_class) ? "#" : "",
+                            (selector->pseudo_class)
+                            ? selector->pseudo_class : "");
+
+  ret = g_strconcat ((ancestor) ? ancestor : "",
+                     (parent) ? parent : "",
+                     string, NULL);
+
+  g_free (string);
+  g_free (ancestor);
+  g_free (parent);
+
+  return ret;
+}
+
+static gchar *
+old_style_sheet_to_string (OldStyleSheet *sheet)
+{
+  GString *string;
+  GList *l, *k, *keys;
+
+  string = g_string_new (NULL);
+
+  for (l = sheet->selectors; l; l = l->next)
+    {
+      OldSelector *selector = l->data;
+      gchar *name;
+
+      name = old_selector_to_string (selector);
+      g_string_append_printf (string, "%s {\n", name);
+      g_free (name);
+
+      keys = g_hash_table_get_keys (selector->style);
+      keys = g_list_sort (keys, (GCompareFunc) strcmp);
+
+      for (k = keys; k; k = k->next)
+        {
+          const gchar *value = g_hash_table_lookup (selector->style, k->data);
+
+          g_string_append_printf (string, "  %s: %s;\n",
+                                  (gchar *) k->data, value ? value : "");
+        }
+      g_list_free (keys);
+
+      g_string_append (string, "}\n");
+    }
+
+  return g_string_free (string, FALSE);
+}
+
+
+static gboolean
+compare_parsers (const gchar *name,
+                 const gchar *contents,
+                 gssize       length,
+                 const gchar *dirname)
+{
+  OldStyleSheet old_sheet = { NULL, NULL };
+  MxStyleSheet *sheet;
+  gchar *filename, *old_string, *new_string;
+  gboolean old_result, new_result, equal;
+
+  filename = g_build_filename (dirname, "test.css", NULL);
+  if (!g_file_set_contents (filename, contents, length, NULL))
+    {
+      g_printerr ("%s: unable to write '%s'\n", name, filename);
+      g_free (filename);
+      return FALSE;
+    }
+
+  old_result = old_parse_file (&old_sheet, filename);
+  old_string = old_style_sheet_to_string (&old_sheet);
+  old_style_sheet_free (&old_sheet);
+
+  sheet = mx_style_sheet_new ();
+  new_result = mx_style_sheet_add_from_file (sheet, filename, NULL);
+  new_string = mx_style_sheet_to_string (sheet);
+  mx_style_sheet_destroy (sheet);
+
+  g_unlink (filename);
+  g_free (filename);
+
+  equal = (old_result == new_result && !strcmp (old_string, new_string));
+
+  if (equal)
+    g_print ("%s: OK (%s)\n", name, new_result ? "parsed" : "rejected");
+  else
+    g_print ("%s: FAILED\n"
+             "GScanner parser (%s):\n%s"
+             "libmx parser (%s):\n%s",
+             name,
+             old_result ? "parsed" : "rejected", old_string,
+             new_result ? "parsed" : "rejected", new_string);
+
+  g_free (old_string);
+  g_free (new_string);
+
+  return equal;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const gchar *default_files[] = { "../data/style/default.css", NULL };
+  const gchar **files;
+  gchar *dirname;
+  gboolean passed = TRUE;
+  gint i;
+
+  g_type_init ();
+
+  dirname = g_build_filename (g_get_tmp_dir (), "test-css-parser-XXXXXX",
+                              NULL);
+  if (!g_mkdtemp (dirname))
+    {
+      g_printerr ("Unable to create a temporary directory\n");
+      return 1;
+    }
+
+  files = (argc > 1) ? (const gchar **) argv + 1 : default_files;
+
+  for (i = 0; files[i]; i++)
+    {
+      gchar *contents;
+      gsize length;
+      GError *error = NULL;
+
+      if (!g_file_get_contents (files[i], &contents, &length, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          g_error_free (error);
+          passed = FALSE;
+          continue;
+        }
+
+      passed &= compare_parsers (files[i], contents, length, dirname);
+      g_free (contents);
+    }
+
+  for (i = 0; edge_cases[i]; i++)
+    {
+      gchar *name = g_strdup_printf ("edge case %d", i + 1);
+
+      passed &= compare_parsers (name, edge_cases[i], -1, dirname);
+      g_free (name);
+    }
+
+  g_rmdir (dirname);
+  g_free (dirname);
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2011 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Times setting the contents of a grid of images from memory, the way a
+ * photo browser fills its thumbnails. Pass the image size and count to
+ * try other grids. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <mx/mx.h>
+
+static void
+time_uploads (ClutterActor    *grid,
+              CoglPixelFormat  format,
+              const gchar     *name,
+              gint             bpp,
+              gint             size,
+              gint             n_images)
+{
+  GList *children, *c;
+  guchar *data;
+  GTimer *timer;
+  gdouble elapsed;
+  gint i;
+
+  data = g_malloc (size * size * bpp);
+  for (i = 0; i < size * size * bpp; i++)
+    data[i] = g_random_int ();
+
+  children = clutter_container_get_children (CLUTTER_CONTAINER (grid));
+
+  timer = g_timer_new ();
+  for (c = children; c; c = c->next)
+    mx_image_set_from_data (MX_IMAGE (c->data), data, format,
+                            size, size, size * bpp, NULL);
+  cogl_flush ();
+  g_timer_stop (timer);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_print ("%-10s %8.0f images/s %8.1f MiB/s\n", name,
+           n_images / elapsed,
+           (gdouble) n_images * size * size * bpp / elapsed / (1024 * 1024));
+
+  g_timer_destroy (timer);
+  g_list_free (children);
+  g_free (data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  ClutterActor *stage, *grid;
+  gint i, size, n_images;
+
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 1;
+
+  size = argc > 1 ? atoi (argv[1]) : 128;
+  n_images = argc > 2 ? atoi (argv[2]) : 1000;
+
+  stage = clutter_stage_get_default ();
+  grid = mx_grid_new ();
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), grid);
+
+  for (i = 0; i < n_images; i++)
+    clutter_container_add_actor (CLUTTER_CONTAINER (grid), mx_image_new ());
+
+  g_print ("%d images of %dx%d\n", n_images, size, size);
+
+  time_uploads (grid, COGL_PIXEL_FORMAT_RGBA_8888, "RGBA", 4, size, n_images);
+  time_uploads (grid, COGL_PIXEL_FORMAT_RGB_888, "RGB", 3, size, n_images);
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2011 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Times texture cache lookups of an image that is already cached, by
+ * absolute path, by URI and by relative path, next to the cost of the
+ * path to URI conversion every lookup used to do. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <mx/mx.h>
+
+#define N_LOOKUPS 100000
+
+static gchar *
+old_normalise (GRegex      *is_uri,
+               const gchar *path)
+{
+  gchar *cwd, *file, *uri;
+
+  if (g_regex_match (is_uri, path, 0, NULL))
+    return g_strdup (path);
+
+  cwd = g_get_current_dir ();
+  file = g_build_filename (cwd, path, NULL);
+  uri = g_filename_to_uri (file, NULL, NULL);
+  g_free (file);
+  g_free (cwd);
+
+  return uri;
+}
+
+static void
+report (const gchar *what,
+        GTimer      *timer)
+{
+  g_print ("%-28s %8.1f ns per lookup\n", what,
+           g_timer_elapsed (timer, NULL) * 1e9 / N_LOOKUPS);
+}
+
+static void
+time_lookups (MxTextureCache *cache,
+              const gchar    *what,
+              const gchar    *uri)
+{
+  GTimer *timer;
+  gint i;
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_LOOKUPS; i++)
+    cogl_handle_unref (mx_texture_cache_get_cogl_texture (cache, uri));
+  g_timer_stop (timer);
+
+  report (what, timer);
+  g_timer_destroy (timer);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const gchar *filename = argc > 1 ? argv[1] : "redhand.png";
+  gchar *cwd, *path, *uri;
+  MxTextureCache *cache;
+  CoglHandle texture;
+  GRegex *is_uri;
+  GTimer *timer;
+  gint i;
+
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 1;
+
+  if (g_path_is_absolute (filename))
+    path = g_strdup (filename);
+  else
+    {
+      cwd = g_get_current_dir ();
+      path = g_build_filename (cwd, filename, NULL);
+      g_free (cwd);
+    }
+  uri = g_filename_to_uri (path, NULL, NULL);
+
+  cache = mx_texture_cache_get_default ();
+  texture = mx_texture_cache_get_cogl_texture (cache, path);
+  if (!texture)
+    {
+      g_printerr ("Unable to load '%s'\n", path);
+      return 1;
+    }
+  cogl_handle_unref (texture);
+
+  g_print ("%d cache hits on '%s'\n", N_LOOKUPS, path);
+
+  time_lookups (cache, "absolute path", path);
+  time_lookups (cache, "URI", uri);
+  if (!g_path_is_absolute (filename))
+    time_lookups (cache, "relative path", filename);
+
+  /* What every lookup by path used to cost before reaching the hash table */
+  is_uri = g_regex_new ("^([a-zA-Z0-9+.-]+)://.*", G_REGEX_OPTIMIZE, 0, NULL);
+  timer = g_timer_new ();
+  for (i = 0; i < N_LOOKUPS; i++)
+    g_free (old_normalise (is_uri, path));
+  g_timer_stop (timer);
+
+  report ("old path normalisation", timer);
+
+  g_timer_destroy (timer);
+  g_regex_unref (is_uri);
+  g_free (uri);
+  g_free (path);
+
+  return 0;
+}
@@ -111,12 +111,12 @@ main (int argc, char *argv[])
   ClutterActor *stage, *view, *scroll;
   ClutterModel *model;
   ClutterColor color = { 0x00, 0xff, 0xff, 0xff };
-  gint i;
-  gboolean list;
+  gint i, n_rows;
+  gboolean list, is_virtual;
 
-  if (argc != 2)
+  if (argc != 2 && argc != 3)
     {
-      printf ("Usage: test-view [list | icon]\n");
+      printf ("Usage: test-view [list | icon] [virtual]\n");
       return 1;
     }
 
@@ -130,6 +130,11 @@ main (int argc, char *argv[])
       return 1;
     }
 
+  /* a virtual view only creates items for the visible rows, so it can
+   * show a lot more of them */
+  is_virtual = (argc == 3 && !g_strcmp0 ("virtual", argv[2]));
+  n_rows = is_virtual ? 50000 : 360;
+
   if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
     return 1;
 
@@ -151,7 +156,7 @@ main (int argc, char *argv[])
   model = clutter_list_model_new (2, CLUTTER_TYPE_COLOR, "color",
                                   G_TYPE_FLOAT, "size");
 
-  for (i = 0; i < 360; i++)
+  for (i = 0; i < n_rows; i++)
     {
       clutter_color_from_hls (&color,
                               g_random_double_range (0.0, 360.0), 0.6, 0.6);
@@ -160,6 +165,7 @@ main (int argc, char *argv[])
 
   if (list)
     {
+      mx_list_view_set_virtual (MX_LIST_VIEW (view), is_virtual);
       mx_list_view_set_model (MX_LIST_VIEW (view), model);
       mx_list_view_set_item_type (MX_LIST_VIEW (view), CLUTTER_TYPE_RECTANGLE);
       mx_list_view_add_attribute (MX_LIST_VIEW (view), "color", 0);
@@ -168,6 +174,7 @@ main (int argc, char *argv[])
     }
   else
     {
+      mx_item_view_set_virtual (MX_ITEM_VIEW (view), is_virtual);
       mx_item_view_set_model (MX_ITEM_VIEW (view), model);
       mx_item_view_set_item_type (MX_ITEM_VIEW (view), CLUTTER_TYPE_RECTANGLE);
       mx_item_view_add_attribute (MX_ITEM_VIEW (view), "color", 0);